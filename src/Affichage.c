@@ -1,6 +1,8 @@
+#include <stdbool.h>
 #include <stdio.h>
 
 #include "Affichage.h"
+#include "Mesures.h"
 
 char *chaine_type[] = {
   "<vide>",	                         // Commande vide 
@@ -15,52 +17,121 @@ char *chaine_type[] = {
   "Sortie standard (concaténation) dans",// Redirection sortie standard, mode append 
   "Sortie d'erreur dans", 	         // Redirection sortie erreur 
   "Sorties standard et d'erreur dans",   // Redirection sortie standard et erreur
-  "Sous-shell mystérieux"};              // Mystère...
+  "Sous-shell mystérieux",               // Mystère...
+  "Si",                                  // if
+  "Alors / sinon",                       // Branches then et else
+  "Tant que",                            // while
+  "Jusqu'à",                             // until
+  "Pour",                                // for
+  "Document en entrée",                  // Document (<<MOT)
+  "Chaîne en entrée"};                   // Chaîne (<<<)
 
 
 
-void indenter_vide(int indentation, int trait){
+void indenter_vide(FILE *f, int indentation, int trait){
   for(int i = 1; i<= indentation + trait; i++)
     if ( i % trait == 0)
-      putchar('|');
+      fputc('|', f);
     else
-      putchar(' ');
+      fputc(' ', f);
 }
 
-void indenter(int indentation, int trait){
+void indenter(FILE *f, int indentation, int trait){
   for(int i = 1; i< indentation; i++)
     if ( i % trait == 0)
-      putchar('|');
+      fputc('|', f);
     else
-      putchar(' '); 
-  putchar('|');
+      fputc(' ', f); 
+  fputc('|', f);
   for(int i = 2; i< trait; i++)
     if ( indentation % trait == 0)
-      putchar('-');
-  putchar('>');
-  putchar(' ');
+      fputc('-', f);
+  fputc('>', f);
+  fputc(' ', f);
+}
+
+
+
+/*
+ * Mesures d'un noeud en mode analyse (voir Mesures.c), en fin de ligne
+ */
+
+static bool avec_mesures = false;
+
+static void ecrire_duree(FILE *f, const char *nom, double s){
+  if (s >= 1)
+    fprintf(f, "%s %.3f s", nom, s);
+  else
+    fprintf(f, "%s %.3f ms", nom, s * 1e3);
+}
+
+static void ecrire_octets(FILE *f, const char *nom, long long n){
+  if (n >= 1 << 30)
+    fprintf(f, "%s %.1f Go", nom, n / (double) (1 << 30));
+  else if (n >= 1 << 20)
+    fprintf(f, "%s %.1f Mo", nom, n / (double) (1 << 20));
+  else if (n >= 1 << 10)
+    fprintf(f, "%s %.1f Ko", nom, n / (double) (1 << 10));
+  else
+    fprintf(f, "%s %lld o", nom, n);
+}
+
+static void terminer_ligne(FILE *f, Expression *e){
+  Mesure *m = e->mesure, *amont;
+
+  if (avec_mesures && m != NULL && m->executee){
+    fputs("  {", f);
+    ecrire_duree(f, "réel", m->fin - m->debut);
+    ecrire_duree(f, ", util", m->utilisateur);
+    ecrire_duree(f, ", sys", m->systeme);
+    fprintf(f, ", RSS %ld Ko, statut %d", m->rss_max, m->statut);
+
+    switch(e->type){
+    case PIPE : // Ce qu'a écrit l'étage juste avant le tube
+      amont = (e->gauche->type == PIPE) ? e->gauche->droite->mesure : e->gauche->mesure;
+      ecrire_octets(f, ", tube", amont->ecrits);
+      break;
+    case REDIRECTION_I :
+    case REDIRECTION_DOC :
+    case REDIRECTION_CHAINE :
+      ecrire_octets(f, ", lus", m->lus);
+      break;
+    case REDIRECTION_O :
+    case REDIRECTION_A :
+    case REDIRECTION_E :
+    case REDIRECTION_EO :
+      ecrire_octets(f, ", écrits", m->ecrits);
+      break;
+    default :
+      ecrire_octets(f, ", lus", m->lus);
+      ecrire_octets(f, ", écrits", m->ecrits);
+    }
+    fputc('}', f);
+  }
+  fputc('\n', f);
 }
 
 
 
   
-void afficher_exprL(Expression *e, int indentation, int trait)
+void afficher_exprL(FILE *f, Expression *e, int indentation, int trait)
 {
   if (e == NULL) return ;
 
   switch(e->type){
 
   case VIDE :
-    indenter(indentation,trait);
-    printf("%s\n", chaine_type[e->type]);
+    indenter(f,indentation,trait);
+    fprintf(f, "%s", chaine_type[e->type]);
+    terminer_ligne(f, e);
     break ;
     
   case SIMPLE :
-    indenter(indentation,trait);
-    printf("%s ", chaine_type[e->type]);
+    indenter(f,indentation,trait);
+    fprintf(f, "%s ", chaine_type[e->type]);
     for(int i=0; e->arguments[i] != NULL;i++)
-      printf("[%s]",e->arguments[i]);
-    putchar('\n');
+      fprintf(f, "[%s]",e->arguments[i]);
+    terminer_ligne(f, e);
     break;
 
   case REDIRECTION_I: 	
@@ -68,23 +139,41 @@ void afficher_exprL(Expression *e, int indentation, int trait)
   case REDIRECTION_A: 	
   case REDIRECTION_E: 	
   case REDIRECTION_EO :
-    indenter(indentation,trait);    
-    printf("%s [%s]\n",chaine_type[e->type], e->arguments[0]);
-    afficher_exprL(e->gauche, indentation + trait, trait);
+  case REDIRECTION_CHAINE :
+    indenter(f,indentation,trait);    
+    fprintf(f, "%s [%s]",chaine_type[e->type], e->arguments[0]);
+    terminer_ligne(f, e);
+    afficher_exprL(f, e->gauche, indentation + trait, trait);
+    break;
+  case REDIRECTION_DOC : // Le texte, puis son délimiteur
+    indenter(f,indentation,trait);
+    fprintf(f, "%s [%s] jusqu'à [%s]",chaine_type[e->type], e->arguments[0], e->arguments[1]);
+    terminer_ligne(f, e);
+    afficher_exprL(f, e->gauche, indentation + trait, trait);
     break;
   case BG:
   case SOUS_SHELL:
-    indenter(indentation,trait);
-    printf("%s\n", chaine_type[e->type]);
-    afficher_exprL(e->gauche, indentation + trait, trait);
+    indenter(f,indentation,trait);
+    fprintf(f, "%s", chaine_type[e->type]);
+    terminer_ligne(f, e);
+    afficher_exprL(f, e->gauche, indentation + trait, trait);
+    break;
+  case POUR:
+    indenter(f,indentation,trait);
+    fprintf(f, "%s [%s] dans ", chaine_type[e->type], e->arguments[0]);
+    for(int i=1; e->arguments[i] != NULL;i++)
+      fprintf(f, "[%s]",e->arguments[i]);
+    terminer_ligne(f, e);
+    afficher_exprL(f, e->gauche, indentation + trait, trait);
     break;
   default :
 
-    indenter(indentation,trait);
-    printf("%s\n", chaine_type[e->type]);
-    afficher_exprL(e->gauche, indentation + trait, trait);
-    indenter_vide(indentation,trait);putchar('\n');
-    afficher_exprL(e->droite, indentation + trait, trait);      
+    indenter(f,indentation,trait);
+    fprintf(f, "%s", chaine_type[e->type]);
+    terminer_ligne(f, e);
+    afficher_exprL(f, e->gauche, indentation + trait, trait);
+    indenter_vide(f,indentation,trait);fputc('\n', f);
+    afficher_exprL(f, e->droite, indentation + trait, trait);      
   }
 }
 
@@ -93,6 +182,116 @@ void afficher_exprL(Expression *e, int indentation, int trait)
 void afficher_expr(Expression *e)
 {
   printf("\n");
-  afficher_exprL(e,4,4);
+  afficher_exprL(stdout,e,4,4);
   printf("\n");
 }
+
+
+
+/*
+ * Mode analyse : l'arbre d'une ligne déjà exécutée, chaque noeud suivi de ses
+ * mesures (sur la sortie d'erreur, pour ne pas se mêler à celle des commandes)
+ */
+
+void afficher_analyse(Expression *e)
+{
+  avec_mesures = true;
+  fprintf(stderr, "\n");
+  afficher_exprL(stderr,e,4,4);
+  fprintf(stderr, "\n");
+  avec_mesures = false;
+}
+
+
+
+/*
+ * Réécrit une expression en syntaxe du shell (pour la liste des tâches)
+ */
+
+static const char *operateur[] = {
+  "", "", " ; ", " && ", " || ", " &", " | ", " < ", " > ", " >> ", " 2> ", " &> ", "",
+  "", "", "while ", "until ", "", " <<", " <<< "};
+
+void ecrire_expr(FILE *f, Expression *e)
+{
+  if (e == NULL) return ;
+
+  switch(e->type){
+
+  case VIDE :
+    break;
+
+  case SIMPLE :
+    for(int i=0; e->arguments[i] != NULL;i++)
+      fprintf(f, (strpbrk(e->arguments[i], " \t") != NULL) ? "%s\"%s\"" : "%s%s",
+	      (i > 0) ? " " : "", e->arguments[i]);
+    break;
+
+  case REDIRECTION_I:
+  case REDIRECTION_O:
+  case REDIRECTION_A:
+  case REDIRECTION_E:
+  case REDIRECTION_EO :
+  case REDIRECTION_CHAINE :
+    ecrire_expr(f, e->gauche);
+    fprintf(f, "%s%s", operateur[e->type], e->arguments[0]);
+    break;
+  case REDIRECTION_DOC : // Le délimiteur seul
+    ecrire_expr(f, e->gauche);
+    fprintf(f, "%s%s", operateur[e->type], e->arguments[1]);
+    break;
+  case BG:
+    ecrire_expr(f, e->gauche);
+    fputs(operateur[e->type], f);
+    break;
+  case SOUS_SHELL:
+    fputs("( ", f);
+    ecrire_expr(f, e->gauche);
+    fputs(" )", f);
+    break;
+  case SI:
+    fputs("if ", f);
+    ecrire_expr(f, e->gauche);
+    fputs(" ; then ", f);
+    ecrire_expr(f, e->droite->gauche);
+    if (e->droite->droite != NULL){
+      fputs(" ; else ", f);
+      ecrire_expr(f, e->droite->droite);
+    }
+    fputs(" ; fi", f);
+    break;
+  case TANT_QUE:
+  case JUSQUA:
+    fputs(operateur[e->type], f);
+    ecrire_expr(f, e->gauche);
+    fputs(" ; do ", f);
+    ecrire_expr(f, e->droite);
+    fputs(" ; done", f);
+    break;
+  case POUR:
+    fprintf(f, "for %s in", e->arguments[0]);
+    for(int i=1; e->arguments[i] != NULL;i++)
+      fprintf(f, " %s", e->arguments[i]);
+    fputs(" ; do ", f);
+    ecrire_expr(f, e->gauche);
+    fputs(" ; done", f);
+    break;
+  default :
+    ecrire_expr(f, e->gauche);
+    fputs(operateur[e->type], f);
+    ecrire_expr(f, e->droite);
+  }
+}
+
+
+
+char *expr_en_texte(Expression *e)
+{
+  char *texte = NULL;
+  size_t taille;
+  FILE *f = open_memstream(&texte, &taille);
+
+  ecrire_expr(f, e);
+  fclose(f);
+  return texte;
+}
@@ -1,8 +1,13 @@
 #ifndef _AFFICHAGE_H
 #define _AFFICHAGE_H
 
+#include <stdio.h>
+
 #include "Shell.h"
 
 extern void afficher_expr(Expression *e);
+extern void afficher_analyse(Expression *e);
+extern void ecrire_expr(FILE *f, Expression *e);
+extern char *expr_en_texte(Expression *e);
 
 #endif
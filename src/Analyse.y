@@ -1,30 +1,55 @@
 %{
 #include "Shell.h"
-extern int yylex(void);
+#include "Variables.h"
 %}
 
+/* Analyseur pur : aucun état global, chaque flot de lignes de commande a son
+   Analyseur (voir Shell.h), passé à yyparse() puis à l'analyseur lexical */
+%define api.pure full
+%parse-param {Analyseur *analyseur}
+%lex-param {Analyseur *analyseur}
+
 %union {
   Expression *Expr;
-  char       **ListeArgs;
-  char	     identificateur[TAILLE_ID];
+  ListeArgs  *Liste;
+  char	     *texte;		/* Mot copié dans l'arène par l'analyseur lexical */
 }
 
-%token <identificateur> IDENTIFICATEUR
+%token <texte> IDENTIFICATEUR
 %nonassoc '&'
 %left ';' ET OU
 %left '|'
-%token IN OUT OUT_APPEND ERR ERR_OUT
-%left  IN OUT OUT_APPEND ERR ERR_OUT
+%token IN OUT OUT_APPEND ERR ERR_OUT DOCUMENT CHAINE
+%left  IN OUT OUT_APPEND ERR ERR_OUT DOCUMENT CHAINE
+%token IF THEN ELIF ELSE FI WHILE UNTIL FOR DANS DO DONE
 
 %type <Expr> expression_ou_rien
 %type <Expr> expression
-%type <ListeArgs> commande
-%type <ListeArgs> fichier
+%type <Expr> liste
+%type <Expr> suite_si
+%type <Liste> commande
+%type <Liste> pour
+%type <Liste> fichier
+
+%code {
+  int analyser_mot (YYSTYPE *, void *);
+
+  static int
+  yylex (YYSTYPE *lval, Analyseur *a)
+  {
+    return analyser_mot (lval, a->scanner);
+  }
+}
 
 %%
 lignecommande	: expression_ou_rien '\n' 
 		    {
-  		      ExpressionAnalysee = $1;
+  		      analyseur->expression = $1;
+  		      YYACCEPT;
+		    }
+		| /* fin de l'entrée */
+		    {
+  		      analyseur->expression = NULL;
   		      YYACCEPT;
 		    }
 		| error '\n'
@@ -44,7 +69,7 @@ expression_ou_rien :
 expression	: 		    
 		  commande
 		    {
-  			$$ = ConstruireNoeud (SIMPLE, NULL, NULL, $1);
+  			$$ = ConstruireNoeud (SIMPLE, NULL, NULL, $1->arguments);
 		    }
 		| expression ';' expression 
 		    {
@@ -64,23 +89,34 @@ expression	:
 		    }
 		| expression IN  fichier
 		    {
-  		      $$ = ConstruireNoeud (REDIRECTION_I, $1, NULL, $3);
+  		      $$ = ConstruireNoeud (REDIRECTION_I, $1, NULL, $3->arguments);
 		    }
 	  	| expression OUT fichier
 		    {
-  		      $$ = ConstruireNoeud (REDIRECTION_O, $1, NULL, $3);
+  		      $$ = ConstruireNoeud (REDIRECTION_O, $1, NULL, $3->arguments);
 		    }
 	  	| expression ERR fichier
 		    {
-  		      $$ = ConstruireNoeud (REDIRECTION_E, $1, NULL, $3);
+  		      $$ = ConstruireNoeud (REDIRECTION_E, $1, NULL, $3->arguments);
 		    }
 	  	| expression ERR_OUT fichier
 		    {
-  		      $$ = ConstruireNoeud (REDIRECTION_EO, $1, NULL, $3);
+  		      $$ = ConstruireNoeud (REDIRECTION_EO, $1, NULL, $3->arguments);
 		    }
 	       	| expression OUT_APPEND fichier
 		    {
-  		      $$ = ConstruireNoeud (REDIRECTION_A, $1, NULL, $3);
+  		      $$ = ConstruireNoeud (REDIRECTION_A, $1, NULL, $3->arguments);
+		    }
+		| expression DOCUMENT fichier
+		    {
+		      /* Le texte du document, lu par l'analyseur lexical après la
+			 fin de ligne, prendra la place du délimiteur, gardé ensuite */
+		      $$ = ConstruireNoeud (REDIRECTION_DOC, $1, NULL, AjouterArg ($3, $3->arguments[0])->arguments);
+		      attendre_document (analyseur, $$);
+		    }
+		| expression CHAINE fichier
+		    {
+		      $$ = ConstruireNoeud (REDIRECTION_CHAINE, $1, NULL, $3->arguments);
 		    }
 		| expression '&'
 		    {
@@ -90,23 +126,76 @@ expression	:
 		    {
   		      $$ = ConstruireNoeud (SOUS_SHELL, $2, NULL, NULL);
 		    }
+		| IF liste THEN liste suite_si FI
+		    {
+		      $$ = ConstruireNoeud (SI, $2, ConstruireNoeud (ALTERNATIVE, $4, $5, NULL), NULL);
+		    }
+		| WHILE liste DO liste DONE
+		    {
+		      $$ = ConstruireNoeud (TANT_QUE, $2, $4, NULL);
+		    }
+		| UNTIL liste DO liste DONE
+		    {
+		      $$ = ConstruireNoeud (JUSQUA, $2, $4, NULL);
+		    }
+		| pour ';' DO liste DONE
+		    {
+		      $$ = ConstruireNoeud (POUR, $4, NULL, $1->arguments);
+		    }
+		;
+
+/* Corps d'une construction : le ';' (ou la fin de ligne) qui précède then,
+   do, fi... est facultatif */
+liste		: expression
+		| expression ';'
+		;
+
+suite_si	:
+		    {
+		      $$ = NULL;
+		    }
+		| ELSE liste
+		    {
+		      $$ = $2;
+		    }
+		| ELIF liste THEN liste suite_si
+		    {
+		      $$ = ConstruireNoeud (SI, $2, ConstruireNoeud (ALTERNATIVE, $4, $5, NULL), NULL);
+		    }
+		;
+
+/* for nom in mots : le nom de la variable, puis les mots à lui affecter */
+pour		: FOR IDENTIFICATEUR DANS
+		    {
+		      if (!nom_valide ($2, strlen ($2)))
+			{
+			  yyerror (analyseur, "for : nom de variable invalide");
+			  YYERROR;
+			}
+		      ListeArgs *p = InitialiserListeArguments ();
+		      $$ = AjouterArg (p, $2);
+		    }
+		| pour IDENTIFICATEUR
+		    {
+		      $$ = AjouterArg ($1, $2);
+		    }
 		;
 
 fichier		: IDENTIFICATEUR
 		    {
-  		      char **p = InitialiserListeArguments ();
-  		      $$ = AjouterArg (p, yylval.identificateur);
+  		      ListeArgs *p = InitialiserListeArguments ();
+  		      $$ = AjouterArg (p, $1);
 		    }
 		;
 
 commande	: IDENTIFICATEUR
 		    {
-  		      char **p = InitialiserListeArguments ();
-  		      $$ = AjouterArg (p, yylval.identificateur);
+  		      ListeArgs *p = InitialiserListeArguments ();
+  		      $$ = AjouterArg (p, $1);
 		    }
 		| commande IDENTIFICATEUR
 		    {
-		      $$ = AjouterArg ($1,yylval.identificateur);
+		      $$ = AjouterArg ($1, $2);
 		    }
 		;
 %%
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Arene.h"
+
+#define ALIGNEMENT sizeof(void *)
+
+Arene arene_ligne = {NULL, NULL};
+
+////////////////////////////////
+// BLOC* NOUVEAU_BLOC(SIZE_T) //
+/////////////////////////////////////////////////////////////////
+// Alloue un bloc vide pouvant contenir au moins taille octets //
+/////////////////////////////////////////////////////////////////
+
+static Bloc *
+nouveau_bloc(size_t taille){
+  Bloc *b;
+
+  if (taille < ARENE_TAILLE_BLOC)
+    taille = ARENE_TAILLE_BLOC;
+  if ((b = malloc(sizeof(Bloc) + taille)) == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  b->suivant = NULL;
+  b->taille = taille;
+  b->utilise = 0;
+  return b;
+}
+
+/////////////////////////////////////////
+// VOID* ARENE_ALLOUER(ARENE*, SIZE_T) //
+////////////////////////////////////////////////////////////////////////
+// Découpe taille octets dans le bloc courant. Quand il est plein, on //
+// passe au bloc suivant (gardé d'une ligne précédente) ou on en crée //
+// un nouveau.                                                        //
+////////////////////////////////////////////////////////////////////////
+
+void *
+arene_allouer(Arene *a, size_t taille){
+  Bloc *b;
+  void *p;
+
+  taille = (taille + ALIGNEMENT - 1) & ~(ALIGNEMENT - 1);
+
+  if (a->courant == NULL)
+    a->premier = a->courant = nouveau_bloc(taille);
+
+  while (a->courant->taille - a->courant->utilise < taille){
+    b = a->courant->suivant;
+    if (b == NULL || b->taille < taille){
+      b = nouveau_bloc(taille);
+      b->suivant = a->courant->suivant;
+      a->courant->suivant = b;
+    }
+    a->courant = b;
+  }
+
+  p = a->courant->donnees + a->courant->utilise;
+  a->courant->utilise += taille;
+  return p;
+}
+
+/////////////////////////////////////////////////////
+// CHAR* ARENE_COPIER(ARENE*, CONST CHAR*, SIZE_T) //
+/////////////////////////////////////////////////////////////
+// Copie les longueur premiers octets de s dans l'arène et //
+// termine la copie par '\0'                               //
+/////////////////////////////////////////////////////////////
+
+char *
+arene_copier(Arene *a, const char *s, size_t longueur){
+  char *copie = arene_allouer(a, longueur + 1);
+  memcpy(copie, s, longueur);
+  copie[longueur] = '\0';
+  return copie;
+}
+
+//////////////////////////////////////
+// VOID ARENE_REINITIALISER(ARENE*) //
+////////////////////////////////////////////////////////////////////////
+// Rend toute la mémoire distribuée. Les blocs de taille normale sont //
+// gardés pour la ligne suivante, les blocs hors norme (une seule     //
+// très grosse allocation) sont rendus au système.                    //
+////////////////////////////////////////////////////////////////////////
+
+void
+arene_reinitialiser(Arene *a){
+  Bloc *b, **p;
+
+  if (a->premier == NULL)
+    return;
+
+  p = &a->premier->suivant;
+  while ((b = *p) != NULL){
+    if (b->taille > ARENE_TAILLE_BLOC){
+      *p = b->suivant;
+      free(b);
+    }
+    else {
+      b->utilise = 0;
+      p = &b->suivant;
+    }
+  }
+
+  a->premier->utilise = 0;
+  a->courant = a->premier;
+}
+
+//////////////////////////////////
+// MARQUE ARENE_MARQUER(ARENE*) //
+////////////////////////////////////////////////////////////////////////
+// Retient le point où en est l'arène, pour lui rendre plus tard tout //
+// ce qui aura été distribué depuis (un tour de boucle par exemple)   //
+////////////////////////////////////////////////////////////////////////
+
+Marque
+arene_marquer(Arene *a){
+  return (Marque){a->courant, a->courant ? a->courant->utilise : 0};
+}
+
+////////////////////////////////////////
+// VOID ARENE_REVENIR(ARENE*, MARQUE) //
+///////////////////////////////////////////////////////////////////////
+// Rend ce qui a été distribué depuis la marque m. Les blocs entamés //
+// depuis suivent celui de la marque dans la chaîne : ils sont       //
+// vidés, et seront repris dans l'ordre par les allocations.         //
+///////////////////////////////////////////////////////////////////////
+
+void
+arene_revenir(Arene *a, Marque m){
+  Bloc *b;
+
+  if (m.bloc == NULL){
+    arene_reinitialiser(a);
+    return;
+  }
+  if (m.bloc != a->courant)
+    for (b = m.bloc->suivant; b != NULL; b = b->suivant){
+      b->utilise = 0;
+      if (b == a->courant)
+	break;
+    }
+  m.bloc->utilise = m.utilise;
+  a->courant = m.bloc;
+}
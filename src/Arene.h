@@ -0,0 +1,40 @@
+#ifndef _ARENE_H
+#define _ARENE_H
+
+#include <stddef.h>
+
+/*
+ * Arène d'allocation : les noeuds, les listes d'arguments et les chaînes
+ * d'une ligne de commande y sont découpés à la suite les uns des autres, et
+ * tout est rendu d'un coup par arene_reinitialiser() une fois la ligne
+ * exécutée.
+ */
+
+#define ARENE_TAILLE_BLOC 16384
+
+typedef struct Bloc {
+  struct Bloc *suivant;
+  size_t taille;      // Octets utilisables dans donnees
+  size_t utilise;     // Octets déjà distribués
+  char donnees[];
+} Bloc;
+
+typedef struct Arene {
+  Bloc *premier;
+  Bloc *courant;
+} Arene;
+
+typedef struct Marque {  // Etat de l'arène à un instant donné
+  Bloc *bloc;
+  size_t utilise;
+} Marque;
+
+extern Arene arene_ligne; // Arène de la ligne de commande en cours
+
+void *arene_allouer(Arene *a, size_t taille);
+char *arene_copier(Arene *a, const char *s, size_t longueur);
+void arene_reinitialiser(Arene *a);
+Marque arene_marquer(Arene *a);
+void arene_revenir(Arene *a, Marque m);
+
+#endif
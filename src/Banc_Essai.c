@@ -0,0 +1,264 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "Shell.h"
+#include "Arene.h"
+#include "Commandes_Internes.h"
+#include "Evaluation.h"
+#include "Taches.h"
+
+/*--------------------------------------------------------------------------------------.
+| Banc d'essai des chemins critiques du shell ("make bench"). Chaque mesure est répétée |
+| un certain nombre de fois ; les échantillons (en nanosecondes par opération) sont     |
+| triés et résumés par leurs centiles, le tout écrit en JSON sur la sortie standard     |
+| pour pouvoir comparer deux versions :                                                 |
+|                                                                                       |
+|   { "bancs" : [ { "nom" : ..., "unite" : "ns/op", "echantillons" : n,                 |
+|                   "min" : ..., "p50" : ..., "p90" : ..., "p99" : ..., "max" : ...,    |
+|                   "moyenne" : ..., "mo_par_s" : ... }, ... ] }                        |
+|                                                                                       |
+| mo_par_s (débit, calculé sur la médiane) n'est donné que pour les mesures portant sur |
+| un volume d'octets.                                                                   |
+`--------------------------------------------------------------------------------------*/
+
+#define TAILLE_PIPELINE (64 << 20) // Octets poussés dans chaque pipeline
+
+static int premier_banc = 1;
+
+static double
+maintenant(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec * 1e9 + t.tv_nsec;
+}
+
+static int
+comparer(const void *a, const void *b){
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static double
+centile(double *t, int n, double c){
+  int i = (int) (c * (n - 1) + 0.5);
+  return t[i];
+}
+
+/////////////////////////////////////////////////////
+// VOID PUBLIER(CONST CHAR*, DOUBLE*, INT, SIZE_T) //
+///////////////////////////////////////////////////////////////////////
+// Ecrit le résumé des n échantillons (ns par opération) ; octets    //
+// est le volume traité par opération, 0 si le débit n'a pas de sens //
+///////////////////////////////////////////////////////////////////////
+
+static void
+publier(const char *nom, double *t, int n, size_t octets){
+  double somme = 0;
+  int i;
+
+  qsort(t, n, sizeof(double), comparer);
+  for (i = 0; i < n; i++)
+    somme += t[i];
+
+  printf("%s\n    { \"nom\" : \"%s\", \"unite\" : \"ns/op\", \"echantillons\" : %d,\n"
+	 "      \"min\" : %.0f, \"p50\" : %.0f, \"p90\" : %.0f, \"p99\" : %.0f, \"max\" : %.0f,"
+	 " \"moyenne\" : %.0f",
+	 premier_banc ? "" : ",", nom, n, t[0], centile(t, n, 0.5), centile(t, n, 0.9),
+	 centile(t, n, 0.99), t[n - 1], somme / n);
+  if (octets > 0)
+    printf(", \"mo_par_s\" : %.1f", octets / (centile(t, n, 0.5) / 1e9) / (1 << 20));
+  printf(" }");
+  fflush(stdout);
+  premier_banc = 0;
+}
+
+// Ligne synthétique d'environ taille octets : des commandes de quelques mots
+// enchaînées par |, && et ;
+
+static char *
+ligne_synthetique(size_t taille, size_t *longueur){
+  static const char *morceaux[] = {"ls -l /usr/bin", " | ", "grep -v toto", " && ",
+				   "echo \"un argument entre guillemets\"", " ; ",
+				   "cat < entree > sortie", " | "};
+  char *ligne = malloc(taille + 64);
+  size_t n = 0;
+  int i = 0;
+
+  do {
+    n += sprintf(ligne + n, "%s", morceaux[i++ % 8]);
+  } while (n < taille || i % 2 == 0); // Jamais d'opérateur en fin de ligne
+  ligne[n++] = '\n';
+  *longueur = n;
+  return ligne;
+}
+
+static Expression *
+analyser(Analyseur *a, const char *texte){
+  if (analyser_ligne(a, texte, strlen(texte)) != 0 || a->expression == NULL){
+    fprintf(stderr, "Banc_Essai : ligne refusée : %s", texte);
+    exit(1);
+  }
+  return a->expression;
+}
+
+///////////////////////////////////
+// VOID BANC_ANALYSE(ANALYSEUR*) //
+////////////////////////////////////////////////////////////////////
+// Débit de l'analyseur (lexical et syntaxique) sur des lignes de //
+// tailles croissantes, arbre compris                             //
+////////////////////////////////////////////////////////////////////
+
+static void
+banc_analyse(Analyseur *a){
+  static const size_t tailles[] = {16, 256, 4096, 65536};
+  double t[200], debut;
+  char nom[64], *ligne;
+  size_t longueur;
+  int i, j, k, repetitions;
+
+  for (i = 0; i < 4; i++){
+    ligne = ligne_synthetique(tailles[i], &longueur);
+    repetitions = 1 + (1 << 20) / (int) longueur; // ~1 Mo analysé par échantillon
+    for (j = 0; j < 200; j++){
+      debut = maintenant();
+      for (k = 0; k < repetitions; k++){
+	analyser_ligne(a, ligne, longueur);
+	arene_reinitialiser(&arene_ligne);
+      }
+      t[j] = (maintenant() - debut) / repetitions;
+    }
+    snprintf(nom, sizeof(nom), "analyse_ligne_%zu_octets", tailles[i]);
+    publier(nom, t, 200, longueur);
+    free(ligne);
+  }
+}
+
+////////////////////////////
+// VOID BANC_NOEUDS(VOID) //
+///////////////////////////////////////////////////////////////////////
+// Coût de construction puis de libération d'un arbre de 64 noeuds à //
+// 4 arguments (ConstruireNoeud, AjouterArg, arene_reinitialiser)    //
+///////////////////////////////////////////////////////////////////////
+
+static void
+banc_noeuds(void){
+  static char *mots[] = {"commande", "-a", "--option", "fichier"};
+  double t[500], debut;
+  Expression *e;
+  ListeArgs *l;
+  int i, j, k;
+
+  for (i = 0; i < 500; i++){
+    debut = maintenant();
+    for (j = 0; j < 1000; j++){
+      e = NULL;
+      for (k = 0; k < 32; k++){
+	l = InitialiserListeArguments();
+	for (int m = 0; m < 4; m++)
+	  l = AjouterArg(l, mots[m]);
+	e = e == NULL ? ConstruireNoeud(SIMPLE, NULL, NULL, l->arguments)
+	  : ConstruireNoeud(PIPE, e, ConstruireNoeud(SIMPLE, NULL, NULL, l->arguments), NULL);
+      }
+      arene_reinitialiser(&arene_ligne);
+    }
+    t[i] = (maintenant() - debut) / 1000;
+  }
+  publier("arbre_64_noeuds", t, 500, 0);
+}
+
+////////////////////////////////////
+// VOID BANC_INTERNES(ANALYSEUR*) //
+///////////////////////////////////////////////////////////////////
+// Aiguillage d'une commande interne muette par executer_interne //
+///////////////////////////////////////////////////////////////////
+
+static void
+banc_internes(Analyseur *a){
+  Expression *e = analyser(a, "cd .\n");
+  double t[500], debut;
+  int i, j, st;
+
+  for (i = 0; i < 500; i++){
+    debut = maintenant();
+    for (j = 0; j < 10000; j++)
+      executer_interne(e, &st);
+    t[i] = (maintenant() - debut) / 10000;
+  }
+  publier("executer_interne_cd", t, 500, 0);
+  arene_reinitialiser(&arene_ligne);
+}
+
+/////////////////////////////////////
+// VOID BANC_LANCEMENT(ANALYSEUR*) //
+///////////////////////////////////////////////////////////////////
+// Latence d'une commande externe (lancement, exec, attente) par //
+// executer_SIMPLE, chemin de la commande déjà dans le cache     //
+///////////////////////////////////////////////////////////////////
+
+static void
+banc_lancement(Analyseur *a){
+  Expression *e = analyser(a, "true\n");
+  double t[500], debut;
+  int i;
+
+  executer_expression(e); // Remplit le cache des chemins
+  for (i = 0; i < 500; i++){
+    debut = maintenant();
+    executer_expression(e);
+    t[i] = maintenant() - debut;
+  }
+  publier("commande_externe_true", t, 500, 0);
+  arene_reinitialiser(&arene_ligne);
+}
+
+/////////////////////////////////////
+// VOID BANC_PIPELINES(ANALYSEUR*) //
+///////////////////////////////////////////////////////////////////////
+// Débit à travers des pipelines de 1 à 8 étages "cat" alimentés par //
+// head -c TAILLE_PIPELINE /dev/zero                                 //
+///////////////////////////////////////////////////////////////////////
+
+static void
+banc_pipelines(Analyseur *a){
+  char ligne[512], nom[64];
+  double t[10], debut;
+  Expression *e;
+  int etages, i, n;
+
+  for (etages = 1; etages <= 8; etages *= 2){
+    n = snprintf(ligne, sizeof(ligne), "head -c %d /dev/zero", TAILLE_PIPELINE);
+    for (i = 0; i < etages; i++)
+      n += snprintf(ligne + n, sizeof(ligne) - n, " | cat");
+    snprintf(ligne + n, sizeof(ligne) - n, " > /dev/null\n");
+    e = analyser(a, ligne);
+
+    for (i = 0; i < 10; i++){
+      debut = maintenant();
+      executer_expression(e);
+      t[i] = maintenant() - debut;
+    }
+    snprintf(nom, sizeof(nom), "pipeline_%d_etages", etages);
+    publier(nom, t, 10, TAILLE_PIPELINE);
+    arene_reinitialiser(&arene_ligne);
+  }
+}
+
+int
+main(int argc, char **argv){
+  Analyseur a;
+
+  initialiser_taches(false);
+  bloquer_recolte(); // Comme pendant l'exécution d'une ligne dans le shell
+  initialiser_analyseur(&a);
+
+  printf("{ \"bancs\" : [");
+  banc_analyse(&a);
+  banc_noeuds();
+  banc_internes(&a);
+  banc_lancement(&a);
+  banc_pipelines(&a);
+  printf("\n] }\n");
+  return 0;
+}
@@ -0,0 +1,472 @@
+#define _GNU_SOURCE // asprintf()
+
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Cache.h"
+#include "Arene.h"
+
+/*--------------------------------------------------------------------------------------.
+| Cache des arbres des scripts. Sans lui, chaque exécution d'un script relit tout son   |
+| texte ligne par ligne avec flex et bison. Ici, la première exécution analyse tout le  |
+| texte d'avance et enregistre les arbres de ses lignes dans un fichier. Les exécutions |
+| suivantes projettent ce fichier en mémoire (mmap) et n'analysent plus rien.           |
+|                                                                                       |
+| Le fichier ne contient aucun pointeur. Il commence par une entête, suivie de la table |
+| des lignes, des noeuds (16 octets : le type et trois références), des listes          |
+| d'arguments, puis de la table des chaînes, où chaque mot ne figure qu'une fois. Une   |
+| référence est un numéro sur 32 bits dans sa table (0 pour NULL). Au chargement, une   |
+| seule passe construit les Expression de tous les arbres dans un seul bloc alloué. Les |
+| chaînes restent dans la projection, sans copie.                                       |
+|                                                                                       |
+| Il y a un fichier par script, nommé d'après l'empreinte du chemin absolu du script.   |
+| Il se trouve dans $TERMINA_CACHE, sinon dans $XDG_CACHE_HOME/termina ou               |
+| ~/.cache/termina ; si $TERMINA_CACHE est vide, il n'y a pas de cache. L'entête porte  |
+| l'empreinte du texte du script et de l'exécutable. Si le script est modifié ou si le  |
+| shell est recompilé, l'analyse est refaite et remplace le fichier (rename()).         |
+|                                                                                       |
+| Un script qui contient une erreur de syntaxe reste analysé ligne par ligne, comme     |
+| avant : les lignes qui précèdent l'erreur s'exécutent et l'erreur est signalée à sa   |
+| place. Son fichier ne contient que l'entête, ce qui évite de l'analyser d'avance à    |
+| chaque fois.                                                                          |
+`--------------------------------------------------------------------------------------*/
+
+#define MAGIE "Termina"         // Avec son '\0' : les 8 premiers octets du fichier
+#define VERSION_CACHE 1         // A changer avec la disposition du fichier ou expr_t
+#define FNV_BASE 14695981039346656037ULL
+#define FNV_PREMIER 1099511628211ULL
+
+typedef struct Entete {
+  char magie[8];
+  uint32_t version;
+  uint32_t erreur;              // Erreur de syntaxe : pas d'arbres
+  uint64_t empreinte;           // Du texte du script et de l'exécutable
+  uint64_t taille_script;
+  uint32_t nb_lignes, nb_noeuds, nb_cases, taille_chaines; // Tables, dans cet ordre
+} Entete;
+
+typedef struct Noeud {          // Expression, dans le fichier
+  uint32_t type;
+  uint32_t gauche, droite;      // Numéro du noeud + 1
+  uint32_t arguments;           // Numéro de la première case + 1
+} Noeud;
+
+typedef struct Tampon {         // Table du fichier en construction
+  char *octets;
+  size_t longueur, capacite;
+} Tampon;
+
+static Tampon lignes, noeuds, cases, chaines;
+static uint32_t *table = NULL;  // Chaînes déjà enregistrées (décalage + 1, 0 : case libre)
+static size_t taille_table = 0, nb_chaines = 0;
+static uint32_t vide = 0;       // Noeud VIDE, commun à toutes les lignes vides
+
+///////////////////////////////////////////////////////
+// UINT64_T EMPREINTE(UINT64_T, CONST VOID*, SIZE_T) //
+/////////////////////////////////////////////////////////////////////
+// Continue l'empreinte h avec n octets : FNV-1a, huit octets à la //
+// fois (le décalage rabat à chaque mot les bits de poids fort)    //
+/////////////////////////////////////////////////////////////////////
+
+static uint64_t
+empreinte(uint64_t h, const void *p, size_t n){
+  const unsigned char *octets = p;
+  uint64_t mot;
+  size_t i;
+
+  for (i = 0; i + 8 <= n; i += 8){
+    memcpy(&mot, octets + i, 8);
+    h = (h ^ mot) * FNV_PREMIER;
+    h ^= h >> 29;
+  }
+  for (; i < n; i++)
+    h = (h ^ octets[i]) * FNV_PREMIER;
+  return h;
+}
+
+static uint64_t
+empreinte_texte(const char *texte, size_t taille){
+  uint64_t h = empreinte(FNV_BASE, texte, taille);
+  struct stat st;
+
+  if (stat("/proc/self/exe", &st) == 0){ // Un Termina recompilé peut construire d'autres arbres
+    h = empreinte(h, &st.st_size, sizeof(st.st_size));
+    h = empreinte(h, &st.st_mtime, sizeof(st.st_mtime));
+  }
+  return h;
+}
+
+//////////////////////////////////////
+// CHAR* FICHIER_CACHE(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Chemin du fichier du cache du script, ou NULL s'il n'y a pas de //
+// cache                                                           //
+/////////////////////////////////////////////////////////////////////
+
+static char *
+fichier_cache(const char *script){
+  char *repertoire = NULL, *absolu, *fichier = NULL;
+  const char *p;
+
+  if ((p = getenv("TERMINA_CACHE")) != NULL){
+    if (*p != '\0')
+      repertoire = strdup(p);
+  }
+  else if ((p = getenv("XDG_CACHE_HOME")) != NULL && *p != '\0'){
+    if (asprintf(&repertoire, "%s/termina", p) == -1)
+      repertoire = NULL;
+  }
+  else if ((p = getenv("HOME")) != NULL && *p != '\0'){
+    if (asprintf(&repertoire, "%s/.cache/termina", p) == -1)
+      repertoire = NULL;
+  }
+  if (repertoire == NULL)
+    return NULL;
+
+  if ((absolu = realpath(script, NULL)) != NULL){
+    if (asprintf(&fichier, "%s/%016llx", repertoire,
+		 (unsigned long long) empreinte(FNV_BASE, absolu, strlen(absolu))) == -1)
+      fichier = NULL;
+    free(absolu);
+  }
+  free(repertoire);
+  return fichier;
+}
+
+////////////////////////////////////
+// EXPRESSION** CONSTRUIRE(CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Table des lignes (terminée par NULL) des arbres du fichier dont   //
+// l'image commence en base. Leurs noeuds et leurs listes            //
+// d'arguments sont alloués d'un bloc. NULL si une référence sort de //
+// sa table (fichier abîmé)                                          //
+///////////////////////////////////////////////////////////////////////
+
+#define REFERENCE(t, r) ((r) == 0 ? NULL : &(t)[(r) - 1])
+
+static Expression **
+construire(char *base){
+  Entete *h = (Entete *) base;
+  uint32_t *l = (uint32_t *) (base + sizeof(Entete));
+  Noeud *n = (Noeud *) (l + h->nb_lignes);
+  uint32_t *c = (uint32_t *) (n + h->nb_noeuds);
+  char *s = (char *) (c + h->nb_cases), **a;
+  Expression **arbres, *e;
+  uint32_t i;
+
+  if ((arbres = malloc((h->nb_lignes + 1) * sizeof(Expression *) + h->nb_noeuds * sizeof(Expression)
+		       + h->nb_cases * sizeof(char *))) == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  e = (Expression *) (arbres + h->nb_lignes + 1);
+  a = (char **) (e + h->nb_noeuds);
+
+  for (i = 0; i < h->nb_lignes; i++){
+    if (l[i] == 0 || l[i] > h->nb_noeuds)
+      goto abime;
+    arbres[i] = &e[l[i] - 1];
+  }
+  arbres[i] = NULL;
+  for (i = 0; i < h->nb_noeuds; i++){
+    if (n[i].gauche > h->nb_noeuds || n[i].droite > h->nb_noeuds || n[i].arguments > h->nb_cases)
+      goto abime;
+    e[i] = (Expression){n[i].type, REFERENCE(e, n[i].gauche), REFERENCE(e, n[i].droite),
+			REFERENCE(a, n[i].arguments), NULL};
+  }
+  for (i = 0; i < h->nb_cases; i++){
+    if (c[i] > h->taille_chaines)
+      goto abime;
+    a[i] = REFERENCE(s, c[i]);
+  }
+  return arbres;
+
+ abime:
+  free(arbres);
+  return NULL;
+}
+
+////////////////////////////////////////////////////////////////
+// BOOL CHARGER(CONST CHAR*, UINT64_T, SIZE_T, EXPRESSION***) //
+//////////////////////////////////////////////////////////////////////
+// Projette le fichier s'il correspond au texte d'empreinte e et de //
+// taille octets. Vrai si c'est le cas ; *l reçoit alors la table   //
+// des lignes, ou NULL si le script a une erreur de syntaxe         //
+//////////////////////////////////////////////////////////////////////
+
+static size_t
+taille_fichier(Entete *h){
+  return sizeof(Entete) + (h->nb_lignes + (size_t) h->nb_cases) * sizeof(uint32_t)
+    + h->nb_noeuds * sizeof(Noeud) + h->taille_chaines;
+}
+
+static bool
+charger(const char *fichier, uint64_t e, size_t taille, Expression ***l){
+  struct stat st;
+  Entete *h;
+  char *base;
+  int fd;
+
+  if ((fd = open(fichier, O_RDONLY | O_CLOEXEC)) == -1)
+    return false;
+  if (fstat(fd, &st) == -1 || st.st_uid != geteuid() || (size_t) st.st_size < sizeof(Entete)
+      || (base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0)) == MAP_FAILED){
+    close(fd);
+    return false;
+  }
+  close(fd);
+
+  h = (Entete *) base;
+  if (memcmp(h->magie, MAGIE, sizeof(h->magie)) != 0 || h->version != VERSION_CACHE
+      || h->empreinte != e || h->taille_script != taille || taille_fichier(h) != (size_t) st.st_size
+      || (h->taille_chaines > 0 && base[st.st_size - 1] != '\0')){
+    munmap(base, st.st_size);
+    return false; // Autre texte, ou autre Termina : l'analyse est à refaire
+  }
+  if (h->erreur){
+    munmap(base, st.st_size);
+    *l = NULL;
+    return true;
+  }
+  // La projection reste en place : les arbres pointent sur ses chaînes. Elle
+  // est privée et modifiable, comme celle du script (voir Lecture.c)
+  if ((*l = construire(base)) == NULL){
+    munmap(base, st.st_size);
+    return false;
+  }
+  return true;
+}
+
+/////////////////////////////////////////////
+// UINT32_T ENREGISTRER_NOEUD(EXPRESSION*) //
+///////////////////////////////////////////////////////////////
+// Ajoute l'arbre e aux tables en construction et renvoie la //
+// référence de sa racine                                    //
+///////////////////////////////////////////////////////////////
+
+static size_t
+ajouter(Tampon *t, const void *p, size_t n){
+  size_t debut = t->longueur;
+
+  if (t->longueur + n > t->capacite){
+    while (t->longueur + n > t->capacite)
+      t->capacite = t->capacite ? 2 * t->capacite : 4096;
+    if ((t->octets = realloc(t->octets, t->capacite)) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(t->octets + debut, p, n);
+  t->longueur += n;
+  return debut;
+}
+
+static size_t
+chercher(const char *s){
+  size_t i = empreinte(FNV_BASE, s, strlen(s)) & (taille_table - 1);
+
+  while (table[i] != 0 && strcmp(chaines.octets + table[i] - 1, s) != 0)
+    i = (i + 1) & (taille_table - 1);
+  return i;
+}
+
+static uint32_t
+enregistrer_chaine(const char *s){
+  uint32_t *ancienne = table;
+  size_t ancienne_taille = taille_table, i;
+
+  if (2 * (nb_chaines + 1) > taille_table){ // Table à moitié pleine au plus
+    taille_table = taille_table ? 2 * taille_table : 1024;
+    if ((table = calloc(taille_table, sizeof(uint32_t))) == NULL){
+      perror("calloc");
+      exit(EXIT_FAILURE);
+    }
+    for (i = 0; i < ancienne_taille; i++)
+      if (ancienne[i] != 0)
+	table[chercher(chaines.octets + ancienne[i] - 1)] = ancienne[i];
+    free(ancienne);
+  }
+  if (table[i = chercher(s)] == 0){
+    table[i] = ajouter(&chaines, s, strlen(s) + 1) + 1;
+    nb_chaines++;
+  }
+  return table[i];
+}
+
+static uint32_t
+enregistrer_arguments(char **args){
+  uint32_t debut, c;
+
+  if (args == NULL)
+    return 0;
+  debut = cases.longueur / sizeof(uint32_t) + 1;
+  for (; *args != NULL; args++){
+    c = enregistrer_chaine(*args);
+    ajouter(&cases, &c, sizeof(c));
+  }
+  c = 0;
+  ajouter(&cases, &c, sizeof(c));
+  return debut;
+}
+
+static uint32_t
+enregistrer_noeud(Expression *e){
+  Noeud n;
+
+  if (e == NULL)
+    return 0;
+  if (e->type == VIDE && vide != 0)
+    return vide;
+  n.type = e->type;
+  n.gauche = enregistrer_noeud(e->gauche);
+  n.droite = enregistrer_noeud(e->droite);
+  n.arguments = enregistrer_arguments(e->arguments);
+  ajouter(&noeuds, &n, sizeof(n));
+  if (e->type == VIDE)
+    vide = noeuds.longueur / sizeof(Noeud);
+  return noeuds.longueur / sizeof(Noeud);
+}
+
+//////////////////////////////////////////////////////
+// CHAR* ASSEMBLER(UINT64_T, SIZE_T, BOOL, SIZE_T*) //
+/////////////////////////////////////////////////////////////////
+// Image du fichier (allouée) : l'entête puis les tables, sans //
+// arbres si erreur. Vide les tables en construction           //
+/////////////////////////////////////////////////////////////////
+
+static void
+vider(Tampon *t){
+  free(t->octets);
+  *t = (Tampon){NULL, 0, 0};
+}
+
+static char *
+assembler(uint64_t e, size_t taille, bool erreur, size_t *longueur){
+  Entete h = {MAGIE, VERSION_CACHE, erreur, e, taille};
+  Tampon *t[] = {&lignes, &noeuds, &cases, &chaines};
+  char *image, *p;
+  int i;
+
+  if (!erreur){
+    h.nb_lignes = lignes.longueur / sizeof(uint32_t);
+    h.nb_noeuds = noeuds.longueur / sizeof(Noeud);
+    h.nb_cases = cases.longueur / sizeof(uint32_t);
+    h.taille_chaines = chaines.longueur;
+  }
+  *longueur = taille_fichier(&h);
+  if ((image = malloc(*longueur)) == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(image, &h, sizeof(h));
+  for (i = 0, p = image + sizeof(h); i < 4; i++){
+    if (!erreur){
+      memcpy(p, t[i]->octets, t[i]->longueur);
+      p += t[i]->longueur;
+    }
+    vider(t[i]);
+  }
+  free(table);
+  table = NULL;
+  taille_table = nb_chaines = 0;
+  vide = 0;
+  return image;
+}
+
+/////////////////////////////////////////////////////
+// VOID ECRIRE_FICHIER(CHAR*, CONST CHAR*, SIZE_T) //
+/////////////////////////////////////////////////////////////////
+// Remplace d'un coup le fichier par l'image. Le cache est     //
+// facultatif : un échec (répertoire en lecture seule, disque  //
+// plein...) n'est pas signalé, le script s'exécute quand même //
+/////////////////////////////////////////////////////////////////
+
+static void
+ecrire_fichier(char *fichier, const char *image, size_t n){
+  char *temporaire, *p;
+  ssize_t ecrit = 0;
+  int fd;
+
+  for (p = strchr(fichier + 1, '/'); p != NULL; p = strchr(p + 1, '/')){
+    *p = '\0';
+    mkdir(fichier, 0700); // Le plus souvent déjà là
+    *p = '/';
+  }
+
+  if (asprintf(&temporaire, "%s.%d", fichier, (int) getpid()) == -1)
+    return;
+  if ((fd = open(temporaire, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600)) != -1){
+    for (; n > 0 && (ecrit = write(fd, image, n)) > 0; image += ecrit, n -= ecrit)
+      ;
+    if (close(fd) == -1 || n > 0 || rename(temporaire, fichier) == -1)
+      unlink(temporaire);
+  }
+  free(temporaire);
+}
+
+/////////////////////////////////////////////////////////////////
+// EXPRESSION** PRECOMPILER_SCRIPT(CONST CHAR*, CHAR*, SIZE_T) //
+///////////////////////////////////////////////////////////////////////
+// Arbres des lignes du script, texte étant le tampon préparé par    //
+// projeter_script (voir Lecture.c) : table terminée par NULL, prise //
+// dans le cache ou construite (et enregistrée) en analysant tout le //
+// texte. NULL s'il n'y a pas de cache ou si le script a une erreur  //
+// de syntaxe : il est alors analysé ligne par ligne                 //
+///////////////////////////////////////////////////////////////////////
+
+Expression **
+precompiler_script(const char *script, char *texte, size_t taille){
+  Expression **l;
+  Analyseur a;
+  uint32_t racine;
+  char *fichier, *copie, *image;
+  uint64_t e;
+  size_t n;
+  int ret;
+
+  if ((fichier = fichier_cache(script)) == NULL)
+    return NULL;
+  e = empreinte_texte(texte, taille);
+  if (charger(fichier, e, taille, &l)){
+    free(fichier);
+    return l;
+  }
+
+  // L'analyseur lexical écrit dans son tampon : le texte reste intact pour
+  // l'analyse ligne par ligne, si une erreur de syntaxe y ramène
+  if ((copie = malloc(taille)) == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(copie, texte, taille);
+  initialiser_analyseur(&a);
+  a.silencieux = 1;
+  analyser_tampon(&a, copie, taille);
+  while ((ret = yyparse(&a)) == 0 && a.expression != NULL){
+    racine = enregistrer_noeud(a.expression);
+    ajouter(&lignes, &racine, sizeof(racine));
+    arene_reinitialiser(&arene_ligne);
+  }
+  arene_reinitialiser(&arene_ligne);
+  detruire_analyseur(&a);
+  free(copie);
+
+  if (chaines.longueur >= UINT32_MAX || noeuds.longueur / sizeof(Noeud) >= UINT32_MAX
+      || cases.longueur / sizeof(uint32_t) >= UINT32_MAX)
+    ret = 1; // Trop grand pour des références sur 32 bits : analysé ligne par ligne
+  image = assembler(e, taille, ret != 0, &n);
+  ecrire_fichier(fichier, image, n);
+  free(fichier);
+  if (ret != 0 || (l = construire(image)) == NULL){
+    free(image);
+    return NULL;
+  }
+  return l; // L'image reste allouée : les arbres pointent sur ses chaînes
+}
@@ -0,0 +1,16 @@
+#ifndef _CACHE_H
+#define _CACHE_H
+
+#include <stddef.h>
+
+#include "Shell.h"
+
+/*
+ * Arbres précompilés des scripts : la première exécution d'un script analyse
+ * tout son texte et enregistre ses arbres dans un fichier du cache ; les
+ * suivantes les projettent en mémoire, sans analyse lexicale ni syntaxique.
+ */
+
+Expression **precompiler_script(const char *script, char *texte, size_t taille);
+
+#endif
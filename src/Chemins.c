@@ -0,0 +1,280 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Chemins.h"
+#include "Variables.h"
+
+/*--------------------------------------------------------------------------------------.
+| Cache des emplacements des commandes externes. execvp() parcourt $PATH à chaque       |
+| commande et paie un execve() raté par répertoire avant le bon ; ici le chemin absolu  |
+| de chaque commande est cherché une fois (un stat() par répertoire), puis gardé dans   |
+| une table de hachage à adressage ouvert.                                              |
+|                                                                                       |
+| Le cache est vidé quand $PATH change, ou quand la date de modification d'un de ses    |
+| répertoires change (vérifié au plus une fois par seconde) : une commande ajoutée ou   |
+| retirée modifie son répertoire.                                                       |
+`--------------------------------------------------------------------------------------*/
+
+#define CAPACITE_INITIALE 64
+#define PATH_DEFAUT "/bin:/usr/bin"
+
+typedef struct Commande {
+  char *nom;          // NULL pour une case vide
+  char *chemin;
+  uint32_t hachage;
+  int occurrences;    // Nombre de lancements servis par le cache
+} Commande;
+
+typedef struct Dossier {
+  char *nom;
+  struct timespec modification;
+} Dossier;
+
+static Commande *table = NULL;
+static size_t capacite = 0, nombre = 0;
+
+static char *path_connu = NULL;      // Valeur de $PATH correspondant au cache
+static Dossier *dossiers = NULL;     // Ses répertoires, dans l'ordre
+static int nb_dossiers = 0;
+static time_t derniere_verification = 0;
+
+static uint32_t
+hacher(const char *s){
+  uint32_t h = 2166136261u; // FNV-1a
+  while (*s)
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+  return h;
+}
+
+///////////////////////////////////////////////////
+// COMMANDE* TROUVER_CASE(CONST CHAR*, UINT32_T) //
+///////////////////////////////////////////////////////////////////
+// Sondage linéaire : renvoie la case de nom, ou la case vide où //
+// il faudrait l'insérer                                         //
+///////////////////////////////////////////////////////////////////
+
+static Commande *
+trouver_case(const char *nom, uint32_t h){
+  size_t i = h & (capacite - 1);
+
+  while (table[i].nom != NULL && (table[i].hachage != h || strcmp(table[i].nom, nom) != 0))
+    i = (i + 1) & (capacite - 1);
+  return &table[i];
+}
+
+static void
+agrandir_table(void){
+  Commande *ancienne = table;
+  size_t ancienne_capacite = capacite;
+
+  capacite = capacite ? 2 * capacite : CAPACITE_INITIALE;
+  if ((table = calloc(capacite, sizeof(Commande))) == NULL){
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < ancienne_capacite; i++)
+    if (ancienne[i].nom != NULL)
+      *trouver_case(ancienne[i].nom, ancienne[i].hachage) = ancienne[i];
+  free(ancienne);
+}
+
+//////////////////////////////////
+// VOID VIDER_CACHE_COMMANDES() //
+////////////////////////////////////////////////
+// Oublie tous les chemins (commande hash -r) //
+////////////////////////////////////////////////
+
+void
+vider_cache_commandes(void){
+  for (size_t i = 0; i < capacite; i++)
+    if (table[i].nom != NULL){
+      free(table[i].nom);
+      free(table[i].chemin);
+      table[i].nom = NULL;
+    }
+  nombre = 0;
+}
+
+////////////////////////////////////////
+// VOID OUBLIER_COMMANDE(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Retire une commande du cache (son chemin n'est plus valable).   //
+// Les cases suivantes de la même grappe sont réinsérées, pour que //
+// le sondage linéaire ne s'arrête pas sur le trou.                //
+/////////////////////////////////////////////////////////////////////
+
+void
+oublier_commande(const char *nom){
+  Commande *c, deplacee;
+  size_t i;
+
+  if (capacite == 0)
+    return;
+  c = trouver_case(nom, hacher(nom));
+  if (c->nom == NULL)
+    return;
+
+  free(c->nom);
+  free(c->chemin);
+  c->nom = NULL;
+  nombre--;
+
+  for (i = (c - table + 1) & (capacite - 1); table[i].nom != NULL; i = (i + 1) & (capacite - 1)){
+    deplacee = table[i];
+    table[i].nom = NULL;
+    *trouver_case(deplacee.nom, deplacee.hachage) = deplacee;
+  }
+}
+
+//////////////////////////////
+// VOID VALIDER_CACHE(VOID) //
+/////////////////////////////////////////////////////////////////////
+// Vide le cache si $PATH a changé depuis le remplissage, ou si un //
+// de ses répertoires a été modifié                                //
+/////////////////////////////////////////////////////////////////////
+
+static void
+relire_path(const char *path){
+  const char *debut, *fin;
+
+  for (int i = 0; i < nb_dossiers; i++)
+    free(dossiers[i].nom);
+  free(dossiers);
+  free(path_connu);
+
+  path_connu = strdup(path);
+  nb_dossiers = 1;
+  for (const char *p = path; *p; p++)
+    if (*p == ':')
+      nb_dossiers++;
+  dossiers = calloc(nb_dossiers, sizeof(Dossier));
+
+  debut = path;
+  for (int i = 0; i < nb_dossiers; i++){
+    fin = strchr(debut, ':');
+    if (fin == NULL)
+      fin = debut + strlen(debut);
+    // Une entrée vide désigne le répertoire courant
+    dossiers[i].nom = (fin == debut) ? strdup(".") : strndup(debut, fin - debut);
+    debut = fin + 1;
+  }
+}
+
+static void
+valider_cache(void){
+  const char *path = valeur_variable("PATH");
+  struct timespec maintenant;
+  struct stat st;
+  bool modifie = false;
+
+  if (path == NULL)
+    path = PATH_DEFAUT;
+
+  if (path_connu == NULL || strcmp(path, path_connu) != 0){
+    relire_path(path);
+    vider_cache_commandes();
+    modifie = true;
+  }
+  else {
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &maintenant);
+    if (maintenant.tv_sec == derniere_verification)
+      return;
+    derniere_verification = maintenant.tv_sec;
+  }
+
+  for (int i = 0; i < nb_dossiers; i++){
+    if (stat(dossiers[i].nom, &st) == -1)
+      st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+    if (st.st_mtim.tv_sec != dossiers[i].modification.tv_sec
+	|| st.st_mtim.tv_nsec != dossiers[i].modification.tv_nsec){
+      dossiers[i].modification = st.st_mtim;
+      modifie = true;
+    }
+  }
+
+  if (modifie)
+    vider_cache_commandes();
+}
+
+//////////////////////////////////////////
+// CHAR* CHERCHER_COMMANDE(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Renvoie le chemin de l'exécutable nom, ou NULL s'il n'est dans  //
+// aucun répertoire de $PATH. Un nom contenant '/' est renvoyé tel //
+// quel. Le chemin renvoyé appartient au cache.                    //
+/////////////////////////////////////////////////////////////////////
+
+char *
+chercher_commande(const char *nom){
+  static char *trouve = NULL;
+  Commande *c;
+  uint32_t h;
+  struct stat st;
+  size_t longueur = strlen(nom);
+
+  if (strchr(nom, '/') != NULL)
+    return (char *) nom;
+
+  valider_cache();
+
+  h = hacher(nom);
+  if (capacite != 0){
+    c = trouver_case(nom, h);
+    if (c->nom != NULL){
+      c->occurrences++;
+      return c->chemin;
+    }
+  }
+
+  for (int i = 0; i < nb_dossiers; i++){
+    free(trouve);
+    trouve = malloc(strlen(dossiers[i].nom) + longueur + 2);
+    sprintf(trouve, "%s/%s", dossiers[i].nom, nom);
+    if (stat(trouve, &st) == 0 && S_ISREG(st.st_mode) && access(trouve, X_OK) == 0)
+      break;
+    free(trouve);
+    trouve = NULL;
+  }
+
+  if (trouve == NULL)
+    return NULL;
+
+  // Un répertoire relatif dépend du répertoire courant : pas de cache
+  if (trouve[0] != '/')
+    return trouve;
+
+  if (2 * (nombre + 1) > capacite)
+    agrandir_table();
+  c = trouver_case(nom, h);
+  c->nom = strdup(nom);
+  c->chemin = trouve;
+  c->hachage = h;
+  c->occurrences = 1;
+  nombre++;
+  trouve = NULL;
+  return c->chemin;
+}
+
+//////////////////////////////////////////
+// VOID AFFICHER_CACHE_COMMANDES(FILE*) //
+////////////////////////////////////////////////////
+// Liste le cache, comme le fait la commande hash //
+////////////////////////////////////////////////////
+
+void
+afficher_cache_commandes(FILE *f){
+  if (nombre == 0){
+    fprintf(f, "hash : cache vide.\n");
+    return;
+  }
+  fprintf(f, "lancements\tcommande\n");
+  for (size_t i = 0; i < capacite; i++)
+    if (table[i].nom != NULL)
+      fprintf(f, "%10d\t%s\n", table[i].occurrences, table[i].chemin);
+}
@@ -0,0 +1,11 @@
+#ifndef _CHEMINS_H
+#define _CHEMINS_H
+
+#include <stdio.h>
+
+char *chercher_commande(const char *nom);
+void oublier_commande(const char *nom);
+void vider_cache_commandes(void);
+void afficher_cache_commandes(FILE *f);
+
+#endif
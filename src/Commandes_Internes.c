@@ -1,8 +1,22 @@
-#include <readline/history.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
 #include <signal.h>
+#include <sys/stat.h>
 #include <time.h>
 
 #include "Commandes_Internes.h"
+#include "Chemins.h"
+#include "Copie.h"
+#include "Distant.h"
+#include "Historique.h"
+#include "Lancement.h"
+#include "Parallele.h"
+#include "Saisie.h"
+#include "Statistiques.h"
+#include "Substitution.h"
+#include "Taches.h"
+#include "Variables.h"
 
 ////////////////////////////////
 // CHAR* COMMANDES_INTERNES[] //
@@ -10,7 +24,7 @@
 // Liste des commandes internes gérées par le programme //
 //////////////////////////////////////////////////////////
 
-static const char* commandes_internes[] = {
+const char* commandes_internes[] = {
   "echo",
   "date",
   "cd",
@@ -21,6 +35,17 @@ static const char* commandes_internes[] = {
   "exit",
   "remote",
   "majora",
+  "hash",
+  "jobs",
+  "wait",
+  "fg",
+  "bg",
+  "cat",
+  "copy",
+  "export",
+  "unset",
+  "parallel",
+  "stats",
   NULL
 };
 
@@ -111,24 +136,44 @@ interne_pwd (Expression * e, int * status) {
   free(buf);
 }
 
-// history : il faut jouer avec les fonctions de l'interface readline/history.h
+// history : l'historique persistant quand il est ouvert (Historique.c), sinon
+// il faut jouer avec les fonctions de l'interface readline/history.h (chargée
+// pour l'occasion hors du mode interactif, voir Saisie.c).
+// history -s <motif> n'affiche que les entrées qui contiennent motif.
 
 static void
 interne_history (Expression * e, int * status) {
-  int pos = where_history();
+  char * motif = NULL;
+
+  if (e->arguments[1] != NULL){
+    if (strcmp(e->arguments[1], "-s") != 0 || e->arguments[2] == NULL || e->arguments[3] != NULL){
+      fprintf(stderr, "Erreur : history [-s <motif>].\n");
+      *status = 1;
+      return;
+    }
+    motif = e->arguments[2];
+  }
+
+  if (historique_ouvert()){
+    *status = afficher_historique(stdout, motif);
+    return;
+  }
+
+  int pos = charger_saisie() ? saisie.where_history() : -1;
   if (pos<0){
     fprintf(stderr, "Erreur d'exécution.\n");
     *status = 1;
     return;
   }
   HIST_ENTRY * hist;
+  *status = (motif != NULL) ? 1 : 0;
   for(int i=0; i<=pos; i++){
-    hist = history_get(i);
-    if (hist != NULL)
+    hist = saisie.history_get(i);
+    if (hist != NULL && (motif == NULL || strstr(hist->line, motif) != NULL)){
       fprintf(stdout, "%5d  %s\n", i, hist->line);
+      *status = 0;
+    }
   }
-
-  *status = 0;
 }
 
 // hostname : là encore, gethostname() fait tout le travail
@@ -202,23 +247,379 @@ interne_majora (Expression * e, int * status) {
   fprintf(stdout, "\x1b[01;31m\n\tDAWN OF THE DAY %d\n\t %d hours ellapsed\n\x1b[0m\n", (ltime.tm_yday-10), (24*(ltime.tm_yday-11)+ltime.tm_hour));
 }
 
+// jobs : liste de la table des tâches (voir Taches.c)
+
+static void
+interne_jobs (Expression * e, int * status) {
+  if (e->arguments[1] != NULL){
+    fprintf(stderr, "Erreur : jobs ne prend pas de paramètre (jobs).\n");
+    *status = 1;
+    return;
+  }
+  afficher_taches(stdout);
+  *status = 0;
+}
+
+// wait : sans paramètre, attend toutes les tâches en cours ; sinon attend les
+// tâches données, le statut étant celui de la dernière
+
+static void
+interne_wait (Expression * e, int * status) {
+  Tache * t;
+
+  *status = 0;
+  if (e->arguments[1] == NULL){
+    *status = attendre_toutes_taches();
+    return;
+  }
+  for (int i = 1; e->arguments[i] != NULL; i++){
+    if ((t = trouver_tache(e->arguments[i])) == NULL){
+      fprintf(stderr, "wait : %s : tâche inexistante.\n", e->arguments[i]);
+      *status = 127;
+      continue;
+    }
+    *status = attendre_tache(t);
+  }
+}
+
+// fg et bg : relance d'une tâche (la tâche courante par défaut), au premier
+// plan ou en arrière-plan
+
+static void
+interne_fg_bg (Expression * e, int * status, bool premier_plan) {
+  Tache * t;
+
+  if (e->arguments[1] != NULL && e->arguments[2] != NULL){
+    fprintf(stderr, "Erreur : %s prend au plus une tâche en paramètre (%s [n]).\n",
+	    e->arguments[0], e->arguments[0]);
+    *status = 1;
+    return;
+  }
+  if ((t = trouver_tache(e->arguments[1])) == NULL){
+    fprintf(stderr, "%s : tâche inexistante.\n", e->arguments[0]);
+    *status = 2;
+    return;
+  }
+  *status = reprendre_tache(t, premier_plan);
+}
+
+// hash : consultation du cache des chemins des commandes (voir Chemins.c).
+// Sans paramètre, liste le cache ; "hash -r" le vide ; "hash <commande>..."
+// cherche et mémorise les commandes données.
+
+static void
+interne_hash (Expression * e, int * status) {
+  *status = 0;
+  if (e->arguments[1] == NULL){
+    afficher_cache_commandes(stdout);
+    return;
+  }
+  if (strcmp(e->arguments[1], "-r") == 0){
+    if (e->arguments[2] != NULL){
+      fprintf(stderr, "Erreur : hash -r ne prend pas d'autre paramètre (hash -r).\n");
+      *status = 1;
+      return;
+    }
+    vider_cache_commandes();
+    return;
+  }
+  for (int i = 1; e->arguments[i] != NULL; i++)
+    if (chercher_commande(e->arguments[i]) == NULL){
+      fprintf(stderr, "hash : %s : commande introuvable.\n", e->arguments[i]);
+      *status = 2;
+    }
+}
+
+// Vrai si l'un des paramètres est une option ("-" seul désigne l'entrée standard)
+
+static bool
+a_des_options(char ** arguments){
+  for (arguments++; *arguments != NULL; arguments++)
+    if ((*arguments)[0] == '-' && (*arguments)[1] != '\0')
+      return true;
+  return false;
+}
+
+// cat : concaténation des fichiers donnés (l'entrée standard sans paramètre ou
+// pour "-") sur la sortie standard, copiés par le noyau (voir Copie.c). Une
+// option apparue au développement ($OPTIONS...) fait appeler le cat du système
+// (voir est_interne). Comme GNU cat, un fichier qui est aussi la sortie n'est
+// pas copié : il grandirait sans fin.
+
+static void
+interne_cat (Expression * e, int * status) {
+  char * entree_standard[] = {"-", NULL};
+  char ** f = (e->arguments[1] != NULL) ? e->arguments + 1 : entree_standard;
+  struct stat so, se;
+  bool sortie_fichier;
+  pid_t pid;
+  int fd;
+
+  fflush(stdout); // Ce que le shell a déjà écrit passe avant
+  if (a_des_options(e->arguments)){
+    pid = lancer_commande(e->arguments, NULL, -1);
+    *status = (pid == -1) ? 127 : attendre_commande(pid);
+    return;
+  }
+  sortie_fichier = fstat(STDOUT_FILENO, &so) == 0 && S_ISREG(so.st_mode);
+  *status = 0;
+  for (; *f != NULL; f++){
+    if (strcmp(*f, "-") == 0)
+      fd = STDIN_FILENO;
+    else if ((fd = open(*f, O_RDONLY | O_CLOEXEC)) == -1){
+      fprintf(stderr, "cat : %s : %s.\n", *f, strerror(errno));
+      *status = 1;
+      continue;
+    }
+    if (sortie_fichier && fstat(fd, &se) == 0 && se.st_dev == so.st_dev && se.st_ino == so.st_ino){
+      fprintf(stderr, "cat : %s : le fichier d'entrée est le fichier de sortie.\n", *f);
+      *status = 1;
+    }
+    else if (copier_descripteur(fd, STDOUT_FILENO) == -1){
+      fprintf(stderr, "cat : %s : %s.\n", *f, strerror(errno));
+      *status = 2;
+    }
+    if (fd != STDIN_FILENO)
+      close(fd);
+    if (*status == 2)
+      return; // Sortie fermée ou pleine : inutile de continuer
+  }
+}
+
+// copy : copie d'un fichier (dans un répertoire, sous le même nom), par le
+// noyau ; la copie garde les droits de l'original
+
+static void
+interne_copy (Expression * e, int * status) {
+  char * source, * destination, * chemin = NULL;
+  struct stat st, sd;
+  int entree, sortie;
+
+  if (e->arguments[1] == NULL || e->arguments[2] == NULL || e->arguments[3] != NULL){
+    fprintf(stderr, "Erreur : copy prend une source et une destination (copy <source> <destination>).\n");
+    *status = 1;
+    return;
+  }
+  source = e->arguments[1];
+  destination = e->arguments[2];
+
+  if ((entree = open(source, O_RDONLY | O_CLOEXEC)) == -1 || fstat(entree, &st) == -1){
+    fprintf(stderr, "copy : %s : %s.\n", source, strerror(errno));
+    if (entree != -1)
+      close(entree);
+    *status = 2;
+    return;
+  }
+
+  if (stat(destination, &sd) == 0 && S_ISDIR(sd.st_mode)){
+    char * nom = strdup(source);
+    size_t n = strlen(destination) + strlen(source) + 2;
+    if ((chemin = malloc(n)) != NULL){
+      snprintf(chemin, n, "%s/%s", destination, basename(nom));
+      destination = chemin;
+    }
+    free(nom);
+  }
+
+  // La destination n'est vidée qu'une fois sûr que ce n'est pas la source
+  // (copy f f, copy f . dans son répertoire, lien physique vers f)
+  if ((sortie = open(destination, O_WRONLY | O_CREAT | O_CLOEXEC, st.st_mode & 07777)) == -1
+      || fstat(sortie, &sd) == -1){
+    fprintf(stderr, "copy : %s : %s.\n", destination, strerror(errno));
+    *status = 3;
+  }
+  else if (sd.st_dev == st.st_dev && sd.st_ino == st.st_ino){
+    fprintf(stderr, "copy : %s et %s sont le même fichier.\n", source, destination);
+    *status = 3;
+  }
+  else if (ftruncate(sortie, 0) == -1){
+    fprintf(stderr, "copy : %s : %s.\n", destination, strerror(errno));
+    *status = 3;
+  }
+  else {
+    *status = 0;
+    if (copier_descripteur(entree, sortie) == -1){
+      fprintf(stderr, "copy : %s : %s.\n", destination, strerror(errno));
+      *status = 4;
+    }
+  }
+  if (sortie != -1)
+    close(sortie);
+  close(entree);
+  free(chemin);
+}
+
+// export : sans argument, liste les variables exportées ; sinon exporte
+// chaque NOM donné (NOM=valeur l'affecte en même temps)
+
+static void
+interne_export (Expression * e, int * status) {
+  char ** a = e->arguments + 1;
+
+  *status = 0;
+  if (*a == NULL){
+    afficher_variables(stdout, true);
+    return;
+  }
+  for (; *a != NULL; a++){
+    if (est_affectation(*a))
+      affecter_mot(*a, true);
+    else if (nom_valide(*a, strlen(*a)))
+      exporter_variable(*a);
+    else {
+      fprintf(stderr, "export : %s : nom de variable invalide.\n", *a);
+      *status = 1;
+    }
+  }
+}
+
+// unset : retire les variables données
+
+static void
+interne_unset (Expression * e, int * status) {
+  *status = 0;
+  for (char ** a = e->arguments + 1; *a != NULL; a++){
+    if (nom_valide(*a, strlen(*a)))
+      supprimer_variable(*a);
+    else {
+      fprintf(stderr, "unset : %s : nom de variable invalide.\n", *a);
+      *status = 1;
+    }
+  }
+}
+
+// parallel [-j N] [-k] [commande [arguments]] [::: mots] : commande pour
+// chaque mot (chaque ligne de l'entrée standard sans :::), {} désignant le
+// mot ; sans commande, chaque mot est une ligne de commande. Au plus N
+// tâches à la fois (une par processeur en ligne) ; -k garde l'ordre des
+// entrées pour les sorties (voir Parallele.c). Le statut est le nombre de
+// tâches en échec, 255 pour une erreur d'utilisation.
+
+static void
+interne_parallel (Expression * e, int * status) {
+  char ** a = e->arguments + 1, ** commande, ** mots = NULL;
+  long max = sysconf(_SC_NPROCESSORS_ONLN);
+  bool ordre = false;
+  char * fin;
+
+  for (; *a != NULL && (*a)[0] == '-' && (*a)[1] != '\0'; a++){
+    if (strcmp(*a, "-k") == 0)
+      ordre = true;
+    else if (strncmp(*a, "-j", 2) == 0){
+      char * n = (*a)[2] != '\0' ? *a + 2 : *++a;
+      if (n == NULL || (max = strtol(n, &fin, 10)) < 1 || *fin != '\0'){
+	fprintf(stderr, "Erreur : -j attend un nombre de tâches positif (parallel -j N).\n");
+	*status = 255;
+	return;
+      }
+    }
+    else {
+      fprintf(stderr, "Erreur : parallel [-j N] [-k] [commande [arguments]] [::: mots]\n");
+      *status = 255;
+      return;
+    }
+  }
+
+  commande = (*a != NULL && strcmp(*a, ":::") != 0) ? a : NULL;
+  for (; *a != NULL; a++)
+    if (strcmp(*a, ":::") == 0){
+      *a = NULL; // Fin de la commande
+      mots = a + 1;
+      break;
+    }
+  if (max < 1)
+    max = 1;
+  *status = executer_parallele(commande, mots, max, ordre);
+  if (mots != NULL)
+    mots[-1] = ":::";
+}
+
+// stats [-p | -r] : statistiques de la session (voir Statistiques.c) ; -p les
+// écrit au format texte de Prometheus, -r les remet à zéro.
+
+static void
+interne_stats (Expression * e, int * status) {
+  char * option = e->arguments[1];
+
+  *status = 0;
+  if (option == NULL)
+    afficher_statistiques(stdout, false);
+  else if (strcmp(option, "-p") == 0 && e->arguments[2] == NULL)
+    afficher_statistiques(stdout, true);
+  else if (strcmp(option, "-r") == 0 && e->arguments[2] == NULL)
+    vider_statistiques();
+  else {
+    fprintf(stderr, "Erreur : stats [-p | -r].\n");
+    *status = 1;
+  }
+}
+
+// NOM=valeur ... : affectation de variables du shell. Une commande qui
+// suivrait les affectations n'est pas gérée. Comme en POSIX, le statut est
+// celui du dernier $(...) développé (x=$(false) échoue), 0 sans substitution.
+
+static void
+interne_affectation (Expression * e, int * status) {
+  char ** a;
+
+  for (a = e->arguments; *a != NULL; a++)
+    if (!est_affectation(*a)){
+      fprintf(stderr, "Erreur : %s : une affectation ne peut pas précéder une commande.\n", *a);
+      *status = 1;
+      return;
+    }
+  for (a = e->arguments; *a != NULL; a++)
+    affecter_mot(*a, false);
+  *status = (statut_substitution == -1) ? 0 : statut_substitution;
+  statut_substitution = -1;
+}
+
 ////////////////////////////////////
-// INT CHECK_INTERNE(EXPRESSION*) //
-///////////////////////////////////////////////////////////////////////////////
-// Vérifie si une commande est interne (compare la commande de e à la liste) //
-///////////////////////////////////////////////////////////////////////////////
+// INT CHECK_INTERNE(CONST CHAR*) //
+//////////////////////////////////////////////////////////////////////
+// Vérifie si une commande est interne (compare son nom à la liste) //
+//////////////////////////////////////////////////////////////////////
 
 static int
-check_interne(Expression * e){
+check_interne(const char * nom){
   int ind = 0;
   while (commandes_internes[ind]){
-    if (strcmp(e->arguments[0], commandes_internes[ind]) == 0)
+    if (strcmp(nom, commandes_internes[ind]) == 0)
       return ind;
     ind++;
   }
   return -1;
 }
 
+//////////////////////////////
+// BOOL EST_INTERNE(CHAR**) //
+////////////////////////////////////////////////////////////////////////
+// Vrai si la commande arguments est exécutée par le shell. cat n'est //
+// interne que pour des fichiers : avec une option (cat -n...), c'est //
+// le cat du système                                                  //
+////////////////////////////////////////////////////////////////////////
+
+bool
+est_interne(char ** arguments){
+  if (strcmp(arguments[0], "cat") == 0 && a_des_options(arguments))
+    return false;
+  return check_interne(arguments[0]) != -1 || est_affectation(arguments[0]);
+}
+
+///////////////////////////////////
+// BOOL EST_COPIE_LONGUE(CHAR**) //
+//////////////////////////////////////////////////////////////////////////
+// Vrai pour les commandes internes qui copient des données sans limite //
+// de durée (cat /dev/zero, un tube, le terminal ; un gros copy) : le   //
+// shell interactif ignore Ctrl-C et Ctrl-Z, elles doivent donc tourner //
+// dans un fils au premier plan (voir executer_SIMPLE)                  //
+//////////////////////////////////////////////////////////////////////////
+
+bool
+est_copie_longue(char ** arguments){
+  return strcmp(arguments[0], "cat") == 0 || strcmp(arguments[0], "copy") == 0;
+}
+
 //////////////////////////////////////////////
 // BOOL EXECUTER_INTERNE(EXPRESSION*, INT*) //
 ////////////////////////////////////////////////////////////////////////
@@ -228,7 +629,14 @@ check_interne(Expression * e){
 
 bool
 executer_interne(Expression * e, int * status){
-  int cmd = check_interne(e);
+  int cmd = check_interne(e->arguments[0]);
+
+  if (cmd == -1 && est_affectation(e->arguments[0])){
+    interne_affectation(e, status);
+    compteurs[INTERNES]++;
+    return true;
+  }
+
   switch (cmd) {
 
   case 0 :
@@ -270,12 +678,57 @@ executer_interne(Expression * e, int * status){
   case 9 :
     interne_majora(e, status);
     break;
+
+  case 10 :
+    interne_hash(e, status);
+    break;
+
+  case 11 :
+    interne_jobs(e, status);
+    break;
+
+  case 12 :
+    interne_wait(e, status);
+    break;
+
+  case 13 :
+    interne_fg_bg(e, status, true);
+    break;
+
+  case 14 :
+    interne_fg_bg(e, status, false);
+    break;
+
+  case 15 :
+    interne_cat(e, status);
+    break;
+
+  case 16 :
+    interne_copy(e, status);
+    break;
+
+  case 17 :
+    interne_export(e, status);
+    break;
+
+  case 18 :
+    interne_unset(e, status);
+    break;
+
+  case 19 :
+    interne_parallel(e, status);
+    break;
+
+  case 20 :
+    interne_stats(e, status);
+    break;
     
   default : // Cas "ce n'est pas une commande interne"
     return false;
     
   }
 
+  compteurs[INTERNES]++;
   return true;
   
 }
@@ -288,66 +741,80 @@ executer_interne(Expression * e, int * status){
 
 static void
 remote_main (Expression * e, int * status){
-  fprintf(stderr,"Sorry, but this command is still in work.\nYou've met with a terrible fate, haven't you ?\n");
-
-  
-
-  /*
-  int fd[2];
+  char ** a = e->arguments;
 
-  if (pipe(fd)==-1){
-    fprintf(stderr, "Erreur d'exécution.\n");
+  if (a[1] == NULL){
+    fprintf(stderr, "Erreur : remote add <machine> | remote list | remote remove <machine> | remote <machine> <commande>\n"
+	    "        | remote all [-e | -o <répertoire>] <commande>.\n");
     *status = 1;
     return;
   }
-  
-  if (fork() == 0){
-    dup2(fd[0], 0);
-    int rc;
-    char buf[1024];
-    
-    
-    char* list[] = {"ssh", "adubroca@jaguar.emi.u-bordeaux.fr"};
-    execvp("ssh", list);
-    fprintf(stderr, "Erreur de ssh.\n");
-        
-
-    // LECTURE DE L'ENTRÉE, ET REPRODUCTION SUR LA SORTIE
-    while(rc = read (0, buf, 1024)){
-      write(1, buf, rc);
-    }
 
-    fprintf(stdout, "Fils fini.\n");
+  // remote list : sessions ouvertes
+  if (strcmp(a[1], "list") == 0 && a[2] == NULL){
+    afficher_sessions(stdout);
+    *status = 0;
+    return;
   }
-  
-  else {
-    FILE* stream = fdopen(fd[1], "w");
-    char buf[1024];
-    memset(buf, '\0', 1024);
-    setvbuf(stream, buf, _IONBF, 1024);
-
-    while(read (0, buf, 1024)){
-      fputs(buf, stream);
-      fputs(buf, stdout);
-      memset(buf, '\0', 1024);
+
+  // remote add <machine> : ouvre (ou garde) la session
+  if (strcmp(a[1], "add") == 0){
+    if (a[2] == NULL || a[3] != NULL){
+      fprintf(stderr, "Erreur : remote add prend une machine en paramètre (remote add <machine>).\n");
+      *status = 2;
+      return;
     }
+    *status = ouvrir_session(a[2]) == -1 ? 3 : 0;
+    return;
+  }
 
-    fprintf(stderr, "Après les fputs.\n");
+  // remote remove <machine> : ferme la session
+  if (strcmp(a[1], "remove") == 0){
+    if (a[2] == NULL || a[3] != NULL){
+      fprintf(stderr, "Erreur : remote remove prend une machine en paramètre (remote remove <machine>).\n");
+      *status = 4;
+      return;
+    }
+    if (fermer_session(a[2]) == -1){
+      fprintf(stderr, "remote : %s : pas de session ouverte.\n", a[2]);
+      *status = 5;
+      return;
+    }
+    *status = 0;
+    return;
+  }
 
-    // ENVOI DE LA COMMANDE-ARGUMENT DANS LE BUFFER
-    int i = 1;
-    while (e->arguments[i] != NULL){
-      fputs(*(e->arguments + (i++)), stream);
-      fputs(" ", stream);
+  // remote all [-e | -o <répertoire>] <commande> : sur toutes les sessions à la
+  // fois, les lignes de chaque machine préfixées par son nom. -e n'affiche que
+  // les machines en échec ; -o range les sorties dans <répertoire>/<machine>.out
+  // et .err. Le statut est le plus grand des statuts distants.
+  if (strcmp(a[1], "all") == 0){
+    mode_mux mode = MUX_PREFIXE;
+    const char * repertoire = NULL;
+    a += 2;
+    if (*a != NULL && strcmp(*a, "-e") == 0){
+      mode = MUX_ECHECS;
+      a++;
     }
+    else if (*a != NULL && strcmp(*a, "-o") == 0 && a[1] != NULL){
+      mode = MUX_FICHIERS;
+      repertoire = a[1];
+      a += 2;
+    }
+    if (*a == NULL){
+      fprintf(stderr, "Erreur : remote all attend une commande (remote all [-e | -o <répertoire>] <commande>).\n");
+      *status = 7;
+      return;
+    }
+    *status = executer_partout(a, mode, repertoire);
+    return;
+  }
 
-    close(0);
-    while(1){}
-    
-    
-    fprintf(stderr, "You've leaving the Remote Zone.\n");
-    
+  // remote <machine> <commande> : le statut est celui de la commande distante
+  if (a[2] == NULL){
+    fprintf(stderr, "Erreur : remote <machine> attend une commande (remote <machine> <commande>).\n");
+    *status = 6;
+    return;
   }
-  */
-  
+  *status = executer_a_distance(a[1], a + 2);
 }
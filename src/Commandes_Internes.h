@@ -4,6 +4,10 @@
 #include <stdbool.h>
 #include "Shell.h"
 
+extern const char* commandes_internes[];
+
 bool executer_interne(Expression * e, int * status);
+bool est_interne(char ** arguments);
+bool est_copie_longue(char ** arguments);
 
 #endif
@@ -0,0 +1,250 @@
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Compilation.h"
+#include "Arene.h"
+#include "Lancement.h"
+#include "Mesures.h"
+
+/*--------------------------------------------------------------------------------------.
+| Traduction de l'arbre d'une ligne en instructions, exécutées à la suite par           |
+| executer_programme() (Evaluation.c) : plus de parcours récursif de pointeurs à chaque |
+| exécution d'un corps de boucle, et des instructions de 16 octets rangées côte à côte. |
+|                                                                                       |
+| - a ; b devient le code de a suivi de celui de b ;                                    |
+| - a && b (resp. a || b) intercale un saut conditionnel vers la fin de b ;             |
+| - une redirection empile sa Redirection, exécute son fils puis la dépile : chaque     |
+|   niveau d'imbrication a sa case dans la pile, dimensionnée à la traduction. Autour   |
+|   d'une construction (if, boucle), le fichier est ouvert une seule fois par le shell  |
+|   (voir ouvrir_redirection), comme l'est toujours le texte d'un document (<<, <<<) ;  |
+| - if, while, until et for se traduisent en sauts ; chaque boucle a sa case (marque    |
+|   de l'arène, mots de for restant à affecter, statut du dernier tour) ;               |
+| - commandes simples, pipes, sous-shells et tâches de fond restent des instructions    |
+|   uniques, confiées aux mêmes fonctions qu'avant.                                     |
+|                                                                                       |
+| Les chaînes de ; && || sont penchées à gauche par l'analyseur ; elles sont parcourues |
+| par une boucle, si bien qu'un script de milliers de commandes ne fait grandir la      |
+| pile C ni à la traduction, ni à l'exécution. Il ne reste de récursion que le long des |
+| constructions imbriquées écrites dans la ligne (parenthèses, if, boucles).            |
+`--------------------------------------------------------------------------------------*/
+
+static Instruction *tampon = NULL; // Code en cours de traduction
+static int longueur = 0, capacite = 0;
+
+static Programme *programme;       // Programme en cours de traduction
+static int niveau_redirections, niveau_boucles;
+
+static int
+emettre(op_t op, Expression *e, int niveau){
+  if (longueur == capacite){
+    capacite = capacite ? 2 * capacite : 256;
+    if ((tampon = realloc(tampon, capacite * sizeof(Instruction))) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  tampon[longueur] = (Instruction){op, niveau, -1, e};
+  return longueur++;
+}
+
+// Début et fin d'un noeud, en mode analyse seulement
+
+static void
+mesurer(op_t op, Expression *e){
+  if (mesures_actives)
+    emettre(op, e, 0);
+}
+
+static int
+ouvrir_niveau(int *niveau, int *maximum){
+  if (++*niveau > *maximum)
+    *maximum = *niveau;
+  return *niveau - 1;
+}
+
+static bool
+est_sequence(expr_t type){
+  return type == SEQUENCE || type == SEQUENCE_ET || type == SEQUENCE_OU;
+}
+
+// Vrai si la redirection e englobe une construction (if, boucle)
+
+static bool
+est_construction(Expression *e){
+  while (est_redirection(e->type))
+    e = e->gauche;
+  return e->type == SI || e->type == TANT_QUE || e->type == JUSQUA || e->type == POUR;
+}
+
+static void traduire(Expression *e);
+
+/////////////////////////////////////////
+// VOID TRADUIRE_SEQUENCE(EXPRESSION*) //
+///////////////////////////////////////////////////////////////////////
+// Chaîne de ; && || : ses noeuds sont relevés le long de la branche //
+// gauche, puis traduits de la feuille la plus à gauche vers la      //
+// racine, chacun suivi de son fils droit                            //
+///////////////////////////////////////////////////////////////////////
+
+static void
+traduire_sequence(Expression *e){
+  Expression **chaine, *p;
+  int n = 0, i, saut;
+
+  for (p = e; est_sequence(p->type); p = p->gauche)
+    n++;
+  chaine = arene_allouer(&arene_ligne, n * sizeof(Expression *));
+  for (p = e, i = n; i-- > 0; p = p->gauche){
+    chaine[i] = p;
+    mesurer(OP_DEBUT_MESURE, p);
+  }
+
+  traduire(p);
+  for (i = 0; i < n; i++){
+    p = chaine[i];
+    saut = -1;
+    if (p->type == SEQUENCE_ET)
+      saut = emettre(OP_SAUT_SI_ECHEC, NULL, 0);
+    else if (p->type == SEQUENCE_OU)
+      saut = emettre(OP_SAUT_SI_SUCCES, NULL, 0);
+    traduire(p->droite);
+    if (saut != -1)
+      tampon[saut].cible = longueur;
+    mesurer(OP_FIN_MESURE, p);
+  }
+}
+
+///////////////////////////////////////
+// VOID TRADUIRE_BOUCLE(EXPRESSION*) //
+///////////////////////////////////////////////////////////
+//        ENTRER k                     POUR k            //
+// debut: <condition>          debut: SUIVANT k -> fin   //
+//        SAUT_SI_ECHEC -> fin        <corps>            //
+//        <corps>                     BOUCLER k -> debut //
+//        BOUCLER k -> debut   fin:   SORTIR k           //
+// fin:   SORTIR k                                       //
+///////////////////////////////////////////////////////////
+
+static void
+traduire_boucle(Expression *e){
+  int k = ouvrir_niveau(&niveau_boucles, &programme->nb_boucles);
+  int debut, sortie;
+
+  if (e->type == POUR){
+    emettre(OP_POUR, e, k);
+    debut = sortie = emettre(OP_SUIVANT, e, k);
+    traduire(e->gauche);
+  }
+  else {
+    emettre(OP_ENTRER, e, k);
+    debut = longueur;
+    traduire(e->gauche);
+    sortie = emettre(e->type == TANT_QUE ? OP_SAUT_SI_ECHEC : OP_SAUT_SI_SUCCES, NULL, 0);
+    traduire(e->droite);
+  }
+  tampon[emettre(OP_BOUCLER, e, k)].cible = debut;
+  tampon[sortie].cible = longueur;
+  emettre(OP_SORTIR, e, k);
+  niveau_boucles--;
+}
+
+static void
+traduire(Expression *e){
+  int saut, fin, k;
+
+  if (est_sequence(e->type)){
+    traduire_sequence(e);
+    return;
+  }
+
+  mesurer(OP_DEBUT_MESURE, e);
+  switch (e->type){
+
+  case SIMPLE :
+    emettre(OP_SIMPLE, e, 0);
+    break;
+
+  case BG :
+    emettre(OP_BG, e, 0);
+    break;
+
+  case PIPE :
+    emettre(OP_PIPE, e, 0);
+    break;
+
+  case SOUS_SHELL :
+    emettre(OP_SOUS_SHELL, e, 0);
+    break;
+
+  case REDIRECTION_I :
+  case REDIRECTION_O :
+  case REDIRECTION_A :
+  case REDIRECTION_E :
+  case REDIRECTION_EO :
+  case REDIRECTION_DOC :
+  case REDIRECTION_CHAINE :
+    if (est_construction(e) || est_document(e->type)){
+      k = ouvrir_niveau(&niveau_redirections, &programme->nb_redirections);
+      ouvrir_niveau(&niveau_redirections, &programme->nb_redirections); // &> : 2 cases
+      saut = emettre(OP_OUVRIR, e, k);
+      traduire(e->gauche);
+      emettre(OP_FERMER, e, k);
+      tampon[saut].cible = longueur;
+      niveau_redirections -= 2;
+      break;
+    }
+    k = ouvrir_niveau(&niveau_redirections, &programme->nb_redirections);
+    emettre(OP_REDIRIGER, e, k);
+    traduire(e->gauche);
+    emettre(OP_RESTAURER, e, k);
+    niveau_redirections--;
+    break;
+
+  case SI : // Sans else, le statut est 0 quand la condition échoue
+    traduire(e->gauche);
+    saut = emettre(OP_SAUT_SI_ECHEC, NULL, 0);
+    traduire(e->droite->gauche);
+    fin = emettre(OP_SAUT, NULL, 0);
+    tampon[saut].cible = longueur;
+    if (e->droite->droite != NULL)
+      traduire(e->droite->droite);
+    else
+      emettre(OP_VIDE, NULL, 0);
+    tampon[fin].cible = longueur;
+    break;
+
+  case TANT_QUE :
+  case JUSQUA :
+  case POUR :
+    traduire_boucle(e);
+    break;
+
+  default :
+    emettre(OP_VIDE, e, 0);
+  }
+  mesurer(OP_FIN_MESURE, e);
+}
+
+//////////////////////////////////////
+// PROGRAMME* COMPILER(EXPRESSION*) //
+////////////////////////////////////////////////////////////////////////
+// Traduit l'arbre e ; le programme est pris dans l'arène de la ligne //
+////////////////////////////////////////////////////////////////////////
+
+Programme *
+compiler(Expression *e){
+  programme = arene_allouer(&arene_ligne, sizeof(Programme));
+  programme->nb_redirections = programme->nb_boucles = 0;
+  niveau_redirections = niveau_boucles = 0;
+  longueur = 0;
+
+  traduire(e);
+  emettre(OP_FIN, NULL, 0);
+
+  programme->code = arene_allouer(&arene_ligne, longueur * sizeof(Instruction));
+  memcpy(programme->code, tampon, longueur * sizeof(Instruction));
+  programme->longueur = longueur;
+  return programme;
+}
@@ -0,0 +1,53 @@
+#ifndef _COMPILATION_H
+#define _COMPILATION_H
+
+#include <stdint.h>
+
+#include "Shell.h"
+
+/*
+ * L'arbre d'une ligne est traduit, avant son exécution, en une suite
+ * d'instructions à plat (voir Compilation.c), exécutée par une simple boucle
+ * dans Evaluation.c.
+ */
+
+typedef enum op_t {
+  OP_VIDE,              // status = 0
+  OP_SIMPLE,            // Commande simple e
+  OP_BG,                // e->gauche en arrière-plan
+  OP_PIPE,              // Chaîne de pipes e
+  OP_SOUS_SHELL,        // ( e->gauche )
+  OP_REDIRIGER,         // Empile la redirection e (case niveau de la pile)
+  OP_RESTAURER,         // Rend la pile des redirections d'avant la case niveau
+  OP_OUVRIR,            // Ouvre le fichier de la redirection e (case niveau), ou saute à cible
+  OP_FERMER,            // Le referme et rend la pile d'avant la case niveau
+  OP_SAUT,              // Saut à cible
+  OP_SAUT_SI_ECHEC,     // Saut à cible si status != 0
+  OP_SAUT_SI_SUCCES,    // Saut à cible si status == 0
+  OP_ENTRER,            // Début d'une boucle while/until (case niveau)
+  OP_POUR,              // Début de la boucle for e : développe ses mots
+  OP_SUIVANT,           // Affecte le mot suivant, ou saute à cible s'il n'y en a plus
+  OP_BOUCLER,           // Fin d'un tour : l'arène revient à la marque, saut à cible
+  OP_SORTIR,            // Sortie de boucle : statut du dernier tour
+  OP_DEBUT_MESURE,      // Mode analyse, autour de chaque noeud e
+  OP_FIN_MESURE,
+  OP_FIN
+} op_t;
+
+typedef struct Instruction {
+  uint16_t op;
+  uint16_t niveau;      // Case de la pile des redirections ou des boucles
+  int32_t cible;        // Indice de l'instruction visée par un saut
+  Expression *e;
+} Instruction;
+
+typedef struct Programme {
+  Instruction *code;
+  int longueur;
+  int nb_redirections;  // Redirections imbriquées au plus
+  int nb_boucles;       // Boucles imbriquées au plus
+} Programme;
+
+Programme *compiler(Expression *e);
+
+#endif
@@ -0,0 +1,409 @@
+#define _GNU_SOURCE // faccessat(), fstatat(), CLOCK_MONOTONIC_COARSE
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Completion.h"
+#include "Commandes_Internes.h"
+#include "Saisie.h"
+#include "Variables.h"
+
+/*--------------------------------------------------------------------------------------.
+| Complétion des noms de commandes. Les noms possibles (commandes internes, exécutables |
+| des répertoires de $PATH) sont rangés dans un arbre de préfixes : une pression sur    |
+| Tab ne fait que descendre le préfixe tapé puis parcourir le sous-arbre, sans aucun    |
+| appel système.                                                                        |
+|                                                                                       |
+| L'arbre est construit et tenu à jour par un fil d'exécution de maintenance. Le fil    |
+| principal lui demande une actualisation au démarrage, puis à chaque Tab quand $PATH   |
+| a changé ou que la dernière demande date d'au moins une seconde. Le fil ne relit que  |
+| les répertoires dont la date de modification a changé, puis retire de l'arbre leurs   |
+| anciens noms et y ajoute les nouveaux. Chaque nom compte ses sources (répertoires,    |
+| liste des commandes internes) : un exécutable présent dans deux répertoires de $PATH  |
+| reste proposé si l'un d'eux le perd.                                                  |
+|                                                                                       |
+| L'arbre n'est verrouillé que le temps de ces mises à jour, jamais pendant la lecture  |
+| d'un répertoire : Tab n'attend pas le parcours de $PATH. Tant que la première         |
+| construction n'est pas finie, seules les commandes internes sont proposées.           |
+`--------------------------------------------------------------------------------------*/
+
+#define PATH_DEFAUT "/bin:/usr/bin"
+#define RACINE 0                // Noeud 0 : la racine, fils ni frère d'aucun noeud
+#define AUCUN 0                 // Pas de fils, pas de frère
+#define LONGUEUR_MAX 4096       // Longueur maximale d'un nom proposé
+
+typedef struct Noeud {
+  uint32_t fils;                // Premier fils
+  uint32_t frere;               // Frère suivant, par caractère croissant
+  uint32_t sources;             // Sources du nom qui se termine ici (0 : pas un nom)
+  unsigned char c;
+} Noeud;
+
+typedef struct Dossier {        // Répertoire de $PATH, connu du fil de maintenance
+  char *nom;
+  struct timespec modification;
+  char *noms;                   // Ses exécutables à la suite, terminés par '\0'
+  size_t taille;
+  bool present;                 // Encore dans $PATH
+} Dossier;
+
+static pthread_mutex_t verrou = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t reveil = PTHREAD_COND_INITIALIZER;
+
+// Protégés par verrou
+static Noeud *noeuds = NULL;
+static size_t nb_noeuds = 0, capacite_noeuds = 0;
+static char *path_demande = NULL; // $PATH à parcourir, NULL sans demande en attente
+
+// Propres au fil principal
+static char *path_connu = NULL;
+static time_t derniere_demande = 0;
+static char **trouves = NULL;     // Noms proposés pour la dernière complétion
+static size_t nb_trouves = 0, capacite_trouves = 0, suivant = 0;
+
+// Propres au fil de maintenance
+static Dossier *dossiers = NULL;
+static int nb_dossiers = 0;
+
+/////////////////////////////////////////////////////
+// UINT32_T NOUVEAU_NOEUD(UNSIGNED CHAR, UINT32_T) //
+/////////////////////////////////////////////////////////////////////
+// Les noeuds sont désignés par leur indice : le tableau peut être //
+// agrandi sans invalider les liens. Verrou tenu.                  //
+/////////////////////////////////////////////////////////////////////
+
+static uint32_t
+nouveau_noeud(unsigned char c, uint32_t frere){
+  if (nb_noeuds == capacite_noeuds){
+    capacite_noeuds = capacite_noeuds ? 2 * capacite_noeuds : 4096;
+    if ((noeuds = realloc(noeuds, capacite_noeuds * sizeof(Noeud))) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  noeuds[nb_noeuds] = (Noeud){AUCUN, frere, 0, c};
+  return nb_noeuds++;
+}
+
+////////////////////////////////////
+// VOID COMPTER(CONST CHAR*, INT) //
+////////////////////////////////////////////////////////////////////////
+// Ajoute delta (+1 ou -1) aux sources du nom, en créant son chemin   //
+// dans l'arbre au besoin. Les noeuds ne sont jamais libérés : un nom //
+// retiré garde les siens, prêts s'il revient. Verrou tenu.           //
+////////////////////////////////////////////////////////////////////////
+
+static void
+compter(const char *nom, int delta){
+  uint32_t n = RACINE, k, precedent, nouveau;
+  unsigned char c;
+
+  if (nb_noeuds == 0)
+    nouveau_noeud('\0', AUCUN);
+
+  for (; *nom != '\0'; nom++, n = k){
+    c = *nom;
+    precedent = AUCUN;
+    for (k = noeuds[n].fils; k != AUCUN && noeuds[k].c < c; k = noeuds[k].frere)
+      precedent = k;
+    if (k == AUCUN || noeuds[k].c != c){
+      if (delta < 0)
+	return;
+      nouveau = nouveau_noeud(c, k);
+      if (precedent == AUCUN)
+	noeuds[n].fils = nouveau;
+      else
+	noeuds[precedent].frere = nouveau;
+      k = nouveau;
+    }
+  }
+  noeuds[n].sources += delta;
+}
+
+static void
+compter_tous(const char *noms, size_t taille, int delta){
+  for (const char *p = noms; p < noms + taille; p += strlen(p) + 1)
+    compter(p, delta);
+}
+
+//////////////////////////////////////////////
+// CHAR* LIRE_DOSSIER(CONST CHAR*, SIZE_T*) //
+////////////////////////////////////////////////////////////////////////
+// Relit les exécutables du répertoire (fichiers ordinaires, ou liens //
+// vers des fichiers ordinaires, exécutables par l'utilisateur)       //
+////////////////////////////////////////////////////////////////////////
+
+static char *
+lire_dossier(const char *nom, size_t *taille){
+  size_t capacite = 4096, n;
+  char *noms = malloc(capacite);
+  struct dirent *d;
+  struct stat st;
+  DIR *rep;
+
+  *taille = 0;
+  if (noms == NULL || (rep = opendir(nom)) == NULL)
+    return noms;
+
+  while ((d = readdir(rep)) != NULL){
+    if (d->d_name[0] == '.' && (d->d_name[1] == '\0' || strcmp(d->d_name, "..") == 0))
+      continue;
+    if (d->d_type != DT_REG && d->d_type != DT_LNK && d->d_type != DT_UNKNOWN)
+      continue;
+    if (faccessat(dirfd(rep), d->d_name, X_OK, 0) == -1)
+      continue;
+    if (d->d_type != DT_REG
+	&& (fstatat(dirfd(rep), d->d_name, &st, 0) == -1 || !S_ISREG(st.st_mode)))
+      continue;
+
+    n = strlen(d->d_name) + 1;
+    while (*taille + n > capacite)
+      if ((noms = realloc(noms, capacite *= 2)) == NULL){
+	perror("realloc");
+	exit(EXIT_FAILURE);
+      }
+    memcpy(noms + *taille, d->d_name, n);
+    *taille += n;
+  }
+  closedir(rep);
+  return noms;
+}
+
+////////////////////////////
+// VOID ACTUALISER(CHAR*) //
+////////////////////////////////////////////////////////////////////////
+// Met l'arbre en accord avec path. Seuls les répertoires nouveaux ou //
+// modifiés sont relus ; le verrou n'est pris que pour reporter leurs //
+// changements dans l'arbre. Les répertoires relatifs sont ignorés :  //
+// leur contenu dépend du répertoire courant.                         //
+////////////////////////////////////////////////////////////////////////
+
+static void
+actualiser(char *path){
+  char *nom, *reste, *noms;
+  Dossier *d;
+  struct stat st;
+  size_t taille;
+  int i;
+
+  for (i = 0; i < nb_dossiers; i++)
+    dossiers[i].present = false;
+
+  for (nom = strtok_r(path, ":", &reste); nom != NULL; nom = strtok_r(NULL, ":", &reste)){
+    if (nom[0] != '/')
+      continue;
+    for (d = NULL, i = 0; i < nb_dossiers && d == NULL; i++)
+      if (strcmp(dossiers[i].nom, nom) == 0)
+	d = &dossiers[i];
+    if (d == NULL){
+      if ((dossiers = realloc(dossiers, (nb_dossiers + 1) * sizeof(Dossier))) == NULL){
+	perror("realloc");
+	exit(EXIT_FAILURE);
+      }
+      d = &dossiers[nb_dossiers++];
+      *d = (Dossier){strdup(nom), {-1, 0}, NULL, 0, false};
+    }
+    if (d->present) // Répertoire cité deux fois
+      continue;
+    d->present = true;
+
+    if (stat(nom, &st) == -1)
+      st.st_mtim.tv_sec = st.st_mtim.tv_nsec = 0;
+    if (st.st_mtim.tv_sec == d->modification.tv_sec
+	&& st.st_mtim.tv_nsec == d->modification.tv_nsec)
+      continue;
+
+    d->modification = st.st_mtim;
+    noms = lire_dossier(nom, &taille);
+    pthread_mutex_lock(&verrou);
+    compter_tous(d->noms, d->taille, -1);
+    compter_tous(noms, taille, +1);
+    pthread_mutex_unlock(&verrou);
+    free(d->noms);
+    d->noms = noms;
+    d->taille = taille;
+  }
+
+  // Répertoires sortis de $PATH
+  for (i = 0; i < nb_dossiers; ){
+    d = &dossiers[i];
+    if (d->present){
+      i++;
+      continue;
+    }
+    pthread_mutex_lock(&verrou);
+    compter_tous(d->noms, d->taille, -1);
+    pthread_mutex_unlock(&verrou);
+    free(d->nom);
+    free(d->noms);
+    *d = dossiers[--nb_dossiers];
+  }
+}
+
+// Fil de maintenance : traite les demandes d'actualisation une à une
+
+static void *
+maintenir(void *inutilise){
+  char *path;
+
+  for (;;){
+    pthread_mutex_lock(&verrou);
+    while (path_demande == NULL)
+      pthread_cond_wait(&reveil, &verrou);
+    path = path_demande;
+    path_demande = NULL;
+    pthread_mutex_unlock(&verrou);
+
+    actualiser(path);
+    free(path);
+  }
+  return NULL;
+}
+
+/////////////////////////
+// VOID DEMANDER(VOID) //
+//////////////////////////////////////////////////////////////////////
+// Réveille le fil de maintenance si $PATH a changé, ou au plus une //
+// fois par seconde pour qu'il vérifie les dates de ses répertoires //
+//////////////////////////////////////////////////////////////////////
+
+static void
+demander(void){
+  const char *path = valeur_variable("PATH");
+  struct timespec maintenant;
+
+  if (path == NULL)
+    path = PATH_DEFAUT;
+  clock_gettime(CLOCK_MONOTONIC_COARSE, &maintenant);
+  if (path_connu != NULL && strcmp(path, path_connu) == 0
+      && maintenant.tv_sec == derniere_demande)
+    return;
+
+  derniere_demande = maintenant.tv_sec;
+  free(path_connu);
+  path_connu = strdup(path);
+
+  pthread_mutex_lock(&verrou);
+  free(path_demande);
+  path_demande = strdup(path);
+  pthread_cond_signal(&reveil);
+  pthread_mutex_unlock(&verrou);
+}
+
+/////////////////////////////////////////////
+// VOID COLLECTER(UINT32_T, CHAR*, SIZE_T) //
+///////////////////////////////////////////////////////////////////////
+// Ajoute aux noms proposés ceux du sous-arbre de n, dont le préfixe //
+// (longueur octets) est dans mot. Verrou tenu.                      //
+///////////////////////////////////////////////////////////////////////
+
+static void
+collecter(uint32_t n, char *mot, size_t longueur){
+  if (noeuds[n].sources > 0){
+    if (nb_trouves == capacite_trouves){
+      capacite_trouves = capacite_trouves ? 2 * capacite_trouves : 256;
+      if ((trouves = realloc(trouves, capacite_trouves * sizeof(char *))) == NULL){
+	perror("realloc");
+	exit(EXIT_FAILURE);
+      }
+    }
+    trouves[nb_trouves++] = strndup(mot, longueur);
+  }
+  if (longueur + 1 >= LONGUEUR_MAX)
+    return;
+  for (uint32_t k = noeuds[n].fils; k != AUCUN; k = noeuds[k].frere){
+    mot[longueur] = noeuds[k].c;
+    collecter(k, mot, longueur + 1);
+  }
+}
+
+// Générateur pour rl_completion_matches() : les noms sont cherchés au
+// premier appel, puis rendus un à un (readline les libère)
+
+static char *
+generer(const char *texte, int etat){
+  char mot[LONGUEUR_MAX];
+  size_t longueur = strlen(texte), i;
+  uint32_t n = RACINE, k = RACINE;
+
+  if (etat == 0){
+    nb_trouves = suivant = 0;
+    if (longueur >= LONGUEUR_MAX)
+      return NULL;
+    memcpy(mot, texte, longueur);
+
+    // Descente du préfixe tapé, puis son sous-arbre
+    pthread_mutex_lock(&verrou);
+    for (i = 0; nb_noeuds > 0 && i < longueur; i++, n = k){
+      for (k = noeuds[n].fils; k != AUCUN && noeuds[k].c != (unsigned char) texte[i]; k = noeuds[k].frere)
+	;
+      if (k == AUCUN)
+	break;
+    }
+    if (nb_noeuds > 0 && i == longueur)
+      collecter(n, mot, longueur);
+    pthread_mutex_unlock(&verrou);
+  }
+
+  return (suivant < nb_trouves) ? trouves[suivant++] : NULL;
+}
+
+/////////////////////////////////////////////
+// CHAR** COMPLETER(CONST CHAR*, INT, INT) //
+///////////////////////////////////////////////////////////////////////
+// Un mot en position de commande (début de ligne, ou après |, ;, &, //
+// ( ) est complété par les noms de commandes ; un chemin, ou un     //
+// argument, par les noms de fichiers de readline                    //
+///////////////////////////////////////////////////////////////////////
+
+static char **
+completer(const char *texte, int debut, int fin){
+  const char *ligne = *saisie.rl_line_buffer;
+  int i = debut;
+
+  while (i > 0 && (ligne[i - 1] == ' ' || ligne[i - 1] == '\t'))
+    i--;
+  if ((i > 0 && strchr("|;&(", ligne[i - 1]) == NULL) || strchr(texte, '/') != NULL)
+    return NULL;
+
+  demander();
+  *saisie.rl_attempted_completion_over = 1;
+  return saisie.rl_completion_matches(texte, generer);
+}
+
+///////////////////////////////////////
+// VOID INITIALISER_COMPLETION(VOID) //
+///////////////////////////////////////////////////////////////////
+// Installe la complétion et lance le fil de maintenance, qui ne //
+// reçoit aucun signal : ils restent l'affaire du fil principal  //
+///////////////////////////////////////////////////////////////////
+
+void
+initialiser_completion(void){
+  sigset_t tous, masque;
+  pthread_t fil;
+
+  pthread_mutex_lock(&verrou);
+  for (int i = 0; commandes_internes[i] != NULL; i++)
+    compter(commandes_internes[i], +1);
+  pthread_mutex_unlock(&verrou);
+
+  *saisie.rl_attempted_completion_function = completer;
+  demander();
+
+  sigfillset(&tous);
+  pthread_sigmask(SIG_SETMASK, &tous, &masque);
+  if (pthread_create(&fil, NULL, maintenir, NULL) == 0)
+    pthread_detach(fil);
+  pthread_sigmask(SIG_SETMASK, &masque, NULL);
+}
@@ -0,0 +1,11 @@
+#ifndef _COMPLETION_H
+#define _COMPLETION_H
+
+/*
+ * Complétion des noms de commandes (touche Tab) : commandes internes et
+ * exécutables de $PATH, tenus à jour par un fil d'exécution à part.
+ */
+
+void initialiser_completion(void);
+
+#endif
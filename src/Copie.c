@@ -0,0 +1,132 @@
+#define _GNU_SOURCE // copy_file_range(), splice()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Copie.h"
+
+/*--------------------------------------------------------------------------------------.
+| Copie sans passage par l'espace utilisateur. Selon la nature des deux descripteurs,   |
+| les octets sont déplacés par le noyau :                                               |
+|                                                                                       |
+| - copy_file_range() de fichier à fichier (le système de fichiers peut même partager   |
+|   les blocs au lieu de les copier) ;                                                  |
+| - sendfile() d'un fichier vers n'importe quoi d'autre (tube, socket, terminal) ;      |
+| - splice() dès que l'un des deux est un tube.                                         |
+|                                                                                       |
+| Un procédé que le noyau refuse pour ces descripteurs (système de fichiers qui ne le   |
+| connaît pas, sortie en mode O_APPEND...) laisse la place au suivant, et en dernier    |
+| recours à une boucle read()/write() sur un grand tampon. Les positions courantes des  |
+| descripteurs sont utilisées et avancées dans tous les cas : on peut passer d'un       |
+| procédé à l'autre en cours de copie.                                                  |
+`--------------------------------------------------------------------------------------*/
+
+#define TRANCHE (1 << 30)          // Octets demandés au noyau par appel
+#define TAILLE_TAMPON (1 << 20)
+
+typedef enum {COPY_FILE_RANGE, SENDFILE, SPLICE, LECTURE_ECRITURE} procede;
+
+// Le noyau ne sait pas faire ce procédé avec ces descripteurs
+
+static int
+refuse(int err){
+  return err == EINVAL || err == ENOSYS || err == EXDEV || err == EBADF
+    || err == EOPNOTSUPP || err == ESPIPE;
+}
+
+static ssize_t
+transferer(procede p, int entree, int sortie){
+  switch (p) {
+  case COPY_FILE_RANGE :
+    return copy_file_range(entree, NULL, sortie, NULL, TRANCHE, 0);
+  case SENDFILE :
+    return sendfile(sortie, entree, NULL, TRANCHE);
+  default :
+    return splice(entree, NULL, sortie, NULL, TRANCHE, SPLICE_F_MOVE | SPLICE_F_MORE);
+  }
+}
+
+////////////////////////////
+// INT RECOPIER(INT, INT) //
+//////////////////////////////////////////////////////
+// Dernier recours : read() puis write() en boucle, //
+// sur un tampon alloué une fois pour toutes        //
+//////////////////////////////////////////////////////
+
+static int
+recopier(int entree, int sortie){
+  static char *tampon = NULL;
+  ssize_t lu, ecrit, k;
+
+  if (tampon == NULL && (tampon = malloc(TAILLE_TAMPON)) == NULL)
+    return -1;
+
+  while ((lu = read(entree, tampon, TAILLE_TAMPON)) != 0){
+    if (lu == -1){
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+    for (ecrit = 0; ecrit < lu; ecrit += k)
+      if ((k = write(sortie, tampon + ecrit, lu - ecrit)) == -1){
+	if (errno == EINTR){
+	  k = 0;
+	  continue;
+	}
+	return -1;
+      }
+  }
+  return 0;
+}
+
+//////////////////////////////////////
+// INT COPIER_DESCRIPTEUR(INT, INT) //
+///////////////////////////////////////////////////////////////////////
+// Copie tout ce qui reste à lire sur entree dans sortie. Renvoie 0, //
+// ou -1 (errno positionné) en cas d'erreur de lecture ou d'écriture //
+///////////////////////////////////////////////////////////////////////
+
+int
+copier_descripteur(int entree, int sortie){
+  struct stat se, ss;
+  procede p;
+  ssize_t n;
+
+  if (fstat(entree, &se) == -1 || fstat(sortie, &ss) == -1)
+    return -1;
+
+  if (S_ISREG(se.st_mode) && S_ISREG(ss.st_mode))
+    p = COPY_FILE_RANGE;
+  else if (S_ISREG(se.st_mode) || S_ISBLK(se.st_mode))
+    p = SENDFILE;
+  else if (S_ISFIFO(se.st_mode) || S_ISFIFO(ss.st_mode))
+    p = SPLICE;
+  else
+    p = LECTURE_ECRITURE;
+
+  while (p != LECTURE_ECRITURE){
+    if ((n = transferer(p, entree, sortie)) == 0)
+      return 0;
+    if (n > 0)
+      continue;
+    if (errno == EINTR)
+      continue;
+    if (!refuse(errno))
+      return -1;
+    // Procédé suivant : sendfile après copy_file_range, splice si un tube
+    // est en jeu, puis la copie ordinaire
+    if (p == COPY_FILE_RANGE)
+      p = SENDFILE;
+    else if (p == SENDFILE && (S_ISFIFO(se.st_mode) || S_ISFIFO(ss.st_mode)))
+      p = SPLICE;
+    else
+      p = LECTURE_ECRITURE;
+  }
+
+  return recopier(entree, sortie);
+}
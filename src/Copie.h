@@ -0,0 +1,11 @@
+#ifndef _COPIE_H
+#define _COPIE_H
+
+/*
+ * Copie d'un descripteur dans un autre par le noyau quand c'est possible
+ * (commandes internes cat et copy).
+ */
+
+int copier_descripteur(int entree, int sortie);
+
+#endif
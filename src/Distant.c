@@ -0,0 +1,532 @@
+#define _GNU_SOURCE // pipe2()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Distant.h"
+#include "Arene.h"
+#include "Evaluation.h"
+#include "Lancement.h"
+#include "Taches.h"
+#include "Variables.h"
+
+/*--------------------------------------------------------------------------------------.
+| Sessions distantes. Plutôt que de lancer un ssh (connexion, échange de clés,          |
+| authentification) à chaque "remote", chaque machine a son processus de transport,     |
+| lancé une fois puis gardé : il exécute "Termina --serveur" de l'autre côté, et les    |
+| deux shells s'échangent des trames sur son entrée et sa sortie standard. Une commande |
+| ne coûte plus qu'un aller-retour. Les réponses sont reçues par le multiplexeur (voir  |
+| Multiplexeur.c), qui peut en attendre de toutes les sessions à la fois.               |
+|                                                                                       |
+| Une trame est un en-tête "<type> <nombre>\n" suivi, sauf pour S, de <nombre> octets : |
+|   C    : commande à exécuter (client -> serveur) ;                                    |
+|   O, E : morceau de sa sortie standard, de sa sortie d'erreur (serveur -> client) ;   |
+|   S    : fin de la commande, <nombre> est son statut (serveur -> client).             |
+|                                                                                       |
+| Le transport est donné par $TERMINA_TRANSPORT, "%h" y étant remplacé par la machine : |
+| "ssh -T %h Termina --serveur" par défaut, "./Termina --serveur" pour tester en local. |
+`--------------------------------------------------------------------------------------*/
+
+#define TRANSPORT_DEFAUT "ssh -T %h Termina --serveur"
+#define TAILLE_MORCEAU 65536
+
+typedef struct Session {
+  char *hote;
+  pid_t pid;                // Processus de transport
+  int requetes;             // Tube vers son entrée standard
+  int reponses;             // Tube depuis sa sortie standard
+  int commandes;            // Commandes exécutées dans la session
+  struct Session *suivante;
+} Session;
+
+static Session *sessions = NULL;
+
+static char morceau[TAILLE_MORCEAU]; // Sorties relayées par le serveur
+
+///////////////////////////////////////////////
+// INT ECRIRE_TOUT(INT, CONST CHAR*, SIZE_T) //
+///////////////////////////////////////////////
+
+int
+ecrire_tout(int fd, const char *p, size_t n){
+  ssize_t k;
+
+  while (n > 0){
+    if ((k = write(fd, p, n)) == -1){
+      if (errno == EINTR)
+	continue;
+      return -1;
+    }
+    p += k;
+    n -= k;
+  }
+  return 0;
+}
+
+///////////////////////////////////////////////////////
+// INT ENVOYER_TRAME(INT, CHAR, CONST CHAR*, SIZE_T) //
+/////////////////////////////////////////////////////////////////
+// Ecrit l'en-tête et les données d'une trame en un seul appel //
+// (deux quand le tube est plein). Pour S, n est le statut.    //
+/////////////////////////////////////////////////////////////////
+
+static int
+envoyer_trame(int fd, char type, const char *donnees, size_t n){
+  char entete[32];
+  struct iovec iov[2];
+  size_t l = snprintf(entete, sizeof(entete), "%c %zu\n", type, n);
+  ssize_t k;
+
+  iov[0].iov_base = entete;
+  iov[0].iov_len = l;
+  iov[1].iov_base = (char *) donnees;
+  iov[1].iov_len = type == 'S' ? 0 : n;
+
+  while ((k = writev(fd, iov, 2)) == -1)
+    if (errno != EINTR)
+      return -1;
+
+  if ((size_t) k < l){
+    if (ecrire_tout(fd, entete + k, l - k) == -1)
+      return -1;
+    k = 0;
+  }
+  else
+    k -= l;
+  return ecrire_tout(fd, donnees + k, iov[1].iov_len - k);
+}
+
+////////////////////////////////////////////
+// INT LIRE_ENTETE(FILE*, CHAR*, SIZE_T*) //
+/////////////////////////////////////////////////////////////
+// Lit l'en-tête de la trame suivante. Renvoie -1 à la fin //
+// du flux ou sur un en-tête mal formé.                    //
+/////////////////////////////////////////////////////////////
+
+static int
+lire_entete(FILE *f, char *type, size_t *n){
+  int c;
+
+  if ((c = getc(f)) == EOF)
+    return -1;
+  *type = c;
+  if (getc(f) != ' ')
+    return -1;
+  *n = 0;
+  while ((c = getc(f)) >= '0' && c <= '9')
+    *n = *n * 10 + (c - '0');
+  return c == '\n' ? 0 : -1;
+}
+
+////////////////////////////////////////////
+// SESSION** TROUVER_SESSION(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////////
+// Renvoie le lien qui pointe sur la session de hote (ou le lien final //
+// de la liste, pointant sur NULL, si elle n'existe pas)               //
+/////////////////////////////////////////////////////////////////////////
+
+static Session **
+trouver_session(const char *hote){
+  Session **p;
+
+  for (p = &sessions; *p != NULL; p = &(*p)->suivante)
+    if (strcmp((*p)->hote, hote) == 0)
+      break;
+  return p;
+}
+
+////////////////////////////////////////////
+// CHAR** COMMANDE_TRANSPORT(CONST CHAR*) //
+///////////////////////////////////////////////////////////////////
+// Découpe $TERMINA_TRANSPORT en mots (dans l'arène de la ligne) //
+///////////////////////////////////////////////////////////////////
+
+static char **
+commande_transport(const char *hote){
+  const char *modele = valeur_variable("TERMINA_TRANSPORT");
+  ListeArgs *l = InitialiserListeArguments();
+  char *mots, *mot;
+
+  if (modele == NULL || *modele == '\0')
+    modele = TRANSPORT_DEFAUT;
+  mots = arene_copier(&arene_ligne, modele, strlen(modele));
+
+  for (mot = strtok(mots, " \t"); mot != NULL; mot = strtok(NULL, " \t"))
+    l = AjouterArg(l, strcmp(mot, "%h") == 0 ? (char *) hote : mot);
+  return l->arguments;
+}
+
+/////////////////////////////////////
+// INT OUVRIR_SESSION(CONST CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Lance le transport vers hote, s'il n'y a pas déjà une session. Il //
+// a son propre groupe de processus : un Ctrl-C destiné à une        //
+// commande au premier plan ne coupe pas les sessions.               //
+///////////////////////////////////////////////////////////////////////
+
+int
+ouvrir_session(const char *hote){
+  int vers[2], depuis[2];
+  Redirection entree, sortie;
+  char **argv;
+  Session *s;
+  pid_t pid;
+
+  if (*trouver_session(hote) != NULL)
+    return 0;
+
+  argv = commande_transport(hote);
+  if (argv[0] == NULL){
+    fprintf(stderr, "remote : TERMINA_TRANSPORT est vide.\n");
+    return -1;
+  }
+
+  if (pipe2(vers, O_CLOEXEC) == -1){
+    perror("pipe");
+    return -1;
+  }
+  if (pipe2(depuis, O_CLOEXEC) == -1){
+    perror("pipe");
+    close(vers[0]);
+    close(vers[1]);
+    return -1;
+  }
+
+  entree = (Redirection){.type = PIPE, .fd = vers[0], .cible = STDIN_FILENO};
+  sortie = (Redirection){.type = PIPE, .fd = depuis[1], .cible = STDOUT_FILENO, .englobante = &entree};
+
+  pid = lancer_commande(argv, &sortie, 0);
+  close(vers[0]);
+  close(depuis[1]);
+  if (pid == -1){
+    close(vers[1]);
+    close(depuis[0]);
+    return -1;
+  }
+
+  s = malloc(sizeof(Session));
+  s->hote = strdup(hote);
+  s->pid = pid;
+  s->requetes = vers[1];
+  s->reponses = depuis[0];
+  s->commandes = 0;
+  s->suivante = sessions;
+  sessions = s;
+  return 0;
+}
+
+/////////////////////////////////////
+// INT FERMER_SESSION(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Ferme les tubes de la session : le serveur lit la fin de son    //
+// entrée et se termine, le transport avec lui (il est récolté par //
+// le gestionnaire de SIGCHLD). Renvoie -1 si la session n'existe  //
+// pas.                                                            //
+/////////////////////////////////////////////////////////////////////
+
+int
+fermer_session(const char *hote){
+  Session **p = trouver_session(hote), *s = *p;
+
+  if (s == NULL)
+    return -1;
+  *p = s->suivante;
+  close(s->requetes);
+  close(s->reponses);
+  free(s->hote);
+  free(s);
+  return 0;
+}
+
+void
+afficher_sessions(FILE *f){
+  Session *s;
+
+  for (s = sessions; s != NULL; s = s->suivante)
+    fprintf(f, "%-24s pid %-8d %d commande(s)\n", s->hote, (int) s->pid, s->commandes);
+}
+
+/////////////////////////////////////////////////
+// INT ENVOYER_COMMANDE(SESSION*, CONST CHAR*) //
+////////////////////////////////////////////////////////////////
+// SIGPIPE est ignoré le temps de l'envoi : un transport mort //
+// donne une erreur EPIPE au lieu de tuer le shell            //
+////////////////////////////////////////////////////////////////
+
+static int
+envoyer_commande(Session *s, const char *commande){
+  struct sigaction ignorer, ancienne;
+  int ret;
+
+  memset(&ignorer, 0, sizeof(ignorer));
+  ignorer.sa_handler = SIG_IGN;
+  sigemptyset(&ignorer.sa_mask);
+  sigaction(SIGPIPE, &ignorer, &ancienne);
+  ret = envoyer_trame(s->requetes, 'C', commande, strlen(commande));
+  sigaction(SIGPIPE, &ancienne, NULL);
+  return ret;
+}
+
+///////////////////////////
+// CHAR* JOINDRE(CHAR**) //
+////////////////////////////////////////////////////////////
+// Recolle les mots de la commande en une ligne à envoyer //
+////////////////////////////////////////////////////////////
+
+static char *
+joindre(char **argv){
+  char *commande, *p;
+  size_t longueur = 0;
+  int i;
+
+  for (i = 0; argv[i] != NULL; i++)
+    longueur += strlen(argv[i]) + 1;
+  p = commande = arene_allouer(&arene_ligne, longueur + 1);
+  *p = '\0';
+  for (i = 0; argv[i] != NULL; i++){
+    if (i > 0)
+      *p++ = ' ';
+    p = stpcpy(p, argv[i]);
+  }
+  return commande;
+}
+
+//////////////////////////////////////////////////////////////////
+// INT ATTENDRE_REPONSES(SESSION**, INT, MODE_MUX, CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////////
+// Reçoit les réponses des n sessions auxquelles la commande vient     //
+// d'être envoyée (voir Multiplexeur.c), puis ferme celles qui ont été //
+// perdues. Renvoie le plus grand des statuts.                         //
+/////////////////////////////////////////////////////////////////////////
+
+static int
+attendre_reponses(Session **liste, int n, mode_mux mode, const char *repertoire){
+  Voie *voies = arene_allouer(&arene_ligne, n * sizeof(Voie));
+  int i, pire;
+
+  for (i = 0; i < n; i++){
+    voies[i].hote = liste[i]->hote;
+    voies[i].fd = liste[i]->reponses;
+  }
+
+  fflush(stdout); // Ce que le shell a déjà écrit passe avant les réponses
+  pire = multiplexer(voies, n, mode, repertoire);
+
+  for (i = 0; i < n; i++){
+    if (voies[i].perdue){
+      fprintf(stderr, "remote : %s : session perdue.\n", voies[i].hote);
+      fermer_session(voies[i].hote);
+    }
+    else
+      liste[i]->commandes++;
+  }
+  return pire;
+}
+
+//////////////////////////////////////////////////
+// INT EXECUTER_A_DISTANCE(CONST CHAR*, CHAR**) //
+/////////////////////////////////////////////////////////////////////
+// Exécute la commande argv sur hote (en ouvrant la session au     //
+// besoin) et recopie ses sorties. Une session gardée qui s'avère  //
+// morte à l'envoi est rouverte une fois : la commande n'est pas   //
+// partie. Renvoie le statut de la commande, ou 255 (comme ssh) si //
+// la session est perdue.                                          //
+/////////////////////////////////////////////////////////////////////
+
+int
+executer_a_distance(const char *hote, char **argv){
+  char *commande = joindre(argv);
+  Session *s;
+  bool envoyee;
+
+  if (ouvrir_session(hote) == -1)
+    return 255;
+  s = *trouver_session(hote);
+
+  envoyee = envoyer_commande(s, commande) == 0;
+  if (!envoyee && s->commandes > 0){
+    fermer_session(hote);
+    if (ouvrir_session(hote) == 0){
+      s = *trouver_session(hote);
+      envoyee = envoyer_commande(s, commande) == 0;
+    }
+  }
+  if (!envoyee){
+    fprintf(stderr, "remote : %s : session perdue.\n", hote);
+    fermer_session(hote);
+    return 255;
+  }
+
+  return attendre_reponses(&s, 1, MUX_DIRECT, NULL);
+}
+
+/////////////////////////////////////////////////////////
+// INT EXECUTER_PARTOUT(CHAR**, MODE_MUX, CONST CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Envoie la commande argv à toutes les sessions ouvertes d'un coup, //
+// puis reçoit les réponses en parallèle. Une machine injoignable    //
+// compte comme un échec de statut 255.                              //
+///////////////////////////////////////////////////////////////////////
+
+int
+executer_partout(char **argv, mode_mux mode, const char *repertoire){
+  char *commande = joindre(argv);
+  Session *s, *suivante, **liste;
+  int n = 0, pire = 0;
+
+  for (s = sessions; s != NULL; s = s->suivante)
+    n++;
+  if (n == 0){
+    fprintf(stderr, "remote : aucune session ouverte (remote add <machine>).\n");
+    return 1;
+  }
+  liste = arene_allouer(&arene_ligne, n * sizeof(Session *));
+
+  n = 0;
+  for (s = sessions; s != NULL; s = suivante){
+    suivante = s->suivante;
+    if (envoyer_commande(s, commande) == 0)
+      liste[n++] = s;
+    else {
+      fprintf(stderr, "remote : %s : session perdue.\n", s->hote);
+      fermer_session(s->hote);
+      pire = 255;
+    }
+  }
+
+  if (n > 0 && (n = attendre_reponses(liste, n, mode, repertoire)) > pire)
+    pire = n;
+  return pire;
+}
+
+////////////////////////////
+// VOID RELAYER(INT, INT) //
+///////////////////////////////////////////////////////////////////////
+// Côté serveur : renvoie au client, au fil de l'eau, tout ce que la //
+// commande écrit sur sa sortie standard et sa sortie d'erreur,      //
+// jusqu'à ce qu'elle ait fermé les deux                             //
+///////////////////////////////////////////////////////////////////////
+
+static void
+relayer(int sortie, int erreur){
+  struct pollfd p[2];
+  int ouverts = 2, i;
+  ssize_t k;
+
+  p[0].fd = sortie;
+  p[1].fd = erreur;
+  p[0].events = p[1].events = POLLIN;
+
+  while (ouverts > 0){
+    if (poll(p, 2, -1) == -1){
+      if (errno == EINTR)
+	continue;
+      break;
+    }
+    for (i = 0; i < 2; i++){
+      if (p[i].fd < 0 || p[i].revents == 0)
+	continue;
+      k = read(p[i].fd, morceau, sizeof(morceau));
+      if (k > 0)
+	envoyer_trame(STDOUT_FILENO, i == 0 ? 'O' : 'E', morceau, k);
+      else if (k == 0 || errno != EINTR){
+	close(p[i].fd);
+	p[i].fd = -1;
+	ouverts--;
+      }
+    }
+  }
+  for (i = 0; i < 2; i++)
+    if (p[i].fd >= 0)
+      close(p[i].fd);
+}
+
+////////////////////////////////
+// VOID EXECUTER_RECUE(CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Côté serveur : exécute une ligne reçue dans un fils dont l'entrée //
+// est /dev/null et dont les sorties sont relayées, puis envoie son  //
+// statut                                                            //
+///////////////////////////////////////////////////////////////////////
+
+static void
+executer_recue(char *ligne){
+  int sortie[2], erreur[2], null, st;
+  Analyseur analyseur;
+  pid_t pid;
+
+  if (pipe2(sortie, O_CLOEXEC) == -1 || pipe2(erreur, O_CLOEXEC) == -1){
+    envoyer_trame(STDOUT_FILENO, 'S', NULL, 126);
+    return;
+  }
+
+  if ((pid = forker_shell(-1, false)) == 0){
+    if ((null = open("/dev/null", O_RDONLY)) != -1){
+      dup2(null, STDIN_FILENO);
+      close(null);
+    }
+    dup2(sortie[1], STDOUT_FILENO);
+    dup2(erreur[1], STDERR_FILENO);
+    close(sortie[0]); close(sortie[1]);
+    close(erreur[0]); close(erreur[1]);
+
+    initialiser_analyseur(&analyseur);
+    if (analyser_ligne(&analyseur, ligne, strlen(ligne)) != 0 || analyseur.expression == NULL)
+      exit(2);
+    status = 0;
+    executer_et_terminer(analyseur.expression);
+  }
+
+  close(sortie[1]);
+  close(erreur[1]);
+  if (pid == -1){
+    close(sortie[0]);
+    close(erreur[0]);
+    envoyer_trame(STDOUT_FILENO, 'S', NULL, 126);
+    return;
+  }
+
+  relayer(sortie[0], erreur[0]);
+  while (waitpid(pid, &st, 0) == -1 && errno == EINTR)
+    ;
+  envoyer_trame(STDOUT_FILENO, 'S', NULL, statut_normalise(st));
+}
+
+///////////////////////////////
+// VOID SERVIR_DISTANT(VOID) //
+////////////////////////////////////////////////////////////////////////
+// Mode "Termina --serveur" : exécute les commandes reçues sur        //
+// l'entrée standard jusqu'à sa fermeture. SIGCHLD reste bloqué : les //
+// fils sont attendus explicitement.                                  //
+////////////////////////////////////////////////////////////////////////
+
+void
+servir_distant(void){
+  char type, *ligne;
+  size_t n;
+
+  initialiser_taches(false);
+  bloquer_recolte();
+
+  while (lire_entete(stdin, &type, &n) == 0){
+    if ((ligne = malloc(n + 2)) == NULL || fread(ligne, 1, n, stdin) != n)
+      break;
+    if (type == 'C'){
+      ligne[n] = '\n'; // L'analyseur attend une ligne complète
+      ligne[n + 1] = '\0';
+      executer_recue(ligne);
+    }
+    free(ligne);
+    arene_reinitialiser(&arene_ligne);
+  }
+  exit(0);
+}
@@ -0,0 +1,24 @@
+#ifndef _DISTANT_H
+#define _DISTANT_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "Multiplexeur.h"
+
+/*
+ * Réserve de sessions distantes de la commande interne remote : une session
+ * par machine, ouverte une fois puis réutilisée par chaque commande.
+ */
+
+int ouvrir_session(const char *hote);
+int fermer_session(const char *hote);
+void afficher_sessions(FILE *f);
+int executer_a_distance(const char *hote, char **argv);
+int executer_partout(char **argv, mode_mux mode, const char *repertoire);
+
+void servir_distant(void);
+
+int ecrire_tout(int fd, const char *p, size_t n);
+
+#endif
@@ -1,12 +1,21 @@
-#include <fcntl.h>
-#include <sys/wait.h>
+#include <signal.h>
 
 #include "Evaluation.h"
+#include "Arene.h"
 #include "Commandes_Internes.h"
+#include "Compilation.h"
+#include "Lancement.h"
+#include "Mesures.h"
+#include "Motifs.h"
+#include "Pipeline.h"
+#include "Statistiques.h"
+#include "Substitution.h"
+#include "Taches.h"
+#include "Variables.h"
 
 /*--------------------------------------------------------------------------------------.
-| Lorsque l'analyse de la ligne de commande est effectuée sans erreur. La variable      |
-| globale ExpressionAnalysee pointe sur un arbre représentant l'expression.  Le type    |
+| Lorsque l'analyse de la ligne de commande est effectuée sans erreur, le champ         |
+| expression de l'Analyseur pointe sur un arbre représentant l'expression.  Le type     |
 |       "Expression" de l'arbre est décrit dans le fichier Shell.h. Il contient 4       |
 |       champs. Si e est du type Expression :					        |
 | 										        |
@@ -25,6 +34,15 @@
 |   - REDIRECTION_A, redirection de la sortie en mode APPEND (>>).		        |
 |   - REDIRECTION_E, redirection de la sortie erreur,  	   			        |
 |   - REDIRECTION_EO, redirection des sorties erreur et standard.		        |
+|   - REDIRECTION_DOC, document en entrée (<<MOT) : e.arguments contient son texte      |
+|     puis son délimiteur.                                                              |
+|   - REDIRECTION_CHAINE, chaîne en entrée (<<<), suivie d'une fin de ligne.            |
+|   - SOUS_SHELL, sous-shell ( ... ).                                                   |
+|   - SI, if ... then ... else ... fi : e.gauche est la condition, e.droite un noeud    |
+|     ALTERNATIVE dont les fils sont les branches then et else (NULL sans else).        |
+|   - TANT_QUE, JUSQUA, boucles while et until : condition à gauche, corps à droite.    |
+|   - POUR, boucle for : corps à gauche ; e.arguments contient le nom de la variable    |
+|     puis les mots à lui affecter.                                                     |
 | 										        |
 | - e.gauche et e.droite, de type Expression *, représentent une sous-expression gauche |
 |       et une sous-expression droite. Ces deux champs ne sont pas utilisés pour les    |
@@ -47,130 +65,326 @@
 // INT EXECUTER_SIMPLE(EXPRESSION*) //
 ///////////////////////////////////////////////////////////////////////////////
 // Fonction exécutant une commande simple (cas SIMPLE de l'arbre syntaxique) //
+// Les redirections en vigueur ne touchent les descripteurs du shell que     //
+// pour les commandes internes ; les commandes externes les reçoivent sous   //
+// forme d'actions exécutées par le fils (voir Lancement.c). Avec le         //
+// contrôle des tâches, cat et copy sont évalués dans un fils au premier     //
+// plan, que Ctrl-C et Ctrl-Z atteignent (le shell les ignore).              //
 ///////////////////////////////////////////////////////////////////////////////
 
 static int
 executer_SIMPLE(Expression * e){
-  
-  if (!executer_interne(e, &status)){
+  char ** arguments = e->arguments;
+  int sauvegarde[3];
+  pid_t pid;
 
-    if (fork() == 0){
-      execvp(e->arguments[0], e->arguments);
-    }
+  if (controle_des_taches && est_interne(arguments) && est_copie_longue(arguments)){
+    if ((pid = forker_shell(0, true)) == 0)
+      executer_et_terminer(e); // Sans contrôle des tâches dans le fils : copie sur place
+    if (pid == -1)
+      return status = 1;
+    suivre_processus(pid, e);
+    status = attendre_premier_plan(&pid, 1, pid, e);
+  }
+  else if (est_interne(e->arguments)){
+
+    // La commande interne lit ses arguments développés dans e, le temps
+    // de son exécution ; une affectation seule prend le statut de son
+    // dernier $(...)
+    statut_substitution = -1;
+    e->arguments = developper_arguments(arguments);
+    debuter_interne(e);
+    if (redirections_en_cours == NULL)
+      executer_interne(e, &status);
     else {
-      wait(&status);
+      if (rediriger_temporairement(redirections_en_cours, sauvegarde) == 0)
+	executer_interne(e, &status);
+      else
+	status = 1;
+      restaurer_redirections(sauvegarde);
     }
+    terminer_interne(e);
+    e->arguments = arguments;
 
   }
-  
+  else {
+    // Avec le contrôle des tâches, la commande a son propre groupe
+    pid = lancer_commande(developper_arguments(e->arguments), redirections_en_cours, controle_des_taches ? 0 : -1);
+    suivre_processus(pid, e);
+    status = attendre_premier_plan(&pid, 1, pid, e);
+  }
+
   return status;
   
 }
 
+//////////////////////////////////
+// INT EXECUTER_BG(EXPRESSION*) //
+//////////////////////////////////////////////////////////////////////////
+// Lance e en arrière-plan et l'enregistre dans la table des tâches.    //
+// Une commande externe est lancée directement, une chaîne de pipes par //
+// le moteur de pipelines ; le reste est évalué dans un fils du shell,  //
+// qui se termine ensuite.                                              //
+//////////////////////////////////////////////////////////////////////////
+
+static int
+executer_BG(Expression * e){
+  pid_t pgid = controle_des_taches ? 0 : -1;
+  pid_t pid;
+
+  if (e->type == PIPE)
+    return executer_pipeline(e, true);
+
+  if (est_commande_externe(e))
+    pid = lancer_expression(e, redirections_en_cours, pgid);
+  else if ((pid = forker_shell(pgid, false)) == 0)
+    executer_et_terminer(e);
+
+  if (pid == -1)
+    return status = 1;
+  lancer_tache(&pid, 1, pid, e);
+  return status = 0;
+}
+
 //////////////////////////////////////////
-// INT EXECUTER_EXPRESSION(EXPRESSION*) //
-////////////////////////////////////////////////////////////////////////////////////////
-// Fonction récursive parcourant l'arbre et s'assurant du respect des types de noeuds //
-// de l'arbre syntaxique (pipes, redirections, séquences...)                          //
-////////////////////////////////////////////////////////////////////////////////////////
+// INT EXECUTER_SOUS_SHELL(EXPRESSION*) //
+////////////////////////////////////////////////////////////////////
+// ( e ) : e est évaluée dans un fils du shell, attendu comme une //
+// commande au premier plan ; cd, exit... ne touchent que lui     //
+////////////////////////////////////////////////////////////////////
 
-int
-executer_expression(Expression * e){
+static int
+executer_SOUS_SHELL(Expression * e){
+  pid_t pid;
 
-  int fd; // Cas simples
-  int fd_pipe[2], backup[2]; // Pipes et redirections multiples
-  
-  switch (e->type) {
-
-  case VIDE :
-    status = 0;
-    break;
-    
-  case SIMPLE :
-    executer_SIMPLE(e);
-    break;
-
-  case SEQUENCE :
-    executer_expression(e->gauche);
-    executer_expression(e->droite);
-    break;
-
-  case SEQUENCE_ET :
-    executer_expression(e->gauche);
-    if (status == 0)
-      executer_expression(e->droite);
-    break;
-
-  case SEQUENCE_OU :
-    executer_expression(e->gauche);
-    if (status != 0)
-      executer_expression(e->droite);
-    break;
-    
-  case BG :
-    if (fork() == 0)
-      executer_expression(e->gauche);
-    break;
-
-  case PIPE :
-    pipe(fd_pipe);
-    
-    backup[1] = dup(1);
-    dup2(fd_pipe[1], 1);
-    executer_expression(e->gauche);
-    close(fd_pipe[1]);
-    dup2(backup[1], 1);
-    
-    backup[0] = dup(0);
-    dup2(fd_pipe[0], 0);
-    executer_expression(e->droite);
-    dup2(backup[0], 0);
-
-    break;
-    
-  case REDIRECTION_I :
-    fd = dup(0);
-    dup2(open(e->arguments[0], 0), 0);
-    executer_expression(e->gauche);
-    dup2(fd, 0);
-    break;
-    
-  case REDIRECTION_O :
-    fd = dup(1);
-    dup2(open(e->arguments[0], O_CREAT|O_TRUNC|O_WRONLY, 0x664), 1);
-    executer_expression(e->gauche);
-    dup2(fd, 1);
-    break;
-    
-  case REDIRECTION_A :
-    fd = dup(1);
-    dup2(open(e->arguments[0], O_CREAT|O_APPEND|O_WRONLY, 0x664), 1);
-    executer_expression(e->gauche);
-    dup2(fd, 1);
-    break;
-    
-  case REDIRECTION_E :
-    fd = dup(2);
-    dup2(open(e->arguments[0], O_CREAT|O_TRUNC|O_WRONLY, 0x664), 1);
-    executer_expression(e->gauche);
-    dup2(fd, 2);
-    break;
-    
-  case REDIRECTION_EO :
-    backup[0] = dup(2);
-    backup[1] = dup(1);
-    fd = open(e->arguments[0], O_CREAT|O_TRUNC|O_WRONLY, 0x664);
-    dup2(fd, 1);
-    dup2(fd, 2);
-    executer_expression(e->gauche);
-    dup2(backup[0], 2);
-    dup2(backup[1], 1);
-    break;
-    
-  default :
-    break;
+  if ((pid = forker_shell(controle_des_taches ? 0 : -1, controle_des_taches)) == 0)
+    executer_et_terminer(e->gauche);
+
+  if (pid == -1)
+    return status = 1;
+  suivre_processus(pid, e);
+  return status = attendre_premier_plan(&pid, 1, pid, e);
+}
+
+/*--------------------------------------------------------------------------------------.
+| Exécution d'un programme (voir Compilation.c) : une boucle sur ses instructions, sans |
+| récursion. Les redirections empilées et l'état des boucles ont leurs cases dans deux  |
+| tableaux pris dans l'arène au lancement du programme.                                 |
+|                                                                                       |
+| A chaque tour de boucle, l'arène revient à sa marque du début de la boucle : les      |
+| arguments développés, les chaînes de pipes... d'un tour sont rendus au suivant, et    |
+| une boucle de millions de tours ne fait pas grandir la mémoire du shell.              |
+|                                                                                       |
+| Une commande tuée par SIGINT (Ctrl-C) interrompt le programme, comme dans bash : sans |
+| quoi il serait impossible d'arrêter while true; do sleep 1; done.                     |
+`--------------------------------------------------------------------------------------*/
+
+typedef struct Boucle {
+  Marque marque;     // Arène au début de la boucle
+  char **mots;       // for : mots restant à affecter
+  int statut;        // Statut du dernier tour (0 si aucun)
+} Boucle;
+
+// Vrai si rien ne reste à exécuter après l'instruction qui précède i
+
+static bool
+est_derniere(Programme *p, Instruction *i){
+  for (;;)
+    switch (i->op){
+    case OP_RESTAURER :
+    case OP_FERMER :
+    case OP_FIN_MESURE :
+      i++;
+      break;
+    case OP_SAUT :
+      i = p->code + i->cible;
+      break;
+    default :
+      return i->op == OP_FIN;
+    }
+}
+
+static bool
+interrompue(void){
+  return status == 128 + SIGINT;
+}
+
+//////////////////////////////////////////////
+// INT EXECUTER_PROGRAMME(PROGRAMME*, BOOL) //
+//////////////////////////////////////////////////////////////////////////
+// Exécute p. Avec terminer (processus qui se termine juste après, voir //
+// executer_et_terminer), la dernière commande, si elle est externe,    //
+// remplace le processus au lieu d'être lancée puis attendue.           //
+//////////////////////////////////////////////////////////////////////////
+
+static int
+executer_programme(Programme *p, bool terminer){
+  Redirection *englobantes = redirections_en_cours, *r;
+  Redirection *pile = arene_allouer(&arene_ligne, p->nb_redirections * sizeof(Redirection));
+  Boucle *boucles = arene_allouer(&arene_ligne, p->nb_boucles * sizeof(Boucle)), *b;
+  Instruction *i = p->code;
+
+  while (i->op != OP_FIN){
+    switch (i->op){
+
+    case OP_VIDE :
+      status = 0;
+      break;
+
+    case OP_SIMPLE :
+      if (terminer && !est_interne(i->e->arguments) && est_derniere(p, i + 1)){
+	if (appliquer_redirections(redirections_en_cours) == -1)
+	  _exit(1);
+	remplacer_commande(developper_arguments(i->e->arguments));
+      }
+      executer_SIMPLE(i->e);
+      break;
+
+    case OP_BG :
+      executer_BG(i->e->gauche);
+      break;
+
+    case OP_PIPE :
+      executer_pipeline(i->e, false); // Tous les étages de la chaîne sont lancés ensemble
+      break;
+
+    case OP_SOUS_SHELL :
+      if (terminer && est_derniere(p, i + 1))
+	executer_et_terminer(i->e->gauche); // Déjà dans un processus à part
+      executer_SOUS_SHELL(i->e);
+      break;
+
+    case OP_REDIRIGER :
+      r = &pile[i->niveau];
+      r->type = i->e->type;
+      r->fichier = developper_mot(i->e->arguments[0]);
+      r->englobante = redirections_en_cours;
+      redirections_en_cours = r;
+      debuter_octets(r, r->type);
+      break;
+
+    case OP_RESTAURER :
+      compter_octets(&pile[i->niveau], i->e->type);
+      redirections_en_cours = pile[i->niveau].englobante;
+      break;
+
+    case OP_OUVRIR :
+      if (ouvrir_redirection(&pile[i->niveau], i->e->type, developper_mot(i->e->arguments[0])) == -1){
+	status = 1;
+	i = p->code + i->cible;
+	continue;
+      }
+      debuter_octets(&pile[i->niveau], i->e->type);
+      break;
+
+    case OP_FERMER :
+      compter_octets(&pile[i->niveau], i->e->type);
+      close(pile[i->niveau].fd);
+      redirections_en_cours = pile[i->niveau].englobante;
+      break;
+
+    case OP_SAUT :
+      i = p->code + i->cible;
+      continue;
+
+    case OP_SAUT_SI_ECHEC :
+      if (status != 0){
+	i = p->code + i->cible;
+	continue;
+      }
+      break;
+
+    case OP_SAUT_SI_SUCCES :
+      if (status == 0){
+	i = p->code + i->cible;
+	continue;
+      }
+      break;
+
+    case OP_POUR :
+      b = &boucles[i->niveau]; // niveau n'est une boucle que pour ces instructions
+      b->mots = developper_arguments(i->e->arguments + 1);
+      // FALLTHROUGH
+    case OP_ENTRER :
+      b = &boucles[i->niveau];
+      b->marque = arene_marquer(&arene_ligne);
+      b->statut = 0;
+      break;
+
+    case OP_SUIVANT :
+      b = &boucles[i->niveau];
+      if (*b->mots == NULL){
+	i = p->code + i->cible;
+	continue;
+      }
+      affecter_variable(i->e->arguments[0], *b->mots++);
+      break;
+
+    case OP_BOUCLER :
+      b = &boucles[i->niveau];
+      b->statut = status;
+      arene_revenir(&arene_ligne, b->marque);
+      i = p->code + i->cible;
+      continue;
+
+    case OP_SORTIR :
+      status = boucles[i->niveau].statut;
+      break;
+
+    case OP_DEBUT_MESURE :
+      debuter_mesure(i->e);
+      break;
+
+    case OP_FIN_MESURE :
+      terminer_mesure(i->e);
+      break;
+    }
+
+    if ((i->op == OP_SIMPLE || i->op == OP_PIPE || i->op == OP_SOUS_SHELL) && interrompue())
+      break;
+    i++;
   }
-  
+
+  // Après une interruption, des fichiers ouverts par OP_OUVRIR peuvent
+  // rester dans la pile (deux fois le même pour &>)
+  for (r = redirections_en_cours; r != englobantes; r = r->englobante)
+    if (r->type == PIPE && (r->englobante == englobantes || r->englobante->fd != r->fd))
+      close(r->fd);
+  redirections_en_cours = englobantes;
   return status;
-    
+}
+
+////////////////////////////////////////////
+// VOID EXECUTER_ET_TERMINER(EXPRESSION*) //
+////////////////////////////////////////////////////////////////////////
+// Evalue e dans un processus qui se termine juste après (fils forké, //
+// ou shell -c à sa dernière ligne), puis le termine avec le statut.  //
+// La dernière commande à exécuter, si elle est externe, remplace le  //
+// processus au lieu d'être lancée puis attendue : un sous-shell ou   //
+// une tâche qui finit par une longue commande ne laisse pas un shell //
+// inactif derrière elle. Ne revient pas.                             //
+////////////////////////////////////////////////////////////////////////
+
+void
+executer_et_terminer(Expression * e){
+  // Le processus est à nous : les redirections en vigueur sont appliquées
+  // une fois pour toutes
+  if (appliquer_redirections(redirections_en_cours) == -1)
+    _exit(1);
+  redirections_en_cours = NULL;
+
+  executer_programme(compiler(e), true);
+  fflush(stdout);
+  _exit(status);
+}
+
+//////////////////////////////////////////
+// INT EXECUTER_EXPRESSION(EXPRESSION*) //
+/////////////////////////////////////////////////////////
+// Traduit l'arbre e en instructions, puis les exécute //
+/////////////////////////////////////////////////////////
+
+int
+executer_expression(Expression * e){
+  return executer_programme(compiler(e), false);
 }
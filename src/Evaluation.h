@@ -4,5 +4,6 @@
 #include "Shell.h"
 
 int executer_expression(Expression * e);
+void executer_et_terminer(Expression * e);
 
 #endif
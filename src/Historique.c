@@ -0,0 +1,593 @@
+#define _GNU_SOURCE // memmem(), memrchr()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Historique.h"
+#include "Saisie.h"
+
+/*--------------------------------------------------------------------------------------.
+| Historique persistant. Le fichier ~/.termina_historique (ou $TERMINA_HISTORIQUE)      |
+| contient une entrée par ligne. Il n'est jamais réécrit : chaque instance y ajoute     |
+| ses lignes d'un seul write() en mode O_APPEND, ce qui permet à plusieurs shells de    |
+| s'en servir en même temps. Il est projeté en mémoire, et reprojeté quand il a grandi  |
+| (lignes ajoutées par les autres instances) ; seules les dernières entrées sont        |
+| données à readline pour les flèches.                                                  |
+|                                                                                       |
+| Un index (même chemin, suffixe .index) couvre un préfixe du fichier. Il donne la      |
+| position de chaque entrée couverte et, pour chaque trigramme (suite de trois octets), |
+| la liste croissante des entrées qui le contiennent, codée par différences en entiers  |
+| de taille variable :                                                                  |
+|                                                                                       |
+|   EnteteIndex | positions[nb_entrees + 1] | Trigramme[nb_trigrammes] | listes        |
+|                                                                                       |
+| Une recherche d'au moins trois octets ne vérifie que les entrées de la liste la plus  |
+| courte parmi les trigrammes du motif ; la fin du fichier que l'index ne couvre pas    |
+| encore est parcourue ligne à ligne. Quand cette fin dépasse SEUIL_INDEXATION,         |
+| l'index est refait au démarrage par un processus détaché, puis remplacé d'un coup     |
+| (rename()) : l'instance qui le lit n'en voit jamais un à moitié écrit.                |
+`--------------------------------------------------------------------------------------*/
+
+#define MAGIQUE 0x31494854u          // "THI1"
+#define NB_CHARGEES 1000             // Entrées données à readline au démarrage
+#define SEUIL_INDEXATION (1 << 20)   // Octets non indexés tolérés
+
+typedef struct EnteteIndex {
+  uint32_t magique;
+  uint32_t nb_entrees;      // Entrées couvertes
+  uint64_t couvert;         // Octets du fichier couverts
+  uint64_t inode;           // Fichier indexé
+  uint32_t nb_trigrammes;
+  uint32_t taille_listes;   // Octets de la zone des listes
+} EnteteIndex;
+
+typedef struct Trigramme {
+  uint32_t cle;             // Les trois octets
+  uint32_t debut;           // Position de sa liste dans la zone des listes
+  uint32_t nombre;          // Entrées qui le contiennent
+} Trigramme;
+
+typedef struct Resultats {  // Entrées trouvées, dans l'ordre du fichier
+  uint64_t *debuts;
+  uint32_t *longueurs;
+  long *numeros;
+  size_t nb, capacite;
+} Resultats;
+
+static int fd_historique = -1;
+static char *chemin_historique = NULL;
+static char *chemin_index = NULL;
+
+static const char *texte = NULL;     // Fichier projeté
+static size_t taille_projetee = 0;
+static size_t fin_texte = 0;         // Fin de la dernière ligne complète
+
+static const EnteteIndex *entete = NULL; // Index projeté, NULL sans index valide
+static size_t taille_index = 0;
+static const uint32_t *positions;
+static const Trigramme *trigrammes;
+static const uint8_t *listes;
+
+/////////////////////////
+// VOID PROJETER(VOID) //
+//////////////////////////////////////////////////////////////////
+// (Re)projette le fichier d'historique s'il a changé de taille //
+//////////////////////////////////////////////////////////////////
+
+static void
+projeter(void){
+  struct stat st;
+  void *p;
+
+  if (fd_historique == -1 || fstat(fd_historique, &st) == -1
+      || (size_t) st.st_size == taille_projetee)
+    return;
+
+  if (texte != NULL)
+    munmap((void *) texte, taille_projetee);
+  texte = NULL;
+  taille_projetee = fin_texte = 0;
+  if (st.st_size == 0)
+    return;
+  if ((p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd_historique, 0)) == MAP_FAILED)
+    return;
+
+  texte = p;
+  taille_projetee = st.st_size;
+  // Une ligne en cours d'écriture par une autre instance est ignorée
+  p = memrchr(texte, '\n', taille_projetee);
+  fin_texte = (p == NULL) ? 0 : (const char *) p - texte + 1;
+}
+
+//////////////////////////////
+// VOID CHARGER_INDEX(VOID) //
+/////////////////////////////////////////////////////////////////////////
+// Projette l'index, s'il existe et correspond bien au fichier : même  //
+// inode, préfixe couvert qui se termine par une fin de ligne, tailles //
+// cohérentes                                                          //
+/////////////////////////////////////////////////////////////////////////
+
+static void
+charger_index(void){
+  struct stat sh, si;
+  const EnteteIndex *e;
+  size_t attendue;
+  void *p;
+  int fd;
+
+  if ((fd = open(chemin_index, O_RDONLY | O_CLOEXEC)) == -1)
+    return;
+  if (fstat(fd, &si) == -1 || fstat(fd_historique, &sh) == -1
+      || (size_t) si.st_size < sizeof(EnteteIndex)
+      || (p = mmap(NULL, si.st_size, PROT_READ, MAP_SHARED, fd, 0)) == MAP_FAILED){
+    close(fd);
+    return;
+  }
+  close(fd);
+
+  e = p;
+  attendue = sizeof(EnteteIndex) + (e->nb_entrees + 1) * sizeof(uint32_t)
+    + (size_t) e->nb_trigrammes * sizeof(Trigramme) + e->taille_listes;
+  if (e->magique != MAGIQUE || e->inode != (uint64_t) sh.st_ino
+      || (size_t) si.st_size != attendue || e->couvert > fin_texte
+      || (e->couvert > 0 && texte[e->couvert - 1] != '\n')){
+    munmap(p, si.st_size);
+    return;
+  }
+
+  entete = e;
+  taille_index = si.st_size;
+  positions = (const uint32_t *) (entete + 1);
+  trigrammes = (const Trigramme *) (positions + entete->nb_entrees + 1);
+  listes = (const uint8_t *) (trigrammes + entete->nb_trigrammes);
+}
+
+static uint32_t
+cle(const char *p){
+  return (uint32_t) (unsigned char) p[0] << 16 | (uint32_t) (unsigned char) p[1] << 8
+    | (unsigned char) p[2];
+}
+
+// Entier de taille variable : 7 bits par octet, bit de poids fort pour "à suivre"
+
+static const uint8_t *
+lire_varint(const uint8_t *p, uint32_t *v){
+  int decalage = 0;
+
+  *v = 0;
+  do {
+    *v |= (uint32_t) (*p & 0x7f) << decalage;
+    decalage += 7;
+  } while (*p++ & 0x80);
+  return p;
+}
+
+static void
+ajouter_resultat(Resultats *r, uint64_t debut, uint32_t longueur, long numero){
+  if (r->nb == r->capacite){
+    r->capacite = r->capacite ? 2 * r->capacite : 64;
+    r->debuts = realloc(r->debuts, r->capacite * sizeof(uint64_t));
+    r->longueurs = realloc(r->longueurs, r->capacite * sizeof(uint32_t));
+    r->numeros = realloc(r->numeros, r->capacite * sizeof(long));
+  }
+  r->debuts[r->nb] = debut;
+  r->longueurs[r->nb] = longueur;
+  r->numeros[r->nb++] = numero;
+}
+
+/////////////////////////////////////////////////////////////////
+// VOID BALAYER(SIZE_T, SIZE_T, LONG, CONST CHAR*, RESULTATS*) //
+////////////////////////////////////////////////////////////////////
+// Recherche ligne à ligne de motif entre les octets debut et fin //
+// (la première ligne porte le numéro numero)                     //
+////////////////////////////////////////////////////////////////////
+
+static void
+balayer(size_t debut, size_t fin, long numero, const char *motif, Resultats *r){
+  size_t n = strlen(motif);
+  const char *ligne, *eol;
+
+  for (ligne = texte + debut; ligne < texte + fin; ligne = eol + 1, numero++){
+    eol = memchr(ligne, '\n', texte + fin - ligne);
+    if (memmem(ligne, eol - ligne, motif, n) != NULL)
+      ajouter_resultat(r, ligne - texte, eol - ligne, numero);
+  }
+}
+
+////////////////////////////////////////////
+// VOID CHERCHER(CONST CHAR*, RESULTATS*) //
+//////////////////////////////////////////////////////////////////////
+// Toutes les entrées contenant motif, dans l'ordre du fichier. Les //
+// entrées sont numérotées à partir de 1.                           //
+//////////////////////////////////////////////////////////////////////
+
+static void
+chercher(const char *motif, Resultats *r){
+  const Trigramme *t, *rare = NULL;
+  const uint8_t *p;
+  size_t n = strlen(motif), couvert = 0, i;
+  long nb_couvertes = 0;
+  uint32_t k, delta, entree = 0;
+
+  r->nb = 0;
+  projeter();
+  if (texte == NULL)
+    return;
+
+  if (entete != NULL){
+    couvert = entete->couvert;
+    nb_couvertes = entete->nb_entrees;
+  }
+
+  if (entete != NULL && n >= 3){
+    // La liste la plus courte parmi les trigrammes du motif
+    for (i = 0; i + 3 <= n; i++){
+      uint32_t c = cle(motif + i);
+      size_t bas = 0, haut = entete->nb_trigrammes;
+      while (bas < haut){
+	size_t milieu = (bas + haut) / 2;
+	if (trigrammes[milieu].cle < c)
+	  bas = milieu + 1;
+	else
+	  haut = milieu;
+      }
+      t = (bas < entete->nb_trigrammes && trigrammes[bas].cle == c) ? &trigrammes[bas] : NULL;
+      if (t == NULL){ // Trigramme absent : aucune entrée couverte ne convient
+	rare = NULL;
+	break;
+      }
+      if (rare == NULL || t->nombre < rare->nombre)
+	rare = t;
+    }
+    if (rare != NULL)
+      for (p = listes + rare->debut, k = 0; k < rare->nombre; k++){
+	p = lire_varint(p, &delta);
+	entree += delta;
+	if (memmem(texte + positions[entree], positions[entree + 1] - positions[entree] - 1,
+		   motif, n) != NULL)
+	  ajouter_resultat(r, positions[entree], positions[entree + 1] - positions[entree] - 1,
+			   entree + 1);
+      }
+  }
+  else
+    balayer(0, couvert, 1, motif, r);
+
+  balayer(couvert, fin_texte, nb_couvertes + 1, motif, r);
+}
+
+static void
+liberer_resultats(Resultats *r){
+  free(r->debuts);
+  free(r->longueurs);
+  free(r->numeros);
+  memset(r, 0, sizeof(*r));
+}
+
+/*--------------------------------------------------------------------------------------.
+| Construction de l'index. Les entrées sont parcourues dans l'ordre : la liste de       |
+| chaque trigramme (une table de hachage les range pendant la construction) se remplit  |
+| donc déjà triée, et un trigramme vu deux fois dans la même entrée n'y est ajouté      |
+| qu'une fois.                                                                          |
+`--------------------------------------------------------------------------------------*/
+
+typedef struct Liste {
+  uint32_t cle;             // 0 : case vide (une entrée ne contient pas d'octet nul)
+  uint32_t derniere;        // Dernière entrée ajoutée
+  uint32_t nombre;
+  uint32_t longueur, capacite;
+  uint8_t *octets;
+} Liste;
+
+static Liste *table = NULL;
+static size_t capacite_table = 0, nb_listes = 0;
+
+static Liste *
+liste_de(uint32_t c){
+  size_t i = (c * 2654435761u) & (capacite_table - 1);
+
+  while (table[i].cle != 0 && table[i].cle != c)
+    i = (i + 1) & (capacite_table - 1);
+  return &table[i];
+}
+
+static void
+agrandir_table(void){
+  Liste *ancienne = table;
+  size_t ancienne_capacite = capacite_table, i;
+
+  capacite_table = capacite_table ? 2 * capacite_table : 1 << 16;
+  table = calloc(capacite_table, sizeof(Liste));
+  for (i = 0; i < ancienne_capacite; i++)
+    if (ancienne[i].cle != 0)
+      *liste_de(ancienne[i].cle) = ancienne[i];
+  free(ancienne);
+}
+
+static void
+ajouter_entree(uint32_t c, uint32_t entree){
+  Liste *l;
+  uint32_t v;
+
+  if (2 * (nb_listes + 1) > capacite_table)
+    agrandir_table();
+  l = liste_de(c);
+  if (l->cle == 0){
+    l->cle = c;
+    l->derniere = 0;
+    nb_listes++;
+  }
+  else if (l->derniere == entree)
+    return;
+
+  if (l->longueur + 5 > l->capacite){
+    l->capacite = l->capacite ? 2 * l->capacite : 8;
+    l->octets = realloc(l->octets, l->capacite);
+  }
+  for (v = entree - l->derniere; v >= 0x80; v >>= 7)
+    l->octets[l->longueur++] = (v & 0x7f) | 0x80;
+  l->octets[l->longueur++] = v;
+  l->derniere = entree;
+  l->nombre++;
+}
+
+static int
+comparer_listes(const void *a, const void *b){
+  uint32_t x = (*(Liste * const *) a)->cle, y = (*(Liste * const *) b)->cle;
+  return (x > y) - (x < y);
+}
+
+static int
+ecrire_tout(int fd, const void *p, size_t n){
+  ssize_t k;
+
+  for (; n > 0; p = (const char *) p + k, n -= k)
+    if ((k = write(fd, p, n)) == -1){
+      if (errno == EINTR){
+	k = 0;
+	continue;
+      }
+      return -1;
+    }
+  return 0;
+}
+
+/////////////////////////////////
+// VOID CONSTRUIRE_INDEX(VOID) //
+////////////////////////////////////////////////////////////////////
+// Indexe tout le fichier projeté et remplace l'index par le neuf //
+////////////////////////////////////////////////////////////////////
+
+static void
+construire_index(void){
+  EnteteIndex e = {MAGIQUE, 0, 0, 0, 0, 0};
+  uint32_t *pos = NULL, debut = 0;
+  Liste **triees;
+  Trigramme t;
+  const char *ligne, *eol;
+  size_t capacite_pos = 0, i, j;
+  struct stat st;
+  char *temporaire;
+  int fd;
+
+  if (texte == NULL || fin_texte > UINT32_MAX || fstat(fd_historique, &st) == -1)
+    return;
+
+  // Entrée numéro i (à partir de 0) : ses trigrammes et sa position
+  for (ligne = texte; ligne < texte + fin_texte; ligne = eol + 1){
+    eol = memchr(ligne, '\n', texte + fin_texte - ligne);
+    if (e.nb_entrees + 2 > capacite_pos){
+      capacite_pos = capacite_pos ? 2 * capacite_pos : 4096;
+      pos = realloc(pos, capacite_pos * sizeof(uint32_t));
+    }
+    pos[e.nb_entrees] = ligne - texte;
+    for (j = 0; ligne + j + 3 <= eol; j++)
+      ajouter_entree(cle(ligne + j), e.nb_entrees);
+    e.nb_entrees++;
+  }
+  if (pos == NULL)
+    return;
+  pos[e.nb_entrees] = fin_texte;
+
+  // Le premier ajout de chaque liste est l'écart depuis l'entrée 0 : c'est
+  // bien le numéro de l'entrée, que lire_varint() additionne à 0
+  triees = malloc(nb_listes * sizeof(Liste *));
+  for (i = j = 0; i < capacite_table; i++)
+    if (table[i].cle != 0)
+      triees[j++] = &table[i];
+  qsort(triees, nb_listes, sizeof(Liste *), comparer_listes);
+
+  e.couvert = fin_texte;
+  e.inode = st.st_ino;
+  e.nb_trigrammes = nb_listes;
+  for (i = 0; i < nb_listes; i++)
+    e.taille_listes += triees[i]->longueur;
+
+  if (asprintf(&temporaire, "%s.XXXXXX", chemin_index) == -1)
+    return;
+  if ((fd = mkstemp(temporaire)) == -1){
+    free(temporaire);
+    return;
+  }
+  fchmod(fd, 0600);
+
+  if (ecrire_tout(fd, &e, sizeof(e)) == -1
+      || ecrire_tout(fd, pos, (e.nb_entrees + 1) * sizeof(uint32_t)) == -1)
+    goto echec;
+  for (i = 0; i < nb_listes; i++){
+    t = (Trigramme){triees[i]->cle, debut, triees[i]->nombre};
+    debut += triees[i]->longueur;
+    if (ecrire_tout(fd, &t, sizeof(t)) == -1)
+      goto echec;
+  }
+  for (i = 0; i < nb_listes; i++)
+    if (ecrire_tout(fd, triees[i]->octets, triees[i]->longueur) == -1)
+      goto echec;
+
+  if (close(fd) == 0 && rename(temporaire, chemin_index) == 0){
+    free(temporaire);
+    return;
+  }
+ echec:
+  close(fd);
+  unlink(temporaire);
+  free(temporaire);
+}
+
+//////////////////////////////////
+// VOID LANCER_INDEXATION(VOID) //
+//////////////////////////////////////////////////////////////////////
+// Refait l'index dans un processus détaché (double fork, nouvelle  //
+// session : il n'est ni un fils à récolter, ni touché par Ctrl-C), //
+// pour que le démarrage n'ait pas à l'attendre                     //
+//////////////////////////////////////////////////////////////////////
+
+static void
+lancer_indexation(void){
+  pid_t pid;
+
+  if ((pid = fork()) == 0){
+    if (fork() == 0){
+      setsid();
+      nice(10);
+      construire_index();
+    }
+    _exit(0);
+  }
+  if (pid > 0)
+    waitpid(pid, NULL, 0);
+}
+
+/*--------------------------------------------------------------------------------------.
+| Ctrl-R : le texte déjà tapé sert de motif, et chaque nouvel appui remplace la ligne   |
+| par l'entrée suivante (de la plus récente à la plus ancienne) qui le contient.        |
+`--------------------------------------------------------------------------------------*/
+
+static int
+rechercher_arriere(int compte, int touche){
+  static Resultats r;
+  static size_t suivante;
+  static char *motif = NULL;
+  char *ligne;
+
+  if (*saisie.rl_last_func != rechercher_arriere){
+    free(motif);
+    motif = strdup(*saisie.rl_line_buffer);
+    chercher(motif, &r);
+    suivante = r.nb;
+  }
+
+  // Une entrée identique à la ligne affichée ne compte pas
+  do {
+    if (suivante == 0){
+      saisie.rl_ding();
+      return 0;
+    }
+    suivante--;
+  } while (r.longueurs[suivante] == (uint32_t) *saisie.rl_end
+	   && memcmp(texte + r.debuts[suivante], *saisie.rl_line_buffer, *saisie.rl_end) == 0);
+
+  ligne = strndup(texte + r.debuts[suivante], r.longueurs[suivante]);
+  saisie.rl_replace_line(ligne, 0);
+  *saisie.rl_point = *saisie.rl_end;
+  free(ligne);
+  return 0;
+}
+
+//////////////////////////////////
+// VOID OUVRIR_HISTORIQUE(VOID) //
+/////////////////////////////////////////////////////////////////////
+// Ouvre (ou crée) l'historique, charge ses dernières entrées dans //
+// readline et installe Ctrl-R. Sans fichier utilisable, le shell  //
+// garde l'historique de readline, limité à la session.            //
+/////////////////////////////////////////////////////////////////////
+
+void
+ouvrir_historique(void){
+  const char *chemin = getenv("TERMINA_HISTORIQUE"), *home = getenv("HOME");
+  const char *p, *debut, *fin;
+  char *ligne;
+  int n;
+
+  if (chemin != NULL)
+    chemin_historique = strdup(chemin);
+  else if (home == NULL || asprintf(&chemin_historique, "%s/.termina_historique", home) == -1)
+    return;
+  if (asprintf(&chemin_index, "%s.index", chemin_historique) == -1)
+    return;
+
+  fd_historique = open(chemin_historique, O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+  if (fd_historique == -1){
+    fprintf(stderr, "%s : %s.\n", chemin_historique, strerror(errno));
+    return;
+  }
+
+  projeter();
+  charger_index();
+  if (fin_texte - (entete ? entete->couvert : 0) > SEUIL_INDEXATION)
+    lancer_indexation();
+
+  // Les NB_CHARGEES dernières entrées, pour les flèches
+  for (p = texte + fin_texte, n = 0; p > texte && n < NB_CHARGEES; n++){
+    p--; // Fin de ligne de l'entrée précédente
+    while (p > texte && p[-1] != '\n')
+      p--;
+  }
+  for (debut = p; debut < texte + fin_texte; debut = fin + 1){
+    fin = memchr(debut, '\n', texte + fin_texte - debut);
+    ligne = strndup(debut, fin - debut);
+    saisie.add_history(ligne);
+    free(ligne);
+  }
+
+  saisie.rl_add_defun("termina-recherche-historique", rechercher_arriere, CTRL('R'));
+}
+
+bool
+historique_ouvert(void){
+  return fd_historique != -1;
+}
+
+//////////////////////////////////////////
+// VOID AJOUTER_HISTORIQUE(CONST CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Ajoute une ligne (non vide) à readline et à la fin du fichier, en //
+// un seul write() : les lignes de deux instances ne se mêlent pas   //
+///////////////////////////////////////////////////////////////////////
+
+void
+ajouter_historique(const char *ligne){
+  struct iovec v[2] = {{(void *) ligne, strlen(ligne)}, {"\n", 1}};
+
+  if (*ligne == '\0')
+    return;
+  saisie.add_history(ligne);
+  if (fd_historique != -1 && strchr(ligne, '\n') == NULL)
+    writev(fd_historique, v, 2);
+}
+
+/////////////////////////////////////////////////
+// INT AFFICHER_HISTORIQUE(FILE*, CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Ecrit, numérotées, les entrées contenant motif (toutes si motif //
+// vaut NULL). Renvoie 0, ou 1 si aucune entrée ne convient.       //
+/////////////////////////////////////////////////////////////////////
+
+int
+afficher_historique(FILE *f, const char *motif){
+  Resultats r = {0};
+  size_t i;
+
+  chercher(motif ? motif : "", &r);
+  for (i = 0; i < r.nb; i++)
+    fprintf(f, "%5ld  %.*s\n", r.numeros[i], (int) r.longueurs[i], texte + r.debuts[i]);
+  liberer_resultats(&r);
+  return (motif != NULL && i == 0) ? 1 : 0;
+}
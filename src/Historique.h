@@ -0,0 +1,17 @@
+#ifndef _HISTORIQUE_H
+#define _HISTORIQUE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Historique persistant du shell interactif : un fichier partagé par toutes
+ * les instances, projeté en mémoire et indexé par trigrammes.
+ */
+
+void ouvrir_historique(void);
+bool historique_ouvert(void);
+void ajouter_historique(const char *ligne);
+int afficher_historique(FILE *f, const char *motif);
+
+#endif
@@ -0,0 +1,532 @@
+#define _GNU_SOURCE // memfd_create(), pipe2(), F_ADD_SEALS
+
+#include <errno.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <limits.h>
+#include <signal.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#include "Lancement.h"
+#include "Chemins.h"
+#include "Commandes_Internes.h"
+#include "Distant.h"
+#include "Mesures.h"
+#include "Motifs.h"
+#include "Statistiques.h"
+#include "Variables.h"
+
+/*--------------------------------------------------------------------------------------.
+| Moteur de lancement des commandes externes. Plutôt que de forker tout le shell puis   |
+| de jongler avec dup/dup2 dans le père, chaque commande est lancée par posix_spawn     |
+| (un clone en mode vfork dans la glibc : l'espace mémoire du shell n'est pas copié).   |
+| Les redirections en vigueur sont compilées en actions sur fichiers exécutées par le   |
+| fils avant l'exec : la table des descripteurs du shell n'est jamais touchée.          |
+|                                                                                       |
+| Seules les commandes internes, exécutées dans le shell lui-même, ont encore besoin    |
+| de rediriger temporairement les descripteurs du shell.                                |
+|                                                                                       |
+| Un document (<<MOT) ou une chaîne (<<<) en entrée ne passe pas par un fichier         |
+| temporaire : son texte est écrit par le shell dans un tube s'il y tient sans bloquer, |
+| sinon dans un fichier anonyme en mémoire (memfd), scellé en lecture seule.            |
+`--------------------------------------------------------------------------------------*/
+
+Redirection *redirections_en_cours = NULL;
+
+//////////////////////////////////
+// BOOL EST_REDIRECTION(EXPR_T) //
+//////////////////////////////////////////////////////////////////
+// Vrai si le noeud de type type est une redirection de fichier //
+//////////////////////////////////////////////////////////////////
+
+bool
+est_redirection(expr_t type){
+  switch (type) {
+  case REDIRECTION_I :
+  case REDIRECTION_O :
+  case REDIRECTION_A :
+  case REDIRECTION_E :
+  case REDIRECTION_EO :
+  case REDIRECTION_DOC :
+  case REDIRECTION_CHAINE :
+    return true;
+  default :
+    return false;
+  }
+}
+
+///////////////////////////////
+// BOOL EST_DOCUMENT(EXPR_T) //
+///////////////////////////////////////////////////////////////////////
+// Vrai si la redirection de type type fournit un texte en entrée    //
+// (<<, <<<) : elle n'a pas de fichier, mais un descripteur à ouvrir //
+// par le shell (voir ouvrir_document)                               //
+///////////////////////////////////////////////////////////////////////
+
+bool
+est_document(expr_t type){
+  return type == REDIRECTION_DOC || type == REDIRECTION_CHAINE;
+}
+
+// Mode d'ouverture et descripteur redirigé de chaque type de redirection
+
+static int
+drapeaux_ouverture(expr_t type){
+  switch (type) {
+  case REDIRECTION_I :
+    return O_RDONLY | O_CLOEXEC;
+  case REDIRECTION_A :
+    return O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC;
+  default :
+    return O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC;
+  }
+}
+
+static int
+descripteur_cible(Redirection *r){
+  switch (r->type) {
+  case PIPE :
+    return r->cible;
+  case REDIRECTION_I :
+  case REDIRECTION_DOC :
+  case REDIRECTION_CHAINE :
+    return STDIN_FILENO;
+  case REDIRECTION_E :
+    return STDERR_FILENO;
+  default :
+    return STDOUT_FILENO;
+  }
+}
+
+////////////////////////////////////////////////////////////////////
+// INT AJOUTER_ACTIONS(POSIX_SPAWN_FILE_ACTIONS_T*, REDIRECTION*) //
+///////////////////////////////////////////////////////////////////////
+// Traduit la pile de redirections en actions exécutées par le fils, //
+// de la plus externe à la plus interne                              //
+///////////////////////////////////////////////////////////////////////
+
+static int
+ajouter_actions(posix_spawn_file_actions_t * actions, Redirection * r){
+  if (r == NULL)
+    return 0;
+
+  ajouter_actions(actions, r->englobante);
+
+  if (r->type == PIPE)
+    return posix_spawn_file_actions_adddup2(actions, r->fd, r->cible);
+
+  posix_spawn_file_actions_addopen(actions, descripteur_cible(r), r->fichier,
+				   drapeaux_ouverture(r->type) & ~O_CLOEXEC, 0666);
+  if (r->type == REDIRECTION_EO)
+    posix_spawn_file_actions_adddup2(actions, STDOUT_FILENO, STDERR_FILENO);
+  return 0;
+}
+
+///////////////////////////////////////////////////
+// VOID SIGNALER_ECHEC(CHAR*, REDIRECTION*, INT) //
+/////////////////////////////////////////////////////////////////////////
+// Explique l'échec d'un lancement. posix_spawn renvoie la même erreur //
+// (ENOENT, EACCES...) pour un exécutable introuvable et pour un       //
+// fichier de redirection qui ne s'ouvre pas : on vérifie donc d'abord //
+// les fichiers, en entrée comme en sortie.                            //
+/////////////////////////////////////////////////////////////////////////
+
+// Erreur qu'aurait l'ouverture du fichier de r, ou 0
+static int
+erreur_fichier(Redirection * r){
+  struct stat st;
+  char *copie;
+  int err = 0;
+
+  if (r->type == PIPE)
+    return 0;
+  if (r->type == REDIRECTION_I)
+    return (access(r->fichier, R_OK) == -1) ? errno : 0;
+
+  if (stat(r->fichier, &st) == 0)
+    return S_ISDIR(st.st_mode) ? EISDIR : (access(r->fichier, W_OK) == -1) ? errno : 0;
+  if (errno != ENOENT)
+    return errno;
+  // Fichier à créer : son répertoire doit exister et être modifiable
+  if ((copie = strdup(r->fichier)) != NULL){
+    if (access(dirname(copie), W_OK | X_OK) == -1)
+      err = errno;
+    free(copie);
+  }
+  return err;
+}
+
+static void
+signaler_echec(char * commande, Redirection * r, int err){
+  int e;
+
+  for (; r != NULL; r = r->englobante)
+    if ((e = erreur_fichier(r)) != 0){
+      fprintf(stderr, "%s : %s.\n", r->fichier, strerror(e));
+      return;
+    }
+
+  if (err == ENOENT)
+    fprintf(stderr, "%s : commande introuvable.\n", commande);
+  else
+    fprintf(stderr, "%s : %s.\n", commande, strerror(err));
+}
+
+////////////////////////////////////////////////////////
+// PID_T LANCER_COMMANDE(CHAR**, REDIRECTION*, PID_T) //
+/////////////////////////////////////////////////////////////////////////
+// Lance la commande externe argv avec les redirections r, sans        //
+// l'attendre. pgid vaut -1 pour rester dans le groupe du shell, 0     //
+// pour que le fils crée son propre groupe, ou le groupe à rejoindre.  //
+// Renvoie le pid du fils, ou -1 si la commande n'a pas pu être lancée //
+// (le fils s'est alors déjà terminé proprement).                      //
+/////////////////////////////////////////////////////////////////////////
+
+pid_t
+lancer_commande(char ** argv, Redirection * r, pid_t pgid){
+  posix_spawn_file_actions_t actions;
+  posix_spawnattr_t attributs;
+  sigset_t masque, defaut;
+  short drapeaux = POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF;
+  pid_t pid;
+  char *chemin;
+  double debut;
+  int err;
+
+  // Chemin résolu par le cache : pas de parcours de $PATH à chaque exec
+  if ((chemin = chercher_commande(argv[0])) == NULL){
+    fprintf(stderr, "%s : commande introuvable.\n", argv[0]);
+    compteurs[ECHECS_LANCEMENT]++;
+    return -1;
+  }
+
+  posix_spawn_file_actions_init(&actions);
+  ajouter_actions(&actions, r);
+
+  // Le fils repart avec un masque vide et les signaux de contrôle de
+  // tâches dans leur comportement par défaut, quoi qu'en fasse le shell
+  posix_spawnattr_init(&attributs);
+  sigemptyset(&masque);
+  posix_spawnattr_setsigmask(&attributs, &masque);
+  sigemptyset(&defaut);
+  sigaddset(&defaut, SIGINT);
+  sigaddset(&defaut, SIGQUIT);
+  sigaddset(&defaut, SIGTSTP);
+  sigaddset(&defaut, SIGTTIN);
+  sigaddset(&defaut, SIGTTOU);
+  sigaddset(&defaut, SIGPIPE);
+  sigaddset(&defaut, SIGCHLD);
+  posix_spawnattr_setsigdefault(&attributs, &defaut);
+  if (pgid >= 0){
+    drapeaux |= POSIX_SPAWN_SETPGROUP;
+    posix_spawnattr_setpgroup(&attributs, pgid);
+  }
+  posix_spawnattr_setflags(&attributs, drapeaux);
+
+  fflush(stdout); // Ce que le shell a déjà écrit doit passer avant le fils
+
+  debut = horloge();
+  err = posix_spawn(&pid, chemin, &actions, &attributs, argv, environnement());
+
+  // L'exécutable a disparu depuis sa mise en cache : on le recherche
+  if (err == ENOENT && chemin != argv[0] && access(chemin, X_OK) == -1){
+    oublier_commande(argv[0]);
+    if ((chemin = chercher_commande(argv[0])) != NULL)
+      err = posix_spawn(&pid, chemin, &actions, &attributs, argv, environnement());
+  }
+  observer(DUREE_LANCEMENT, debut, horloge());
+
+  posix_spawn_file_actions_destroy(&actions);
+  posix_spawnattr_destroy(&attributs);
+
+  if (err != 0){
+    signaler_echec(argv[0], r, err);
+    compteurs[ECHECS_LANCEMENT]++;
+    return -1;
+  }
+  compteurs[EXTERNES]++;
+  return pid;
+}
+
+/////////////////////////////////////
+// VOID REMPLACER_COMMANDE(CHAR**) //
+///////////////////////////////////////////////////////////////////////
+// Exécute la commande externe argv à la place du processus courant, //
+// qui n'avait plus qu'à l'attendre puis se terminer : ni fork, ni   //
+// attente. Les redirections doivent déjà être appliquées. Ne        //
+// revient pas : un échec termine le processus (127 ou 126).         //
+///////////////////////////////////////////////////////////////////////
+
+void
+remplacer_commande(char ** argv){
+  sigset_t masque;
+  char *chemin;
+  int err = ENOENT;
+
+  fflush(stdout);
+
+  // Comme pour posix_spawn : masque vide, et SIGPIPE (que le mode serveur
+  // ignore) dans son comportement par défaut
+  signal(SIGPIPE, SIG_DFL);
+  sigemptyset(&masque);
+  sigprocmask(SIG_SETMASK, &masque, NULL);
+
+  if ((chemin = chercher_commande(argv[0])) != NULL){
+    execve(chemin, argv, environnement());
+    err = errno;
+    if (err == ENOENT && chemin != argv[0]){ // Disparu depuis sa mise en cache
+      oublier_commande(argv[0]);
+      if ((chemin = chercher_commande(argv[0])) != NULL){
+	execve(chemin, argv, environnement());
+	err = errno;
+      }
+    }
+  }
+
+  if (err == ENOENT){
+    fprintf(stderr, "%s : commande introuvable.\n", argv[0]);
+    _exit(127);
+  }
+  fprintf(stderr, "%s : %s.\n", argv[0], strerror(err));
+  _exit(126);
+}
+
+////////////////////////////////////////////
+// BOOL EST_COMMANDE_EXTERNE(EXPRESSION*) //
+/////////////////////////////////////////////////////////////////////
+// Vrai si e est une commande externe, sous d'éventuelles          //
+// redirections : elle peut alors être lancée sans forker le shell //
+/////////////////////////////////////////////////////////////////////
+
+bool
+est_commande_externe(Expression * e){
+  while (est_redirection(e->type))
+    e = e->gauche;
+  return e->type == SIMPLE && !est_interne(e->arguments);
+}
+
+////////////////////////////////////////
+// INT OUVRIR_DOCUMENT(EXPR_T, CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Descripteur d'où lire le texte d'un document (ou d'une chaîne,    //
+// suivie d'une fin de ligne), positionné à son début. Jusqu'à       //
+// PIPE_BUF octets, le texte est écrit d'un coup dans un tube qui ne //
+// peut pas bloquer ; au-delà, dans un memfd scellé : le texte ne    //
+// peut plus changer, et le lecteur peut se déplacer dedans.         //
+///////////////////////////////////////////////////////////////////////
+
+static int
+ouvrir_document(expr_t type, const char * texte){
+  size_t longueur = strlen(texte);
+  bool chaine = (type == REDIRECTION_CHAINE);
+  int tube[2], fd;
+
+  compteurs[OCTETS_LUS] += longueur + chaine;
+
+  if (longueur + chaine <= PIPE_BUF){
+    if (pipe2(tube, O_CLOEXEC) == -1){
+      perror("pipe");
+      return -1;
+    }
+    ecrire_tout(tube[1], texte, longueur);
+    if (chaine)
+      ecrire_tout(tube[1], "\n", 1);
+    close(tube[1]);
+    return tube[0];
+  }
+
+  if ((fd = memfd_create("document", MFD_CLOEXEC | MFD_ALLOW_SEALING)) == -1){
+    perror("memfd_create");
+    return -1;
+  }
+  if (ecrire_tout(fd, texte, longueur) == -1
+      || (chaine && ecrire_tout(fd, "\n", 1) == -1)
+      || fcntl(fd, F_ADD_SEALS, F_SEAL_WRITE | F_SEAL_GROW | F_SEAL_SHRINK | F_SEAL_SEAL) == -1
+      || lseek(fd, 0, SEEK_SET) == -1){
+    perror("memfd");
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+///////////////////////////////////////////////////////////////
+// PID_T LANCER_EXPRESSION(EXPRESSION*, REDIRECTION*, PID_T) //
+////////////////////////////////////////////////////////////////////////
+// Lance une commande externe redirigée (voir est_commande_externe) : //
+// ses redirections propres sont empilées par-dessus r                //
+////////////////////////////////////////////////////////////////////////
+
+pid_t
+lancer_expression(Expression * e, Redirection * r, pid_t pgid){
+  Redirection locale;
+  pid_t pid;
+
+  if (est_document(e->type)){
+    if ((locale.fd = ouvrir_document(e->type, developper_mot(e->arguments[0]))) == -1)
+      return -1;
+    locale = (Redirection){.type = PIPE, .fd = locale.fd, .cible = STDIN_FILENO, .englobante = r};
+    pid = lancer_expression(e->gauche, &locale, pgid);
+    close(locale.fd);
+    return pid;
+  }
+  if (est_redirection(e->type)){
+    locale = (Redirection){.type = e->type, .fichier = developper_mot(e->arguments[0]), .englobante = r};
+    return lancer_expression(e->gauche, &locale, pgid);
+  }
+  return lancer_commande(developper_arguments(e->arguments), r, pgid);
+}
+
+//////////////////////////////////
+// INT ATTENDRE_COMMANDE(PID_T) //
+///////////////////////////////////////////////////////////////
+// Attend la fin du fils pid et renvoie son statut normalisé //
+///////////////////////////////////////////////////////////////
+
+int
+attendre_commande(pid_t pid){
+  int st;
+
+  while (attendre_processus(pid, &st, 0) == -1)
+    if (errno != EINTR)
+      return 1;
+  return statut_normalise(st);
+}
+
+///////////////////////////////
+// INT STATUT_NORMALISE(INT) //
+/////////////////////////////////////////////////////////////////////////
+// Convertit un statut de wait() en code de retour : le code de exit() //
+// du fils, ou 128 + numéro du signal qui l'a tué                      //
+/////////////////////////////////////////////////////////////////////////
+
+int
+statut_normalise(int st){
+  if (WIFEXITED(st))
+    return WEXITSTATUS(st);
+  if (WIFSIGNALED(st))
+    return 128 + WTERMSIG(st);
+  return st;
+}
+
+/////////////////////////////////////////////////////////
+// INT OUVRIR_REDIRECTION(REDIRECTION*, EXPR_T, CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Redirection qui englobe plusieurs commandes (boucle, if) : le     //
+// fichier est ouvert une seule fois, par le shell, et empilé comme  //
+// les tubes sous forme de descripteur à dupliquer, dans r[0] (et    //
+// r[1] pour &>). Sans quoi chaque commande rouvrirait le fichier et //
+// > écraserait la sortie des précédentes. Un document, dont fichier //
+// est alors le texte, est toujours ouvert ainsi. Renvoie le         //
+// descripteur, à fermer une fois la pile rendue, ou -1.             //
+///////////////////////////////////////////////////////////////////////
+
+int
+ouvrir_redirection(Redirection * r, expr_t type, char * fichier){
+  int fd;
+
+  if (est_document(type)){
+    if ((fd = ouvrir_document(type, fichier)) == -1)
+      return -1;
+  }
+  else if ((fd = open(fichier, drapeaux_ouverture(type), 0666)) == -1){
+    fprintf(stderr, "%s : %s.\n", fichier, strerror(errno));
+    return -1;
+  }
+
+  r[0] = (Redirection){.type = type, .fichier = fichier, .fd = fd, .englobante = redirections_en_cours};
+  r[0].cible = descripteur_cible(&r[0]);
+  r[0].type = PIPE;
+  redirections_en_cours = &r[0];
+  if (type == REDIRECTION_EO){
+    r[1] = (Redirection){.type = PIPE, .fichier = fichier, .fd = fd, .cible = STDERR_FILENO, .englobante = &r[0]};
+    redirections_en_cours = &r[1];
+  }
+  return fd;
+}
+
+///////////////////////////////////////
+// INT APPLIQUER(REDIRECTION*, INT*) //
+/////////////////////////////////////////////////////////////////////////
+// Applique la pile r aux descripteurs du processus courant, de la     //
+// plus externe à la plus interne. Si sauvegarde n'est pas NULL, une   //
+// copie de chacun des descripteurs 0, 1 et 2 est faite avant qu'il ne //
+// soit remplacé pour la première fois.                                //
+/////////////////////////////////////////////////////////////////////////
+
+static void
+sauver(int fd, int * sauvegarde){
+  if (sauvegarde != NULL && fd <= STDERR_FILENO && sauvegarde[fd] == -1)
+    sauvegarde[fd] = fcntl(fd, F_DUPFD_CLOEXEC, 10);
+}
+
+static int
+appliquer(Redirection * r, int * sauvegarde){
+  int fd, cible;
+
+  if (r == NULL)
+    return 0;
+  if (appliquer(r->englobante, sauvegarde) == -1)
+    return -1;
+
+  if (r->type == PIPE)
+    fd = r->fd;
+  else if ((fd = open(r->fichier, drapeaux_ouverture(r->type), 0666)) == -1){
+    fprintf(stderr, "%s : %s.\n", r->fichier, strerror(errno));
+    return -1;
+  }
+
+  cible = descripteur_cible(r);
+  sauver(cible, sauvegarde);
+  dup2(fd, cible);
+  if (r->type == REDIRECTION_EO){
+    sauver(STDERR_FILENO, sauvegarde);
+    dup2(fd, STDERR_FILENO);
+  }
+
+  if (r->type != PIPE)
+    close(fd);
+  return 0;
+}
+
+//////////////////////////////////////////////
+// INT APPLIQUER_REDIRECTIONS(REDIRECTION*) //
+/////////////////////////////////////////////////////////////////
+// Applique définitivement la pile r (dans un fils déjà forké) //
+/////////////////////////////////////////////////////////////////
+
+int
+appliquer_redirections(Redirection * r){
+  return appliquer(r, NULL);
+}
+
+////////////////////////////////////////////////////////
+// INT REDIRIGER_TEMPORAIREMENT(REDIRECTION*, INT[3]) //
+/////////////////////////////////////////////////////////////////////
+// Applique la pile r le temps d'une commande interne. Les anciens //
+// descripteurs sont gardés dans sauvegarde, à rendre ensuite à    //
+// restaurer_redirections() (même en cas d'échec).                 //
+/////////////////////////////////////////////////////////////////////
+
+int
+rediriger_temporairement(Redirection * r, int sauvegarde[3]){
+  sauvegarde[0] = sauvegarde[1] = sauvegarde[2] = -1;
+  fflush(stdout);
+  fflush(stderr);
+  return appliquer(r, sauvegarde);
+}
+
+void
+restaurer_redirections(int sauvegarde[3]){
+  fflush(stdout);
+  fflush(stderr);
+  for (int fd = 0; fd <= STDERR_FILENO; fd++)
+    if (sauvegarde[fd] != -1){
+      dup2(sauvegarde[fd], fd);
+      close(sauvegarde[fd]);
+    }
+}
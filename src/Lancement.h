@@ -0,0 +1,40 @@
+#ifndef _LANCEMENT_H
+#define _LANCEMENT_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "Shell.h"
+
+/*
+ * Redirection à appliquer à une commande. Les redirections en vigueur forment
+ * une pile chaînée de la plus interne (en tête) à la plus externe : elles
+ * sont appliquées de l'extérieur vers l'intérieur, la plus interne l'emporte.
+ */
+
+typedef struct Redirection {
+  expr_t type;                    // REDIRECTION_*, ou PIPE pour dup2(fd, cible)
+  char *fichier;                  // Fichier des REDIRECTION_*
+  int fd, cible;                  // Descripteurs des PIPE
+  struct Redirection *englobante; // Redirection appliquée juste avant
+  long long taille;               // Taille du fichier avant la commande (Statistiques.c)
+} Redirection;
+
+extern Redirection *redirections_en_cours;
+
+bool est_redirection(expr_t type);
+bool est_document(expr_t type);
+
+bool est_commande_externe(Expression *e);
+pid_t lancer_commande(char **argv, Redirection *r, pid_t pgid);
+pid_t lancer_expression(Expression *e, Redirection *r, pid_t pgid);
+void remplacer_commande(char **argv);
+int attendre_commande(pid_t pid);
+int statut_normalise(int st);
+
+int ouvrir_redirection(Redirection *r, expr_t type, char *fichier);
+int appliquer_redirections(Redirection *r);
+int rediriger_temporairement(Redirection *r, int sauvegarde[3]);
+void restaurer_redirections(int sauvegarde[3]);
+
+#endif
@@ -0,0 +1,89 @@
+#define _DEFAULT_SOURCE // MAP_ANONYMOUS
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Lecture.h"
+
+/*--------------------------------------------------------------------------------------.
+| Préparation des entrées du mode non interactif. L'analyseur lexical lit directement   |
+| dans un tampon qu'il modifie en place (yy_scan_buffer), sans le recopier : ce tampon  |
+| doit se terminer par un '\n' (la dernière ligne est une ligne de commande comme les   |
+| autres) puis par deux octets nuls.                                                    |
+`--------------------------------------------------------------------------------------*/
+
+/////////////////////////////////////////////////
+// CHAR* PROJETER_SCRIPT(CONST CHAR*, SIZE_T*) //
+//////////////////////////////////////////////////////////////////////////
+// Projette le script chemin en mémoire et renvoie le tampon à analyser //
+// (taille reçoit sa longueur, fin comprise), ou NULL en cas d'erreur.  //
+//                                                                      //
+// Une zone anonyme (donc remplie de zéros) un peu plus grande que le   //
+// fichier est réservée, puis le fichier est projeté par-dessus son     //
+// début : les octets qui suivent le fichier existent toujours, même    //
+// quand sa taille est un multiple de la taille des pages. La           //
+// projection est privée, les écritures de l'analyseur ne touchent pas  //
+// le fichier.                                                          //
+//////////////////////////////////////////////////////////////////////////
+
+char *
+projeter_script(const char *chemin, size_t *taille){
+  struct stat st;
+  char *zone;
+  size_t n;
+  int fd;
+
+  if ((fd = open(chemin, O_RDONLY | O_CLOEXEC)) == -1 || fstat(fd, &st) == -1){
+    perror(chemin);
+    if (fd != -1)
+      close(fd);
+    return NULL;
+  }
+  n = st.st_size;
+
+  zone = mmap(NULL, n + 3, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (zone == MAP_FAILED
+      || (n > 0 && mmap(zone, n, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)){
+    perror(chemin);
+    close(fd);
+    return NULL;
+  }
+  close(fd);
+
+  madvise(zone, n, MADV_SEQUENTIAL);
+  if (n == 0 || zone[n - 1] != '\n')
+    zone[n++] = '\n';
+  zone[n] = zone[n + 1] = '\0';
+
+  *taille = n + 2;
+  return zone;
+}
+
+/////////////////////////////////////////////////
+// CHAR* PREPARER_CHAINE(CONST CHAR*, SIZE_T*) //
+////////////////////////////////////////////////////////////////
+// Recopie la chaîne de l'option -c dans un tampon à analyser //
+////////////////////////////////////////////////////////////////
+
+char *
+preparer_chaine(const char *commande, size_t *taille){
+  size_t n = strlen(commande);
+  char *tampon = malloc(n + 3);
+
+  if (tampon == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(tampon, commande, n);
+  if (n == 0 || tampon[n - 1] != '\n')
+    tampon[n++] = '\n';
+  tampon[n] = tampon[n + 1] = '\0';
+
+  *taille = n + 2;
+  return tampon;
+}
@@ -0,0 +1,9 @@
+#ifndef _LECTURE_H
+#define _LECTURE_H
+
+#include <stddef.h>
+
+char *projeter_script(const char *chemin, size_t *taille);
+char *preparer_chaine(const char *commande, size_t *taille);
+
+#endif
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE // wait4()
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Mesures.h"
+#include "Arene.h"
+#include "Lancement.h"
+
+/*--------------------------------------------------------------------------------------.
+| Mode analyse. Avant l'exécution d'une ligne, chaque noeud de son arbre reçoit une     |
+| Mesure (prise dans l'arène de la ligne). Les noeuds exécutés par le shell sont        |
+| chronométrés par les instructions qui encadrent leur code (voir Compilation.c) ; les  |
+| processus lancés au premier plan sont suivis par leur pid, et leur récolte passe par  |
+| wait4() pour obtenir leur consommation (temps CPU, RSS maximale). Juste avant, le     |
+| zombie est examiné (waitid(WNOWAIT)) pour lire ses compteurs d'octets lus et écrits   |
+| dans /proc/<pid>/io.                                                                  |
+|                                                                                       |
+| Les étages d'un pipeline sont récoltés dans l'ordre : la fin d'un étage terminé avant |
+| ceux qui le précèdent est donc datée un peu tard, ce qui ne change rien à son temps   |
+| CPU. Les noeuds qui ne sont pas mesurés eux-mêmes cumulent ensuite les mesures de     |
+| leurs fils (agreger_mesures).                                                         |
+`--------------------------------------------------------------------------------------*/
+
+typedef struct Suivi {
+  pid_t pid;
+  Mesure *mesure;
+} Suivi;
+
+bool mesures_actives = false;
+
+static Suivi *suivis = NULL;      // Processus au premier plan de la ligne
+static int nb_suivis = 0, capacite_suivis = 0;
+
+static struct rusage avant_interne;
+static long long lus_avant, ecrits_avant;
+
+static double
+maintenant(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+static double
+secondes(struct timeval t){
+  return t.tv_sec + t.tv_usec / 1e6;
+}
+
+// Compteurs d'octets lus et écrits d'un processus. Renvoie le nombre d'octets
+// lus pour les obtenir, qui s'ajoutent au compteur du lecteur
+
+static ssize_t
+lire_io(const char *chemin, long long *lus, long long *ecrits){
+  char texte[512];
+  ssize_t n = -1;
+  int fd;
+
+  *lus = *ecrits = 0;
+  if ((fd = open(chemin, O_RDONLY | O_CLOEXEC)) == -1)
+    return 0;
+  if ((n = read(fd, texte, sizeof(texte) - 1)) > 0){
+    texte[n] = '\0';
+    if (sscanf(texte, "rchar: %lld wchar: %lld", lus, ecrits) != 2)
+      *lus = *ecrits = 0;
+  }
+  close(fd);
+  return n > 0 ? n : 0;
+}
+
+////////////////////////////////////////
+// VOID PREPARER_MESURES(EXPRESSION*) //
+/////////////////////////////////////////////////////////////
+// Donne une mesure vierge à chaque noeud de l'arbre e, et //
+// oublie les processus suivis pendant la ligne précédente //
+/////////////////////////////////////////////////////////////
+
+static void
+preparer(Expression *e){
+  if (e == NULL)
+    return;
+  e->mesure = arene_allouer(&arene_ligne, sizeof(Mesure));
+  *e->mesure = (Mesure){0};
+  preparer(e->gauche);
+  preparer(e->droite);
+}
+
+void
+preparer_mesures(Expression *e){
+  nb_suivis = 0;
+  preparer(e);
+}
+
+void
+debuter_mesure(Expression *e){
+  if (e->mesure == NULL)
+    return;
+  e->mesure->executee = true;
+  e->mesure->debut = maintenant();
+}
+
+void
+terminer_mesure(Expression *e){
+  if (e->mesure == NULL)
+    return;
+  e->mesure->fin = maintenant();
+  e->mesure->statut = status;
+}
+
+////////////////////////////////////////////////
+// VOID DEBUTER/TERMINER_INTERNE(EXPRESSION*) //
+////////////////////////////////////////////////////////////////////
+// Une commande interne s'exécute dans le shell : sa consommation //
+// est la différence des compteurs du shell avant et après        //
+////////////////////////////////////////////////////////////////////
+
+void
+debuter_interne(Expression *e){
+  if (e->mesure == NULL)
+    return;
+  getrusage(RUSAGE_SELF, &avant_interne);
+  lus_avant += lire_io("/proc/self/io", &lus_avant, &ecrits_avant);
+}
+
+void
+terminer_interne(Expression *e){
+  Mesure *m = e->mesure;
+  struct rusage apres;
+
+  if (m == NULL)
+    return;
+  getrusage(RUSAGE_SELF, &apres);
+  lire_io("/proc/self/io", &m->lus, &m->ecrits);
+  m->lus -= lus_avant;
+  m->ecrits -= ecrits_avant;
+  m->utilisateur = secondes(apres.ru_utime) - secondes(avant_interne.ru_utime);
+  m->systeme = secondes(apres.ru_stime) - secondes(avant_interne.ru_stime);
+  m->rss_max = apres.ru_maxrss;
+  m->processus = true;
+}
+
+///////////////////////////////////////////////
+// VOID SUIVRE_PROCESSUS(PID_T, EXPRESSION*) //
+///////////////////////////////////////////////////////////////////////
+// Associe le processus pid, qui vient d'être lancé au premier plan, //
+// au noeud e. Pour une commande externe redirigée, la mesure va à   //
+// la commande elle-même.                                            //
+///////////////////////////////////////////////////////////////////////
+
+void
+suivre_processus(pid_t pid, Expression *e){
+  if (e->mesure == NULL || pid == -1)
+    return;
+  if (est_commande_externe(e))
+    while (est_redirection(e->type))
+      e = e->gauche;
+
+  if (nb_suivis == capacite_suivis){
+    capacite_suivis = capacite_suivis ? 2 * capacite_suivis : 16;
+    suivis = realloc(suivis, capacite_suivis * sizeof(Suivi));
+  }
+  suivis[nb_suivis++] = (Suivi){pid, e->mesure};
+  e->mesure->executee = true;
+  e->mesure->debut = maintenant();
+}
+
+////////////////////////////////////////////////
+// PID_T ATTENDRE_PROCESSUS(PID_T, INT*, INT) //
+//////////////////////////////////////////////////////////////////////
+// Remplace waitpid(pid, st, options). Si pid est suivi, la récolte //
+// de sa fin remplit sa mesure.                                     //
+//////////////////////////////////////////////////////////////////////
+
+pid_t
+attendre_processus(pid_t pid, int *st, int options){
+  Mesure *m = NULL;
+  struct rusage ru;
+  siginfo_t info;
+  char chemin[32];
+  pid_t r;
+  int i;
+
+  for (i = 0; i < nb_suivis && m == NULL; i++)
+    if (suivis[i].pid == pid)
+      m = suivis[i].mesure;
+  if (m == NULL)
+    return waitpid(pid, st, options);
+
+  // Le zombie garde ses compteurs d'entrées-sorties jusqu'à sa récolte
+  info.si_pid = 0;
+  if (waitid(P_PID, pid, &info, WEXITED | WNOWAIT | ((options & WUNTRACED) ? WSTOPPED : 0)) == -1)
+    return -1;
+  if (info.si_code == CLD_EXITED || info.si_code == CLD_KILLED || info.si_code == CLD_DUMPED){
+    snprintf(chemin, sizeof(chemin), "/proc/%d/io", (int) pid);
+    lire_io(chemin, &m->lus, &m->ecrits);
+  }
+
+  if ((r = wait4(pid, st, options, &ru)) <= 0)
+    return r;
+  if (WIFEXITED(*st) || WIFSIGNALED(*st)){
+    m->fin = maintenant();
+    m->utilisateur = secondes(ru.ru_utime);
+    m->systeme = secondes(ru.ru_stime);
+    m->rss_max = ru.ru_maxrss;
+    m->statut = statut_normalise(*st);
+    m->processus = true;
+  }
+  return r;
+}
+
+///////////////////////////////////////
+// VOID AGREGER_MESURES(EXPRESSION*) //
+///////////////////////////////////////////////////////////////////////
+// Complète, après l'exécution, les noeuds qui n'ont pas été mesurés //
+// eux-mêmes : consommation cumulée de leurs fils, et pour ceux que  //
+// le shell n'a pas chronométrés (noeuds internes d'un pipeline),    //
+// l'intervalle couvert par leurs fils et le statut du dernier.      //
+///////////////////////////////////////////////////////////////////////
+
+static void
+cumuler(Mesure *m, Mesure *f, bool chronometre){
+  if (!f->executee)
+    return;
+  m->utilisateur += f->utilisateur;
+  m->systeme += f->systeme;
+  if (f->rss_max > m->rss_max)
+    m->rss_max = f->rss_max;
+  m->lus += f->lus;
+  m->ecrits += f->ecrits;
+  if (chronometre)
+    return;
+  if (!m->executee || f->debut < m->debut)
+    m->debut = f->debut;
+  if (!m->executee || f->fin > m->fin)
+    m->fin = f->fin;
+  m->statut = f->statut;
+  m->executee = true;
+}
+
+void
+agreger_mesures(Expression *e){
+  bool chronometre;
+
+  if (e == NULL || e->mesure == NULL || e->mesure->processus)
+    return;
+  agreger_mesures(e->gauche);
+  agreger_mesures(e->droite);
+  if (e->type == BG) // Ses fils ne sont pas attendus
+    return;
+
+  chronometre = e->mesure->executee;
+  if (e->gauche != NULL)
+    cumuler(e->mesure, e->gauche->mesure, chronometre);
+  if (e->droite != NULL)
+    cumuler(e->mesure, e->droite->mesure, chronometre);
+}
@@ -0,0 +1,40 @@
+#ifndef _MESURES_H
+#define _MESURES_H
+
+#include <stdbool.h>
+#include <sys/types.h>
+
+#include "Shell.h"
+
+/*
+ * Mode analyse (option -a) : chaque noeud de l'arbre d'une ligne reçoit les
+ * mesures de son exécution, affichées ensuite avec l'arbre (voir Affichage.c).
+ */
+
+typedef struct Mesure {
+  bool executee;          // Le noeud a été exécuté (ou lancé)
+  bool processus;         // Mesures prises sur le noeud lui-même (processus
+                          // récolté ou commande interne), pas sur ses fils
+  double debut, fin;      // Horloge monotone, en secondes
+  double utilisateur;     // Temps CPU, en secondes
+  double systeme;
+  long rss_max;           // Ko
+  long long lus, ecrits;  // Octets (/proc/<pid>/io)
+  int statut;
+} Mesure;
+
+extern bool mesures_actives;
+
+void preparer_mesures(Expression *e);
+void debuter_mesure(Expression *e);
+void terminer_mesure(Expression *e);
+
+void debuter_interne(Expression *e);
+void terminer_interne(Expression *e);
+
+void suivre_processus(pid_t pid, Expression *e);
+pid_t attendre_processus(pid_t pid, int *st, int options);
+
+void agreger_mesures(Expression *e);
+
+#endif
@@ -0,0 +1,572 @@
+#define _GNU_SOURCE // O_DIRECTORY, st_mtim
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Motifs.h"
+#include "Arene.h"
+#include "Variables.h"
+
+/*--------------------------------------------------------------------------------------.
+| Développement des motifs. Juste avant le lancement d'une commande, chaque argument    |
+| qui contient un '*' ou un '?' non protégé est remplacé par les chemins qui lui        |
+| correspondent, triés ; un motif sans correspondance reste tel quel. Ses variables    |
+| viennent d'être substituées (Variables.c). Comme dans les autres shells, un joker ne  |
+| désigne pas un nom qui commence par un '.' (sauf si le motif commence lui-même par    |
+| '.'), ni "." et "..". Les mots entre guillemets sont protégés par l'analyseur         |
+| lexical (proteger_motif) et ne sont jamais développés.                                |
+|                                                                                       |
+| Un motif est découpé en composants séparés par des '/'. Un composant sans joker est   |
+| ouvert directement (openat) ; les autres sont confrontés aux noms de leur répertoire, |
+| lus par getdents64() dans un cache de quelques répertoires. Une entrée du cache est   |
+| reconnue à son inode et reste valable tant que la date de modification du répertoire  |
+| ne change pas ; un répertoire modifié dans la seconde qui précède sa lecture est      |
+| relu à chaque fois, la date pouvant ne pas avoir changé depuis.                       |
+|                                                                                       |
+| Chaque composant est compilé en segments (le texte entre deux '*'), que le filtrage   |
+| place chacun à sa première position possible, sans jamais revenir en arrière.         |
+`--------------------------------------------------------------------------------------*/
+
+#define NB_REPERTOIRES 32         // Répertoires gardés dans le cache
+#define TAILLE_LECTURE (1 << 16)  // Tampon de getdents64()
+#define JOKER (-1)                // '?' dans un segment compilé
+
+typedef struct EntreeNoyau {      // struct linux_dirent64
+  uint64_t d_ino;
+  int64_t d_off;
+  unsigned short d_reclen;
+  unsigned char d_type;
+  char d_name[];
+} EntreeNoyau;
+
+typedef struct Repertoire {
+  bool valide;
+  int utilise;                    // Parcours en cours : la case ne peut pas être reprise
+  dev_t dev;
+  ino_t ino;
+  struct timespec modification;
+  time_t lecture;
+  char *noms;                     // Noms à la suite, terminés par '\0'
+  size_t taille, capacite;
+  uint32_t *debuts;               // Début de chaque nom dans noms
+  unsigned char *types;           // d_type de chaque nom
+  size_t nb, capacite_entrees;
+} Repertoire;
+
+typedef struct Segment {
+  short *car;                     // Octets à reconnaître, JOKER pour '?'
+  size_t longueur;
+} Segment;
+
+typedef struct Motif {
+  Segment *segments;
+  int nb;
+  bool etoile;                    // Sans '*', l'unique segment couvre tout le nom
+  bool point;                     // Peut désigner un nom qui commence par '.'
+  size_t minimum;                 // Longueur cumulée des segments
+} Motif;
+
+static Repertoire cache[NB_REPERTOIRES];
+static int prochain = 0;          // Prochaine case reprise par un défaut de cache
+
+static char **trouves = NULL;     // Arguments développés de la commande en cours
+static size_t nb_trouves = 0, capacite_trouves = 0;
+
+static char *chemin = NULL;       // Chemin du répertoire en cours de parcours
+static size_t capacite_chemin = 0;
+
+// Un '*' ou un '?' que rien ne protège
+
+static bool
+contient_jokers(const char *mot, size_t longueur){
+  size_t i;
+
+  for (i = 0; i < longueur; i++)
+    if (mot[i] == '\\')
+      i++;
+    else if (mot[i] == '*' || mot[i] == '?')
+      return true;
+  return false;
+}
+
+// Un mot qui contient un de ces caractères passe par le développement : ses
+// '\' protègent alors le caractère suivant
+
+static bool
+a_developper(const char *mot, size_t longueur){
+  return memchr(mot, '*', longueur) != NULL || memchr(mot, '?', longueur) != NULL
+    || memchr(mot, '$', longueur) != NULL;
+}
+
+/////////////////////////////////////////////////////
+// CHAR* PROTEGER_MOTIF(CONST CHAR*, SIZE_T, BOOL) //
+/////////////////////////////////////////////////////////////////////////
+// Copie dans l'arène un mot entre guillemets. S'il doit passer par le //
+// développement, ses jokers, ses parenthèses et ses '\' sont protégés //
+// par un '\', ainsi que ses '$' si variables est faux (mot entre      //
+// apostrophes). Un $(...) devient $\(...\) : voir Substitution.c      //
+/////////////////////////////////////////////////////////////////////////
+
+char *
+proteger_motif(const char *mot, size_t longueur, bool variables){
+  char *copie, *p;
+  size_t i;
+
+  if (!a_developper(mot, longueur))
+    return arene_copier(&arene_ligne, mot, longueur);
+
+  p = copie = arene_allouer(&arene_ligne, 2 * longueur + 1);
+  for (i = 0; i < longueur; i++){
+    if (mot[i] == '*' || mot[i] == '?' || mot[i] == '\\' || mot[i] == '(' || mot[i] == ')'
+	|| (mot[i] == '$' && !variables))
+      *p++ = '\\';
+    *p++ = mot[i];
+  }
+  *p = '\0';
+  return copie;
+}
+
+// Retire sur place les '\' : c'est le mot tel quel, quand il n'est pas (ou
+// ne peut pas être) développé
+
+static char *
+retirer_protections(char *mot){
+  char *lu, *ecrit;
+
+  for (lu = ecrit = mot; *lu != '\0'; lu++){
+    if (*lu == '\\' && lu[1] != '\0')
+      lu++;
+    *ecrit++ = *lu;
+  }
+  *ecrit = '\0';
+  return mot;
+}
+
+/////////////////////////////
+// REPERTOIRE* LISTER(INT) //
+///////////////////////////////////////////////////////////////////////
+// Noms contenus dans le répertoire ouvert fd, pris dans le cache ou //
+// lus par getdents64(). NULL si le répertoire ne peut être lu.      //
+///////////////////////////////////////////////////////////////////////
+
+static void
+ajouter_nom(Repertoire *r, const char *nom, unsigned char type){
+  size_t n = strlen(nom) + 1;
+
+  while (r->taille + n > r->capacite){
+    r->capacite = r->capacite ? 2 * r->capacite : 4096;
+    r->noms = realloc(r->noms, r->capacite);
+  }
+  if (r->nb == r->capacite_entrees){
+    r->capacite_entrees = r->capacite_entrees ? 2 * r->capacite_entrees : 256;
+    r->debuts = realloc(r->debuts, r->capacite_entrees * sizeof(uint32_t));
+    r->types = realloc(r->types, r->capacite_entrees);
+  }
+  memcpy(r->noms + r->taille, nom, n);
+  r->debuts[r->nb] = r->taille;
+  r->types[r->nb++] = type;
+  r->taille += n;
+}
+
+static Repertoire *
+lister(int fd){
+  static char *tampon = NULL;
+  Repertoire *r = NULL;
+  EntreeNoyau *e;
+  struct stat st;
+  long n, i;
+  int k;
+
+  if (fstat(fd, &st) == -1)
+    return NULL;
+
+  for (k = 0; k < NB_REPERTOIRES && r == NULL; k++)
+    if (cache[k].valide && cache[k].dev == st.st_dev && cache[k].ino == st.st_ino)
+      r = &cache[k];
+  if (r != NULL && (r->utilise > 0
+		    || (r->modification.tv_sec == st.st_mtim.tv_sec
+			&& r->modification.tv_nsec == st.st_mtim.tv_nsec
+			&& r->lecture > st.st_mtim.tv_sec + 1)))
+    return r;
+
+  // Case à (re)lire : la sienne, ou la plus ancienne qui n'est pas parcourue
+  for (k = 0; r == NULL && k < NB_REPERTOIRES; k++, prochain = (prochain + 1) % NB_REPERTOIRES)
+    if (cache[prochain].utilise == 0)
+      r = &cache[prochain];
+  if (r == NULL || (tampon == NULL && (tampon = malloc(TAILLE_LECTURE)) == NULL))
+    return NULL;
+
+  r->valide = false;
+  r->taille = r->nb = 0;
+  r->lecture = time(NULL);
+  while ((n = syscall(SYS_getdents64, fd, tampon, TAILLE_LECTURE)) > 0)
+    for (i = 0; i < n; i += e->d_reclen){
+      e = (EntreeNoyau *) (tampon + i);
+      if (strcmp(e->d_name, ".") != 0 && strcmp(e->d_name, "..") != 0)
+	ajouter_nom(r, e->d_name, e->d_type);
+    }
+  if (n == -1)
+    return NULL;
+
+  r->dev = st.st_dev;
+  r->ino = st.st_ino;
+  r->modification = st.st_mtim;
+  r->valide = true;
+  return r;
+}
+
+////////////////////////////////////////////////
+// VOID COMPILER(CONST CHAR*, SIZE_T, MOTIF*) //
+///////////////////////////////////////////////////////////////////////
+// Découpe le composant p (longueur octets) en segments séparés par  //
+// des '*', en retirant les protections. Tout est pris dans l'arène. //
+///////////////////////////////////////////////////////////////////////
+
+static void
+compiler(const char *p, size_t longueur, Motif *m){
+  short *car = arene_allouer(&arene_ligne, (longueur + 1) * sizeof(short));
+  size_t i;
+
+  m->segments = arene_allouer(&arene_ligne, (longueur + 1) * sizeof(Segment));
+  m->nb = 0;
+  m->etoile = false;
+  m->point = (p[0] == '.');
+  m->minimum = 0;
+  m->segments[0] = (Segment){car, 0};
+
+  for (i = 0; i < longueur; i++){
+    if (p[i] == '*'){
+      m->etoile = true;
+      m->minimum += m->segments[m->nb].longueur;
+      m->segments[++m->nb] = (Segment){car, 0};
+      continue;
+    }
+    if (p[i] == '\\' && i + 1 < longueur)
+      *car++ = (unsigned char) p[++i];
+    else
+      *car++ = (p[i] == '?') ? JOKER : (unsigned char) p[i];
+    m->segments[m->nb].longueur++;
+  }
+  m->minimum += m->segments[m->nb++].longueur;
+}
+
+static bool
+egal(const Segment *s, const char *nom){
+  size_t i;
+
+  for (i = 0; i < s->longueur; i++)
+    if (s->car[i] != JOKER && s->car[i] != (unsigned char) nom[i])
+      return false;
+  return true;
+}
+
+////////////////////////////////////////////////////////
+// BOOL CORRESPOND(CONST MOTIF*, CONST CHAR*, SIZE_T) //
+////////////////////////////////////////////////////////////////////////
+// Le premier segment est au début du nom, le dernier à la fin ; ceux //
+// du milieu sont placés de gauche à droite, chacun à sa première     //
+// position possible. Cette place laisse le plus de choix aux         //
+// suivants : un échec est définitif, sans retour en arrière.         //
+////////////////////////////////////////////////////////////////////////
+
+static bool
+correspond(const Motif *m, const char *nom, size_t longueur){
+  const Segment *premier = &m->segments[0], *dernier = &m->segments[m->nb - 1], *s;
+  size_t debut, fin;
+  int k;
+
+  if (nom[0] == '.' && !m->point)
+    return false;
+  if (!m->etoile)
+    return longueur == premier->longueur && egal(premier, nom);
+  if (longueur < m->minimum || !egal(premier, nom)
+      || !egal(dernier, nom + longueur - dernier->longueur))
+    return false;
+
+  debut = premier->longueur;
+  fin = longueur - dernier->longueur;
+  for (k = 1; k < m->nb - 1; k++){
+    s = &m->segments[k];
+    while (debut + s->longueur <= fin && !egal(s, nom + debut))
+      debut++;
+    if (debut + s->longueur > fin)
+      return false;
+    debut += s->longueur;
+  }
+  return true;
+}
+
+static void
+ajouter_trouve(char *mot){
+  if (nb_trouves == capacite_trouves){
+    capacite_trouves = capacite_trouves ? 2 * capacite_trouves : 64;
+    trouves = realloc(trouves, capacite_trouves * sizeof(char *));
+  }
+  trouves[nb_trouves++] = mot;
+}
+
+static void
+etendre_chemin(size_t longueur){
+  while (longueur > capacite_chemin){
+    capacite_chemin = capacite_chemin ? 2 * capacite_chemin : 4096;
+    chemin = realloc(chemin, capacite_chemin);
+  }
+}
+
+// Ajoute nom (n octets) et éventuellement un '/' au chemin de longueur l
+
+static size_t
+prolonger(size_t l, const char *nom, size_t n, bool barre){
+  etendre_chemin(l + n + 2);
+  memcpy(chemin + l, nom, n);
+  l += n;
+  if (barre)
+    chemin[l++] = '/';
+  chemin[l] = '\0';
+  return l;
+}
+
+static bool
+est_repertoire(int fd, const char *nom, unsigned char type){
+  struct stat st;
+
+  if (type == DT_DIR)
+    return true;
+  if (type != DT_UNKNOWN && type != DT_LNK)
+    return false;
+  return fstatat(fd, nom, &st, 0) == 0 && S_ISDIR(st.st_mode);
+}
+
+//////////////////////////////////////////////
+// VOID PARCOURIR(INT, SIZE_T, CONST CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Développe les composants restants du motif dans le répertoire     //
+// ouvert fd, dont le chemin (terminé par '/', ou vide pour le       //
+// répertoire courant) occupe les longueur premiers octets de chemin //
+///////////////////////////////////////////////////////////////////////
+
+static void parcourir(int fd, size_t longueur, const char *reste);
+
+static void
+descendre(int fd, size_t longueur, const char *nom, const char *reste){
+  int sous;
+
+  if ((sous = openat(fd, nom, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) == -1)
+    return;
+  parcourir(sous, longueur, reste);
+  close(sous);
+}
+
+static void
+parcourir(int fd, size_t longueur, const char *reste){
+  const char *barre, *nom;
+  Repertoire *r;
+  struct stat st;
+  Motif m;
+  size_t n, l, i;
+
+  while (*reste == '/')
+    reste++;
+  if (*reste == '\0'){ // Motif terminé par '/' : seuls les répertoires conviennent
+    ajouter_trouve(arene_copier(&arene_ligne, chemin, longueur));
+    return;
+  }
+  barre = strchr(reste, '/');
+  n = (barre != NULL) ? (size_t) (barre - reste) : strlen(reste);
+
+  if (!contient_jokers(reste, n)){
+    prolonger(longueur, reste, n, false);
+    retirer_protections(chemin + longueur);
+    l = longueur + strlen(chemin + longueur);
+    if (barre == NULL){
+      if (fstatat(fd, chemin + longueur, &st, AT_SYMLINK_NOFOLLOW) == 0)
+	ajouter_trouve(arene_copier(&arene_ligne, chemin, l));
+      return;
+    }
+    nom = arene_copier(&arene_ligne, chemin + longueur, l - longueur);
+    chemin[l++] = '/';
+    descendre(fd, l, nom, barre);
+    return;
+  }
+
+  if ((r = lister(fd)) == NULL)
+    return;
+  compiler(reste, n, &m);
+  r->utilise++;
+  for (i = 0; i < r->nb; i++){
+    nom = r->noms + r->debuts[i];
+    n = (i + 1 < r->nb ? r->debuts[i + 1] : r->taille) - r->debuts[i] - 1;
+    if (!correspond(&m, nom, n))
+      continue;
+    if (barre == NULL){
+      l = prolonger(longueur, nom, n, false);
+      ajouter_trouve(arene_copier(&arene_ligne, chemin, l));
+    }
+    else if (est_repertoire(fd, nom, r->types[i])){
+      l = prolonger(longueur, nom, n, true);
+      descendre(fd, l, nom, barre);
+    }
+  }
+  r->utilise--;
+}
+
+////////////////////////////////
+// VOID TRIER(CHAR**, SIZE_T) //
+//////////////////////////////////////////////////////////////////////
+// Tri rapide en place (qsort() peut allouer un tampon de fusion) : //
+// pivot médian de trois, récursion sur la plus petite partie, tri  //
+// par insertion des petites parties                                //
+//////////////////////////////////////////////////////////////////////
+
+static void
+echanger(char **a, char **b){
+  char *x = *a;
+  *a = *b;
+  *b = x;
+}
+
+static void
+trier(char **t, size_t n){
+  char *pivot;
+  long i, j;
+
+  while (n > 16){
+    if (strcmp(t[(n - 1) / 2], t[0]) < 0)
+      echanger(&t[(n - 1) / 2], &t[0]);
+    if (strcmp(t[n - 1], t[0]) < 0)
+      echanger(&t[n - 1], &t[0]);
+    if (strcmp(t[n - 1], t[(n - 1) / 2]) < 0)
+      echanger(&t[n - 1], &t[(n - 1) / 2]);
+    pivot = t[(n - 1) / 2];
+
+    i = -1;
+    j = n;
+    for (;;){
+      do i++; while (strcmp(t[i], pivot) < 0);
+      do j--; while (strcmp(t[j], pivot) > 0);
+      if (i >= j)
+	break;
+      echanger(&t[i], &t[j]);
+    }
+    // t[0..j] <= pivot <= t[j+1..n-1]
+    if ((size_t) j + 1 < n - j - 1){
+      trier(t, j + 1);
+      t += j + 1;
+      n -= j + 1;
+    }
+    else {
+      trier(t + j + 1, n - j - 1);
+      n = j + 1;
+    }
+  }
+
+  for (i = 1; i < (long) n; i++)
+    for (j = i; j > 0 && strcmp(t[j - 1], t[j]) > 0; j--)
+      echanger(&t[j - 1], &t[j]);
+}
+
+// Ajoute aux arguments les chemins désignés par le mot, ou le mot lui-même
+// s'il n'est pas un motif ou ne désigne rien
+
+static void
+developper(char *mot){
+  size_t debut = nb_trouves;
+  int fd;
+
+  if (contient_jokers(mot, strlen(mot))){
+    fd = open(mot[0] == '/' ? "/" : ".", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd != -1){
+      parcourir(fd, prolonger(0, "/", mot[0] == '/', false), mot);
+      close(fd);
+    }
+  }
+  if (nb_trouves == debut)
+    ajouter_trouve(retirer_protections(arene_copier(&arene_ligne, mot, strlen(mot))));
+  else
+    trier(trouves + debut, nb_trouves - debut);
+}
+
+// Sortie d'un $(...) hors guillemets : découpée aux blancs, chaque mot
+// développé à son tour ; une sortie vide ne donne aucun argument
+
+static void
+decouper(char *mot){
+  char *debut;
+
+  for (;;){
+    while (*mot == ' ' || *mot == '\t' || *mot == '\n')
+      mot++;
+    if (*mot == '\0')
+      return;
+    for (debut = mot; *mot != '\0' && *mot != ' ' && *mot != '\t' && *mot != '\n'; mot++)
+      if (*mot == '\\' && mot[1] != '\0')
+	mot++;
+    developper(arene_copier(&arene_ligne, debut, mot - debut));
+  }
+}
+
+/////////////////////////////////////////
+// CHAR** DEVELOPPER_ARGUMENTS(CHAR**) //
+////////////////////////////////////////////////////////////////////////
+// Renvoie argv, ou s'il contient des motifs une copie développée     //
+// prise dans l'arène. argv lui-même n'est pas modifié : une commande //
+// exécutée plusieurs fois est développée à chaque fois. Un $(...)    //
+// peut développer une autre commande au milieu : les arguments en    //
+// cours sont gardés à partir de base, comme dans une pile.           //
+////////////////////////////////////////////////////////////////////////
+
+char **
+developper_arguments(char **argv){
+  size_t i, base = nb_trouves, n;
+  char **resultat, *mot;
+  bool a_decouper;
+
+  for (i = 0; argv[i] != NULL && !a_developper(argv[i], strlen(argv[i])); i++)
+    ;
+  if (argv[i] == NULL) // Cas courant : rien à développer
+    return argv;
+
+  for (i = 0; argv[i] != NULL; i++){
+    if (!a_developper(argv[i], strlen(argv[i]))){
+      ajouter_trouve(argv[i]);
+      continue;
+    }
+
+    a_decouper = false;
+    mot = substituer_variables(argv[i], &a_decouper);
+    if (a_decouper && !est_affectation(argv[0])) // NOM=$(...) reste un seul mot
+      decouper(mot);
+    else
+      developper(mot);
+  }
+
+  n = nb_trouves - base;
+  resultat = arene_allouer(&arene_ligne, (n + 1) * sizeof(char *));
+  memcpy(resultat, trouves + base, n * sizeof(char *));
+  resultat[n] = NULL;
+  nb_trouves = base;
+  return resultat;
+}
+
+///////////////////////////////////////
+// CHAR* DEVELOPPER_MOT(CONST CHAR*) //
+////////////////////////////////////////////////////////////////////////
+// Nom de fichier d'une redirection : ses variables sont substituées, //
+// mais ce n'est pas un motif                                         //
+////////////////////////////////////////////////////////////////////////
+
+char *
+developper_mot(const char *mot){
+  if (!a_developper(mot, strlen(mot)))
+    return (char *) mot;
+  mot = substituer_variables(mot, NULL);
+  return retirer_protections(arene_copier(&arene_ligne, mot, strlen(mot)));
+}
@@ -0,0 +1,18 @@
+#ifndef _MOTIFS_H
+#define _MOTIFS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Développement des arguments des commandes : variables ($NOM, ${NOM}, $?)
+ * puis motifs (*, ?). Un mot entre guillemets n'est pas un motif (ni, entre
+ * apostrophes, une variable) : l'analyseur lexical en protège les caractères
+ * spéciaux par des '\', retirés au moment du développement.
+ */
+
+char *proteger_motif(const char *mot, size_t longueur, bool variables);
+char **developper_arguments(char **argv);
+char *developper_mot(const char *mot);
+
+#endif
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE // epoll_create1()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "Multiplexeur.h"
+#include "Distant.h"
+
+/*--------------------------------------------------------------------------------------.
+| Multiplexeur des réponses distantes. Un seul epoll surveille les tubes de toutes les  |
+| sessions : chaque réponse est lue dès qu'elle arrive, sans processus ni terminal par  |
+| machine, et les trames (voir Distant.c) sont décodées au fil de l'eau, même coupées   |
+| entre deux lectures.                                                                  |
+|                                                                                       |
+| En mode préfixé, les sorties de chaque machine sont découpées en lignes : seules des  |
+| lignes entières sont écrites, d'un seul write(), et deux machines ne peuvent donc     |
+| jamais mélanger leurs lignes.                                                         |
+`--------------------------------------------------------------------------------------*/
+
+#define NB_EVENEMENTS 64
+#define TAILLE_LECTURE 65536
+
+typedef struct Tampon {
+  char *donnees;
+  size_t longueur, capacite;
+} Tampon;
+
+typedef struct Etat {
+  Voie *voie;
+  char entete[32];      // En-tête de trame en cours de lecture
+  int lg_entete;
+  char type;            // Trame de données en cours ('O' ou 'E'), 0 sinon
+  size_t reste;         // Octets de cette trame pas encore reçus
+  Tampon lignes[2];     // Fin de ligne incomplète de chaque sortie
+  Tampon capture;       // Sorties gardées pour le mode MUX_ECHECS
+  int fichiers[2];      // Sorties du mode MUX_FICHIERS
+  bool fini;
+} Etat;
+
+static mode_mux mode_courant;
+static Tampon sortie;   // Lignes préfixées prêtes à être écrites
+static char lecture[TAILLE_LECTURE];
+
+static void
+ajouter(Tampon *t, const char *p, size_t n){
+  if (t->longueur + n > t->capacite){
+    t->capacite = 2 * (t->longueur + n);
+    if ((t->donnees = realloc(t->donnees, t->capacite)) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(t->donnees + t->longueur, p, n);
+  t->longueur += n;
+}
+
+////////////////////////////////////////////////////
+// VOID EMETTRE_LIGNES(ETAT*, INT, CHAR*, SIZE_T) //
+//////////////////////////////////////////////////////////////////////////
+// Ajoute n octets de la sortie s (0 : standard, 1 : erreur) à sa ligne //
+// en cours, puis émet d'un bloc toutes les lignes complètes, chacune   //
+// préfixée par la machine                                              //
+//////////////////////////////////////////////////////////////////////////
+
+static void
+emettre_lignes(Etat *e, int s, const char *p, size_t n){
+  Tampon *l = &e->lignes[s];
+  char *debut, *fin, *limite;
+
+  ajouter(l, p, n);
+  if ((limite = memrchr(l->donnees, '\n', l->longueur)) == NULL)
+    return;
+  limite++;
+
+  sortie.longueur = 0;
+  for (debut = l->donnees; debut < limite; debut = fin + 1){
+    fin = memchr(debut, '\n', limite - debut);
+    ajouter(&sortie, e->voie->hote, strlen(e->voie->hote));
+    ajouter(&sortie, ": ", 2);
+    ajouter(&sortie, debut, fin + 1 - debut);
+  }
+
+  if (mode_courant == MUX_ECHECS)
+    ajouter(&e->capture, sortie.donnees, sortie.longueur);
+  else
+    ecrire_tout(s == 0 ? STDOUT_FILENO : STDERR_FILENO, sortie.donnees, sortie.longueur);
+
+  l->longueur -= limite - l->donnees;
+  memmove(l->donnees, limite, l->longueur);
+}
+
+//////////////////////////////////////////////////
+// VOID RECUS(ETAT*, CHAR, CONST CHAR*, SIZE_T) //
+//////////////////////////////////////////////////////////////
+// Oriente des données reçues selon le mode de présentation //
+//////////////////////////////////////////////////////////////
+
+static void
+recus(Etat *e, char type, const char *p, size_t n){
+  int s = type == 'E';
+
+  switch (mode_courant) {
+  case MUX_DIRECT :
+    ecrire_tout(s == 0 ? STDOUT_FILENO : STDERR_FILENO, p, n);
+    break;
+  case MUX_FICHIERS :
+    if (e->fichiers[s] != -1)
+      ecrire_tout(e->fichiers[s], p, n);
+    break;
+  default :
+    emettre_lignes(e, s, p, n);
+  }
+}
+
+//////////////////////////////////////////////
+// INT RECEVOIR(ETAT*, CONST CHAR*, SIZE_T) //
+///////////////////////////////////////////////////////////////////////
+// Décode n octets lus sur le tube d'une session. Renvoie 1 quand la //
+// trame S (fin de la commande) a été reçue, -1 sur une trame mal    //
+// formée, 0 s'il faut attendre la suite.                            //
+///////////////////////////////////////////////////////////////////////
+
+static int
+recevoir(Etat *e, const char *p, size_t n){
+  size_t k;
+
+  while (n > 0){
+    if (e->type == 0){
+      e->entete[e->lg_entete++] = *p++;
+      n--;
+      if (e->entete[e->lg_entete - 1] != '\n'){
+	if (e->lg_entete == sizeof(e->entete) - 1)
+	  return -1;
+	continue;
+      }
+      e->entete[e->lg_entete] = '\0';
+      if (e->lg_entete < 4 || e->entete[1] != ' ')
+	return -1;
+      e->lg_entete = 0;
+      e->reste = strtoul(e->entete + 2, NULL, 10);
+      if (e->entete[0] == 'S'){
+	e->voie->statut = (int) e->reste;
+	return 1;
+      }
+      if (e->entete[0] != 'O' && e->entete[0] != 'E')
+	return -1;
+      if (e->reste > 0)
+	e->type = e->entete[0];
+      continue;
+    }
+
+    k = n < e->reste ? n : e->reste;
+    recus(e, e->type, p, k);
+    p += k;
+    n -= k;
+    if ((e->reste -= k) == 0)
+      e->type = 0;
+  }
+  return 0;
+}
+
+//////////////////////////////////////////////
+// VOID OUVRIR_FICHIERS(ETAT*, CONST CHAR*) //
+//////////////////////////////////////////////
+
+static void
+ouvrir_fichiers(Etat *e, const char *repertoire){
+  static const char *suffixes[2] = {"out", "err"};
+  char chemin[4096];
+  int s;
+
+  for (s = 0; s < 2; s++){
+    snprintf(chemin, sizeof(chemin), "%s/%s.%s", repertoire, e->voie->hote, suffixes[s]);
+    if ((e->fichiers[s] = open(chemin, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666)) == -1)
+      fprintf(stderr, "%s : %s.\n", chemin, strerror(errno));
+  }
+}
+
+//////////////////////////
+// VOID TERMINER(ETAT*) //
+///////////////////////////////////////////////////////////////////////
+// Fin des réponses d'une session : une dernière ligne sans '\n' est //
+// complétée, les fichiers sont fermés                               //
+///////////////////////////////////////////////////////////////////////
+
+static void
+terminer(Etat *e){
+  int s;
+
+  for (s = 0; s < 2; s++){
+    if (e->lignes[s].longueur > 0)
+      emettre_lignes(e, s, "\n", 1);
+    free(e->lignes[s].donnees);
+    if (e->fichiers[s] != -1)
+      close(e->fichiers[s]);
+  }
+  e->fini = true;
+  if (e->voie->perdue)
+    e->voie->statut = 255;
+}
+
+///////////////////////////////////////
+// VOID RAPPORTER_ECHECS(ETAT*, INT) //
+//////////////////////////////////////////////////////////////////////////
+// Vue compacte : une ligne par machine en échec suivie de ce qu'elle   //
+// a écrit, puis le décompte. Les machines qui ont réussi sont muettes. //
+//////////////////////////////////////////////////////////////////////////
+
+static void
+rapporter_echecs(Etat *etats, int n){
+  int i, echecs = 0;
+
+  for (i = 0; i < n; i++){
+    if (etats[i].voie->statut != 0){
+      echecs++;
+      fprintf(stdout, "%s : statut %d%s\n", etats[i].voie->hote, etats[i].voie->statut,
+	      etats[i].voie->perdue ? " (session perdue)" : "");
+      fwrite(etats[i].capture.donnees, 1, etats[i].capture.longueur, stdout);
+    }
+    free(etats[i].capture.donnees);
+  }
+  fprintf(stdout, "%d machine(s) en échec sur %d.\n", echecs, n);
+  fflush(stdout);
+}
+
+////////////////////////////////////////////////////////
+// INT MULTIPLEXER(VOIE*, INT, MODE_MUX, CONST CHAR*) //
+//////////////////////////////////////////////////////////////////////
+// Attend la fin de la commande envoyée à chacune des n sessions en //
+// présentant leurs sorties selon mode (repertoire ne sert qu'à     //
+// MUX_FICHIERS). Le statut de chaque voie est rempli ; renvoie le  //
+// plus grand.                                                      //
+//////////////////////////////////////////////////////////////////////
+
+int
+multiplexer(Voie *voies, int n, mode_mux mode, const char *repertoire){
+  struct epoll_event ev, evenements[NB_EVENEMENTS];
+  Etat *etats, *e;
+  int epfd, actives = 0, pire = 0, i, k, r;
+  ssize_t lu;
+
+  mode_courant = mode;
+  if ((etats = calloc(n, sizeof(Etat))) == NULL){
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1)
+    perror("epoll_create1");
+  if (mode == MUX_FICHIERS)
+    mkdir(repertoire, 0777);
+
+  for (i = 0; i < n; i++){
+    e = &etats[i];
+    e->voie = &voies[i];
+    e->fichiers[0] = e->fichiers[1] = -1;
+    voies[i].statut = 255;
+    voies[i].perdue = false;
+    if (mode == MUX_FICHIERS)
+      ouvrir_fichiers(e, repertoire);
+
+    ev.events = EPOLLIN;
+    ev.data.ptr = e;
+    if (epfd == -1 || epoll_ctl(epfd, EPOLL_CTL_ADD, voies[i].fd, &ev) == -1){
+      voies[i].perdue = true;
+      terminer(e);
+      continue;
+    }
+    actives++;
+  }
+
+  while (actives > 0){
+    if ((k = epoll_wait(epfd, evenements, NB_EVENEMENTS, -1)) == -1){
+      if (errno == EINTR)
+	continue;
+      perror("epoll_wait");
+      break;
+    }
+    for (i = 0; i < k; i++){
+      e = evenements[i].data.ptr;
+      if ((lu = read(e->voie->fd, lecture, sizeof(lecture))) == -1 && errno == EINTR)
+	continue;
+      r = lu > 0 ? recevoir(e, lecture, lu) : -1;
+      if (r == 0)
+	continue;
+      e->voie->perdue = r == -1;
+      epoll_ctl(epfd, EPOLL_CTL_DEL, e->voie->fd, NULL);
+      terminer(e);
+      actives--;
+    }
+  }
+
+  // Sessions encore attendues si epoll_wait a échoué
+  for (i = 0; i < n; i++)
+    if (!etats[i].fini){
+      voies[i].perdue = true;
+      terminer(&etats[i]);
+    }
+
+  if (epfd != -1)
+    close(epfd);
+  if (mode == MUX_ECHECS)
+    rapporter_echecs(etats, n);
+
+  for (i = 0; i < n; i++)
+    if (voies[i].statut > pire)
+      pire = voies[i].statut;
+  free(etats);
+  return pire;
+}
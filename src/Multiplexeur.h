@@ -0,0 +1,27 @@
+#ifndef _MULTIPLEXEUR_H
+#define _MULTIPLEXEUR_H
+
+#include <stdbool.h>
+
+/*
+ * Réception simultanée des réponses de plusieurs sessions distantes (voir
+ * Distant.c), et présentation de leurs sorties selon le mode choisi.
+ */
+
+typedef enum {
+  MUX_DIRECT,     // Une seule session : sorties recopiées telles quelles
+  MUX_PREFIXE,    // Lignes entières, préfixées par la machine
+  MUX_FICHIERS,   // <répertoire>/<machine>.out et <machine>.err
+  MUX_ECHECS      // Seulement les machines en échec, à la fin
+} mode_mux;
+
+typedef struct Voie {
+  const char *hote;
+  int fd;         // Réponses de la session
+  int statut;     // Statut de la commande (255 si la session est perdue)
+  bool perdue;    // Session morte ou réponse mal formée
+} Voie;
+
+int multiplexer(Voie *voies, int n, mode_mux mode, const char *repertoire);
+
+#endif
@@ -0,0 +1,454 @@
+#define _GNU_SOURCE // epoll_create1(), pipe2(), syscall()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "Parallele.h"
+#include "Arene.h"
+#include "Commandes_Internes.h"
+#include "Distant.h"
+#include "Evaluation.h"
+#include "Lancement.h"
+#include "Taches.h"
+
+/*--------------------------------------------------------------------------------------.
+| Commande interne parallel. Chaque mot (ou chaque ligne de l'entrée standard) donne    |
+| une tâche ; au plus max tâches tournent à la fois. Une commande externe est lancée    |
+| par posix_spawn (voir Lancement.c), sans forker le shell ; une commande interne, ou   |
+| une ligne de commande complète quand aucune commande n'est donnée, est exécutée dans  |
+| un fils du shell.                                                                     |
+|                                                                                       |
+| Sorties : chaque tâche écrit dans deux tubes à elle, lus par un seul epoll. Ce        |
+| qu'elle écrit est gardé jusqu'à sa fin, puis écrit d'un bloc (sortie standard, puis   |
+| erreur) : deux tâches ne mélangent jamais leurs sorties. En mode ordonné, les         |
+| sorties suivent l'ordre des entrées ; la plus ancienne tâche pas encore affichée      |
+| écrit au fil de l'eau, les suivantes attendent leur tour.                             |
+|                                                                                       |
+| Fin d'une tâche : un pidfd par tâche, dans le même epoll, signale la fin du           |
+| processus sans passer par SIGCHLD (bloqué pendant l'exécution d'une ligne). La tâche  |
+| est finie quand son processus est récolté et ses deux tubes fermés.                   |
+`--------------------------------------------------------------------------------------*/
+
+#define NB_EVENEMENTS 64
+#define TAILLE_LECTURE 65536
+
+typedef struct Tampon {
+  char *donnees;
+  size_t longueur, capacite;
+} Tampon;
+
+typedef struct Travail {
+  pid_t pid;            // 0 une fois récolté
+  int fds[3];           // Sortie standard, erreur (tubes), pidfd ; -1 une fois fermés
+  Tampon sorties[2];    // Sorties pas encore écrites
+  int statut;
+  bool fini;
+  bool direct;          // Mode ordonné : plus ancienne tâche, sorties écrites au fil de l'eau
+  bool affiche;         // Sorties écrites, case à rendre
+} Travail;
+
+typedef struct Entree {
+  char **mots;          // Mots donnés après :::, ou NULL : lignes de l'entrée standard
+  Tampon lu;            // Entrée standard lue, pas encore découpée
+  size_t debut;         // Début de la prochaine ligne dans lu
+  bool finie;
+} Entree;
+
+static Travail *travaux;        // Tâches numérotées de premier à premier + nb - 1
+static int nb, capacite, premier;
+static int epoll, en_cours, echecs;
+static bool ordonne, interrompu;
+static char lecture[TAILLE_LECTURE];
+
+static void
+ajouter(Tampon *t, const char *p, size_t n){
+  if (t->longueur + n > t->capacite){
+    t->capacite = 2 * (t->longueur + n);
+    if ((t->donnees = realloc(t->donnees, t->capacite)) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  memcpy(t->donnees + t->longueur, p, n);
+  t->longueur += n;
+}
+
+////////////////////////////////////
+// CHAR* ENTREE_SUIVANTE(ENTREE*) //
+///////////////////////////////////////////////////////////////////////
+// Mot suivant, ou ligne non vide suivante de l'entrée standard, lue //
+// au fur et à mesure. Valable jusqu'à l'appel suivant ; NULL à la   //
+// fin de l'entrée.                                                  //
+///////////////////////////////////////////////////////////////////////
+
+static char *
+entree_suivante(Entree *en){
+  Tampon *t = &en->lu;
+  char *ligne, *fin;
+  ssize_t n;
+
+  if (en->mots != NULL)
+    return *en->mots != NULL ? *en->mots++ : NULL;
+
+  for (;;){
+    ligne = t->donnees + en->debut;
+    if (en->debut < t->longueur && (fin = memchr(ligne, '\n', t->longueur - en->debut)) != NULL){
+      *fin = '\0';
+      en->debut = fin + 1 - t->donnees;
+      if (*ligne != '\0')
+	return ligne;
+      continue;
+    }
+
+    if (en->finie){ // Dernière ligne, sans '\n'
+      if (en->debut == t->longueur)
+	return NULL;
+      ajouter(t, "", 1);
+      ligne = t->donnees + en->debut;
+      en->debut = t->longueur;
+      return ligne;
+    }
+
+    // Début de ligne incomplète ramené en tête, puis lecture de la suite
+    t->longueur -= en->debut;
+    memmove(t->donnees, t->donnees + en->debut, t->longueur);
+    en->debut = 0;
+    if ((n = read(STDIN_FILENO, lecture, sizeof(lecture))) == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      en->finie = true;
+    else
+      ajouter(t, lecture, n);
+  }
+}
+
+// Remplace chaque {} de modele par mot
+
+static char *
+remplacer_accolades(const char *modele, const char *mot){
+  size_t lg = strlen(mot), n = 0;
+  const char *p, *q;
+  char *resultat, *r;
+
+  for (p = modele; (p = strstr(p, "{}")) != NULL; p += 2)
+    n++;
+  r = resultat = arene_allouer(&arene_ligne, strlen(modele) + n * lg - 2 * n + 1);
+  for (p = modele; (q = strstr(p, "{}")) != NULL; p = q + 2){
+    memcpy(r, p, q - p);
+    r += q - p;
+    memcpy(r, mot, lg);
+    r += lg;
+  }
+  strcpy(r, p);
+  return resultat;
+}
+
+////////////////////////////////////////////////
+// CHAR** CONSTRUIRE_ARGUMENTS(CHAR**, CHAR*) //
+///////////////////////////////////////////////////////////////////
+// Arguments de la tâche : mot prend la place de chaque {} de la //
+// commande, ou s'ajoute à la fin s'il n'y en a aucun            //
+///////////////////////////////////////////////////////////////////
+
+static char **
+construire_arguments(char **commande, char *mot){
+  bool remplace = false;
+  char **argv;
+  int n, i;
+
+  for (n = 0; commande[n] != NULL; n++)
+    ;
+  argv = arene_allouer(&arene_ligne, (n + 2) * sizeof(char *));
+  for (i = 0; i < n; i++)
+    if (strstr(commande[i], "{}") != NULL){
+      argv[i] = remplacer_accolades(commande[i], mot);
+      remplace = true;
+    }
+    else
+      argv[i] = commande[i];
+  if (!remplace)
+    argv[n++] = mot;
+  argv[n] = NULL;
+  return argv;
+}
+
+static void
+ecrire_sorties(Travail *t){
+  for (int k = 0; k < 2; k++){
+    ecrire_tout(k == 0 ? STDOUT_FILENO : STDERR_FILENO, t->sorties[k].donnees, t->sorties[k].longueur);
+    t->sorties[k].longueur = 0;
+  }
+}
+
+static void
+fermer(Travail *t, int k){
+  epoll_ctl(epoll, EPOLL_CTL_DEL, t->fds[k], NULL);
+  close(t->fds[k]);
+  t->fds[k] = -1;
+}
+
+static void
+surveiller(int numero, int k){
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.u64 = (uint64_t) numero * 3 + k;
+  epoll_ctl(epoll, EPOLL_CTL_ADD, travaux[numero - premier].fds[k], &ev);
+}
+
+/////////////////////////////////
+// VOID VERIFIER_FIN(TRAVAIL*) //
+/////////////////////////////////////////////////////////////////////
+// La tâche est finie quand ses tubes sont fermés et son processus //
+// récolté (sans pidfd, il est attendu une fois les tubes fermés). //
+// Hors mode ordonné, ses sorties sont alors écrites.              //
+/////////////////////////////////////////////////////////////////////
+
+static void
+verifier_fin(Travail *t){
+  if (t->fini || t->fds[0] != -1 || t->fds[1] != -1 || t->fds[2] != -1)
+    return;
+  if (t->pid > 0){
+    t->statut = attendre_commande(t->pid);
+    t->pid = 0;
+  }
+  t->fini = true;
+  en_cours--;
+  if (t->statut != 0)
+    echecs++;
+  if (t->statut == 128 + SIGINT)
+    interrompu = true; // Ctrl-C : plus de nouvelle tâche
+  if (!ordonne || t->direct){
+    ecrire_sorties(t);
+    t->affiche = true;
+  }
+}
+
+////////////////////////////////////////////////////////
+// VOID EXECUTER_TRAVAIL(CHAR**, CHAR*, REDIRECTION*) //
+//////////////////////////////////////////////////////////////////////
+// Dans le fils du shell : la commande interne argv, ou la ligne de //
+// commande complète ligne quand argv est NULL. Ne revient pas.     //
+//////////////////////////////////////////////////////////////////////
+
+static void
+executer_travail(char **argv, char *ligne, Redirection *r){
+  Analyseur analyseur;
+  size_t n = strlen(ligne);
+  char *texte;
+
+  redirections_en_cours = NULL;
+  if (appliquer_redirections(r) == -1)
+    exit(1);
+  if (argv != NULL){
+    executer_interne(ConstruireNoeud(SIMPLE, NULL, NULL, argv), &status);
+    exit(status);
+  }
+  texte = arene_allouer(&arene_ligne, n + 1);
+  memcpy(texte, ligne, n);
+  texte[n] = '\n'; // L'analyseur attend une ligne complète
+  initialiser_analyseur(&analyseur);
+  if (analyser_ligne(&analyseur, texte, n + 1) != 0 || analyseur.expression == NULL)
+    exit(2);
+  status = 0;
+  executer_et_terminer(analyseur.expression);
+}
+
+////////////////////////////////////////
+// VOID LANCER_TRAVAIL(CHAR**, CHAR*) //
+//////////////////////////////////////////////////////////////////////
+// Lance la tâche suivante pour mot, entrée standard sur /dev/null, //
+// sorties dans ses deux tubes                                      //
+//////////////////////////////////////////////////////////////////////
+
+static void
+lancer_travail(char **commande, char *mot){
+  Marque m = arene_marquer(&arene_ligne);
+  int sortie[2], erreur[2], numero;
+  char **argv = NULL;
+  Redirection r[3];
+  Travail *t;
+
+  if (nb == capacite){
+    capacite = capacite ? 2 * capacite : 64;
+    if ((travaux = realloc(travaux, capacite * sizeof(Travail))) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  numero = premier + nb;
+  t = &travaux[nb++];
+  *t = (Travail){0, {-1, -1, -1}, {{NULL, 0, 0}, {NULL, 0, 0}}, 0, false, false, false};
+  en_cours++;
+
+  if (pipe2(sortie, O_CLOEXEC) == -1){
+    perror("pipe");
+    t->statut = 126;
+    verifier_fin(t);
+    return;
+  }
+  if (pipe2(erreur, O_CLOEXEC) == -1){
+    perror("pipe");
+    close(sortie[0]);
+    close(sortie[1]);
+    t->statut = 126;
+    verifier_fin(t);
+    return;
+  }
+  r[0] = (Redirection){.type = REDIRECTION_I, .fichier = "/dev/null", .fd = -1, .cible = -1};
+  r[1] = (Redirection){.type = PIPE, .fd = sortie[1], .cible = STDOUT_FILENO, .englobante = &r[0]};
+  r[2] = (Redirection){.type = PIPE, .fd = erreur[1], .cible = STDERR_FILENO, .englobante = &r[1]};
+
+  if (commande != NULL)
+    argv = construire_arguments(commande, mot);
+  if (argv != NULL && !est_interne(argv))
+    t->pid = lancer_commande(argv, &r[2], -1);
+  else if ((t->pid = forker_shell(-1, false)) == 0)
+    executer_travail(argv, mot, &r[2]);
+  arene_revenir(&arene_ligne, m);
+
+  close(sortie[1]);
+  close(erreur[1]);
+  if (t->pid == -1){
+    close(sortie[0]);
+    close(erreur[0]);
+    t->pid = 0;
+    t->statut = 127;
+    verifier_fin(t);
+    return;
+  }
+
+  t->fds[0] = sortie[0];
+  t->fds[1] = erreur[0];
+  surveiller(numero, 0);
+  surveiller(numero, 1);
+#ifdef SYS_pidfd_open
+  if ((t->fds[2] = syscall(SYS_pidfd_open, t->pid, 0)) != -1)
+    surveiller(numero, 2);
+#endif
+}
+
+////////////////////////////////
+// VOID TRAITER(EPOLL_EVENT*) //
+///////////////////////////////////////////////////////////////////////
+// Sortie d'une tâche à lire (gardée, ou écrite si elle est directe) //
+// ou fin de son processus                                           //
+///////////////////////////////////////////////////////////////////////
+
+static void
+traiter(struct epoll_event *ev){
+  Travail *t = &travaux[ev->data.u64 / 3 - premier];
+  int k = ev->data.u64 % 3;
+  ssize_t n;
+
+  if (t->fds[k] == -1)
+    return;
+  if (k == 2){
+    t->statut = attendre_commande(t->pid);
+    t->pid = 0;
+    fermer(t, 2);
+  }
+  else if ((n = read(t->fds[k], lecture, sizeof(lecture))) > 0){
+    if (t->direct)
+      ecrire_tout(k == 0 ? STDOUT_FILENO : STDERR_FILENO, lecture, n);
+    else
+      ajouter(&t->sorties[k], lecture, n);
+  }
+  else if (n == 0 || errno != EINTR)
+    fermer(t, k);
+  verifier_fin(t);
+}
+
+////////////////////
+// VOID AVANCER() //
+//////////////////////////////////////////////////////////////////////
+// Rend les cases des tâches affichées en tête. En mode ordonné, la //
+// nouvelle tête écrit ce qu'elle a gardé et devient directe ; déjà //
+// finie, elle est affichée à son tour.                             //
+//////////////////////////////////////////////////////////////////////
+
+static void
+avancer(void){
+  int k;
+
+  for (;;){
+    for (k = 0; k < nb && travaux[k].affiche; k++){
+      free(travaux[k].sorties[0].donnees);
+      free(travaux[k].sorties[1].donnees);
+    }
+    if (k > 0){
+      nb -= k;
+      premier += k;
+      memmove(travaux, travaux + k, nb * sizeof(Travail));
+    }
+    if (!ordonne || nb == 0 || travaux[0].direct)
+      return;
+    ecrire_sorties(&travaux[0]);
+    travaux[0].direct = true;
+    if (!travaux[0].fini)
+      return;
+    travaux[0].affiche = true;
+  }
+}
+
+///////////////////////////////////////////////////////
+// INT EXECUTER_PARALLELE(CHAR**, CHAR**, INT, BOOL) //
+///////////////////////////////////////////////////////////////////////
+// Exécute commande (ou chaque ligne, si commande est NULL) pour     //
+// chacun des mots (ou chaque ligne de l'entrée standard si mots est //
+// NULL), au plus max à la fois. Renvoie 0 si toutes les tâches ont  //
+// réussi, sinon leur nombre (101 au-delà de 100), comme GNU         //
+// parallel ; 128 + SIGINT après un Ctrl-C.                          //
+///////////////////////////////////////////////////////////////////////
+
+int
+executer_parallele(char **commande, char **mots, int max, bool ordre){
+  struct epoll_event evenements[NB_EVENEMENTS];
+  Entree entree = {mots, {NULL, 0, 0}, 0, false};
+  bool epuisee = false;
+  char *mot;
+  int n, i;
+
+  if ((epoll = epoll_create1(EPOLL_CLOEXEC)) == -1){
+    perror("epoll_create1");
+    return 255;
+  }
+  nb = premier = en_cours = echecs = 0;
+  ordonne = ordre;
+  interrompu = false;
+  fflush(stdout); // Ce que le shell a déjà écrit passe avant
+
+  for (;;){
+    while (en_cours < max && !interrompu && !epuisee)
+      if ((mot = entree_suivante(&entree)) != NULL)
+	lancer_travail(commande, mot);
+      else
+	epuisee = true;
+    avancer();
+    if (en_cours == 0)
+      break;
+    if ((n = epoll_wait(epoll, evenements, NB_EVENEMENTS, -1)) == -1){
+      if (errno == EINTR)
+	continue;
+      perror("epoll_wait");
+      break;
+    }
+    for (i = 0; i < n; i++)
+      traiter(&evenements[i]);
+  }
+
+  avancer();
+  close(epoll);
+  free(entree.lu.donnees);
+  if (interrompu)
+    return 128 + SIGINT;
+  return echecs > 100 ? 101 : echecs;
+}
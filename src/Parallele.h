@@ -0,0 +1,13 @@
+#ifndef _PARALLELE_H
+#define _PARALLELE_H
+
+#include <stdbool.h>
+
+/*
+ * Commande interne parallel : une commande par mot (ou par ligne de l'entrée
+ * standard), au plus max à la fois, sorties gardées tâche par tâche.
+ */
+
+int executer_parallele(char **commande, char **mots, int max, bool ordre);
+
+#endif
@@ -0,0 +1,151 @@
+#define _GNU_SOURCE // pipe2() et F_SETPIPE_SZ
+
+#include <fcntl.h>
+#include <stdio.h>
+
+#include "Pipeline.h"
+#include "Arene.h"
+#include "Evaluation.h"
+#include "Lancement.h"
+#include "Mesures.h"
+#include "Taches.h"
+
+/*--------------------------------------------------------------------------------------.
+| Une chaîne de pipes a | b | c est analysée en ((a | b) | c). Plutôt que d'exécuter    |
+| la partie gauche jusqu'au bout avant de lancer la droite (ce qui bloque dès que la    |
+| gauche écrit plus que ce que peut contenir le tube), on aplatit la chaîne en N        |
+| étages et on les lance tous en même temps, dans un même groupe de processus. Le       |
+| shell ne garde aucune extrémité de tube ouverte et attend tous les étages à la fin.   |
+| Les étages qui sont des commandes externes (éventuellement redirigées) sont lancés    |
+| par posix_spawn, les tubes devenant de simples redirections ; les autres sont forkés. |
+|                                                                                       |
+| La variable d'environnement TERMINA_PIPE_SZ permet de fixer la taille (en octets)     |
+| des tampons des tubes (F_SETPIPE_SZ).                                                 |
+`--------------------------------------------------------------------------------------*/
+
+/////////////////////////////////
+// VOID DIMENSIONNER_PIPE(INT) //
+/////////////////////////////////////////////////////////////////////
+// Applique TERMINA_PIPE_SZ au tube fd, si elle est définie (un    //
+// échec, par exemple au-delà de /proc/sys/fs/pipe-max-size, n'est //
+// pas grave : le tube garde sa taille par défaut)                 //
+/////////////////////////////////////////////////////////////////////
+
+static void
+dimensionner_pipe(int fd){
+#ifdef F_SETPIPE_SZ
+  static int taille = -1;
+
+  if (taille == -1){
+    char *s = getenv("TERMINA_PIPE_SZ");
+    taille = (s != NULL) ? atoi(s) : 0;
+  }
+  if (taille > 0)
+    fcntl(fd, F_SETPIPE_SZ, taille);
+#endif
+}
+
+/////////////////////////////////////////////////////////////////////
+// PID_T FORKER_ETAGE(EXPRESSION*, REDIRECTION*, PID_T, BOOL, INT) //
+////////////////////////////////////////////////////////////////////////
+// Exécute un étage quelconque dans un fils du shell, qui applique    //
+// lui-même les redirections du tube avant d'évaluer l'étage. Le fils //
+// ne fera peut-être pas d'exec : il ferme lui-même lecture,          //
+// l'extrémité de son tube de sortie réservée à l'étage suivant, sans //
+// quoi il ne verrait jamais ce dernier se terminer (EPIPE).          //
+////////////////////////////////////////////////////////////////////////
+
+static pid_t
+forker_etage(Expression * e, Redirection * r, pid_t pgid, bool terminal, int lecture){
+  pid_t pid = forker_shell(pgid, terminal);
+
+  if (pid == 0){
+    if (lecture != -1)
+      close(lecture);
+    redirections_en_cours = r;
+    executer_et_terminer(e);
+  }
+  return pid;
+}
+
+//////////////////////////////////////////////
+// INT EXECUTER_PIPELINE(EXPRESSION*, BOOL) //
+/////////////////////////////////////////////////////////////////////////
+// Lance tous les étages de la chaîne de pipes e. Au premier plan, ils //
+// sont tous attendus et le statut est celui du dernier étage ; en     //
+// arrière-plan, la chaîne devient une tâche de la table des tâches.   //
+/////////////////////////////////////////////////////////////////////////
+
+int
+executer_pipeline(Expression * e, bool arriere_plan){
+  Expression *p, **etages;
+  Redirection tubes[2], *r;
+  pid_t *pids, pgid;
+  int n = 1, i;
+  int fd[2], entree = -1;
+  bool terminal = controle_des_taches && !arriere_plan;
+
+  // Aplatissement de la chaîne : les étages sont les fils droits le long
+  // de la branche gauche, plus la feuille la plus à gauche
+  for (p = e; p->type == PIPE; p = p->gauche)
+    n++;
+  etages = arene_allouer(&arene_ligne, n * sizeof(Expression *));
+  pids = arene_allouer(&arene_ligne, n * sizeof(pid_t));
+  i = n - 1;
+  for (p = e; p->type == PIPE; p = p->gauche)
+    etages[i--] = p->droite;
+  etages[0] = p;
+
+  // Avec le contrôle des tâches, la chaîne a son propre groupe, créé par
+  // le premier étage ; sinon elle reste dans celui du shell
+  pgid = controle_des_taches ? 0 : -1;
+
+  for (i = 0; i < n; i++){
+    fd[0] = fd[1] = -1;
+    if (i < n - 1){
+      if (pipe2(fd, O_CLOEXEC) == -1){
+	perror("pipe");
+	break;
+      }
+      dimensionner_pipe(fd[1]);
+    }
+
+    // Les tubes se posent par-dessus les redirections qui englobent la chaîne
+    r = redirections_en_cours;
+    if (entree != -1){
+      tubes[0] = (Redirection){.type = PIPE, .fd = entree, .cible = STDIN_FILENO, .englobante = r};
+      r = &tubes[0];
+    }
+    if (fd[1] != -1){
+      tubes[1] = (Redirection){.type = PIPE, .fd = fd[1], .cible = STDOUT_FILENO, .englobante = r};
+      r = &tubes[1];
+    }
+
+    if (est_commande_externe(etages[i]))
+      pids[i] = lancer_expression(etages[i], r, pgid);
+    else
+      pids[i] = forker_etage(etages[i], r, pgid, terminal, fd[0]);
+    if (!arriere_plan)
+      suivre_processus(pids[i], etages[i]);
+
+    // Dans le père : on ne garde que l'entrée de l'étage suivant
+    if (pids[i] != -1 && pgid == 0)
+      pgid = pids[i];
+    if (entree != -1)
+      close(entree);
+    if (fd[1] != -1)
+      close(fd[1]);
+    entree = fd[0];
+  }
+
+  if (entree != -1) // Chaîne interrompue par une erreur
+    close(entree);
+  for (int j = i; j < n; j++)
+    pids[j] = -1;
+
+  if (arriere_plan){
+    lancer_tache(pids, n, pgid, e);
+    return status = 0;
+  }
+  return status = attendre_premier_plan(pids, n, pgid, e);
+}
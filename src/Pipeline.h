@@ -0,0 +1,10 @@
+#ifndef _PIPELINE_H
+#define _PIPELINE_H
+
+#include <stdbool.h>
+
+#include "Shell.h"
+
+int executer_pipeline(Expression * e, bool arriere_plan);
+
+#endif
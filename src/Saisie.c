@@ -0,0 +1,103 @@
+#include <dlfcn.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Saisie.h"
+
+/*--------------------------------------------------------------------------------------.
+| Chargement paresseux de readline. Lier -lreadline fait charger et reloger la          |
+| bibliothèque (et libtinfo) par l'éditeur de liens dynamique à chaque lancement, même  |
+| pour exécuter "Termina -c ..." lancé par un autre programme. Ici, elle n'est ouverte  |
+| (dlopen) qu'au premier besoin : session interactive, commande history, démon.         |
+|                                                                                       |
+| Compilé avec -DSAISIE_STATIQUE (cible Termina_statique), le module prend simplement   |
+| les adresses de la readline liée avec le reste de l'exécutable.                       |
+`--------------------------------------------------------------------------------------*/
+
+#ifndef BIBLIOTHEQUE_READLINE
+#define BIBLIOTHEQUE_READLINE "libreadline.so.8"
+#endif
+
+Saisie saisie;
+
+static int etat = 0; // 0 : pas encore chargée, 1 : chargée, -1 : échec
+
+#ifdef SAISIE_STATIQUE
+
+#define FONCTION(nom) (saisie.nom = nom)
+#define VARIABLE(nom) (saisie.nom = &nom)
+
+static bool
+ouvrir(void){
+  return true;
+}
+
+#else
+
+#define FONCTION(nom) (saisie.nom = symbole(#nom))
+#define VARIABLE(nom) (saisie.nom = symbole(#nom))
+
+static void *bibliotheque = NULL;
+static bool manquant = false;
+
+static void *
+symbole(const char *nom){
+  void *p = dlsym(bibliotheque, nom);
+
+  if (p == NULL){
+    fprintf(stderr, "%s : %s.\n", BIBLIOTHEQUE_READLINE, dlerror());
+    manquant = true;
+  }
+  return p;
+}
+
+static bool
+ouvrir(void){
+  if ((bibliotheque = dlopen(BIBLIOTHEQUE_READLINE, RTLD_LAZY)) == NULL){
+    fprintf(stderr, "%s.\n", dlerror());
+    return false;
+  }
+  return true;
+}
+
+#endif
+
+///////////////////////////////
+// BOOL CHARGER_SAISIE(VOID) //
+/////////////////////////////////////////////////////////////////////
+// Charge readline au premier appel. Vrai si saisie est utilisable //
+/////////////////////////////////////////////////////////////////////
+
+bool
+charger_saisie(void){
+  if (etat != 0)
+    return etat > 0;
+
+  etat = -1;
+  if (!ouvrir())
+    return false;
+
+  FONCTION(readline);
+  FONCTION(using_history);
+  FONCTION(add_history);
+  FONCTION(clear_history);
+  FONCTION(where_history);
+  FONCTION(history_get);
+  FONCTION(rl_add_defun);
+  FONCTION(rl_ding);
+  FONCTION(rl_replace_line);
+  FONCTION(rl_completion_matches);
+  VARIABLE(rl_line_buffer);
+  VARIABLE(rl_point);
+  VARIABLE(rl_end);
+  VARIABLE(rl_last_func);
+  VARIABLE(rl_attempted_completion_function);
+  VARIABLE(rl_attempted_completion_over);
+
+#ifndef SAISIE_STATIQUE
+  if (manquant)
+    return false;
+#endif
+  etat = 1;
+  return true;
+}
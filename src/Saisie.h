@@ -0,0 +1,37 @@
+#ifndef _SAISIE_H
+#define _SAISIE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <readline/history.h>
+#include <readline/readline.h>
+
+/*
+ * Interface readline/history, chargée à la demande : un shell qui exécute un
+ * script ou une commande -c ne la charge jamais. Ses fonctions et variables
+ * s'utilisent à travers saisie, une fois que charger_saisie() a réussi.
+ */
+
+typedef struct Saisie {
+  char *(*readline)(const char *);
+  void (*using_history)(void);
+  void (*add_history)(const char *);
+  void (*clear_history)(void);
+  int (*where_history)(void);
+  HIST_ENTRY *(*history_get)(int);
+  int (*rl_add_defun)(const char *, rl_command_func_t *, int);
+  int (*rl_ding)(void);
+  void (*rl_replace_line)(const char *, int);
+  char **(*rl_completion_matches)(const char *, rl_compentry_func_t *);
+  char **rl_line_buffer;
+  int *rl_point, *rl_end;
+  rl_command_func_t **rl_last_func;
+  rl_completion_func_t **rl_attempted_completion_function;
+  int *rl_attempted_completion_over;
+} Saisie;
+
+extern Saisie saisie;
+
+bool charger_saisie(void);
+
+#endif
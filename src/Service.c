@@ -0,0 +1,389 @@
+#define _GNU_SOURCE // accept4(), pipe2()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "Service.h"
+#include "Arene.h"
+#include "Evaluation.h"
+#include "Saisie.h"
+#include "Taches.h"
+
+/*--------------------------------------------------------------------------------------.
+| Mode démon : "Termina --serve <socket>". Un seul processus, déjà chargé, sert autant  |
+| de clients qu'il en vient sur une socket Unix. Chaque connexion est une session, qui  |
+| a son propre Analyseur (les lignes de tous les clients sont analysées dans le même    |
+| processus, l'analyseur étant réentrant), son répertoire courant, son statut et son    |
+| historique.                                                                           |
+|                                                                                       |
+| Chaque ligne reçue est analysée dans le démon puis exécutée dans un fils forké, placé |
+| dans le répertoire de la session : un cd, un exit ou un plantage ne touche que cette  |
+| session. Le fils rend compte de son statut et de son répertoire final par un tube,    |
+| qu'un seul epoll surveille avec la socket d'écoute et les connexions.                 |
+`--------------------------------------------------------------------------------------*/
+
+#define NB_EVENEMENTS 64
+#define TAILLE_LECTURE 65536
+
+typedef enum {ECOUTE, CONNEXION, COMPTE_RENDU} genre_source;
+
+typedef struct Source {         // Donnée rendue par epoll avec chaque événement
+  genre_source genre;
+  struct Session *session;
+} Source;
+
+typedef struct Session {
+  int fd;                       // Connexion du client
+  Analyseur analyseur;
+  char *repertoire;             // Répertoire courant de la session
+  int statut;                   // Statut de sa dernière commande
+  char **historique;
+  int nb_lignes, capacite_historique;
+  char *recu;                   // Octets reçus, pas encore exécutés
+  size_t longueur, capacite;
+  pid_t pid;                    // Commande en cours, 0 s'il n'y en a pas
+  int compte_rendu;             // Tube de compte rendu de cette commande
+  bool deconnectee;
+  bool fermee;                  // Libérée à la fin du tour de boucle
+  Source connexion, retour;
+  struct Session *suivante;
+} Session;
+
+static int epfd;
+static Session *sessions = NULL;
+static Session *fermees = NULL;
+static char lecture[TAILLE_LECTURE];
+
+static void
+surveiller(int fd, Source *source){
+  struct epoll_event ev;
+
+  ev.events = EPOLLIN;
+  ev.data.ptr = source;
+  if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+    perror("epoll_ctl");
+}
+
+// Les fils forkés gardent une copie des descripteurs : la surveillance est
+// donc retirée explicitement avant la fermeture
+
+static void
+oublier(int fd){
+  epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+  close(fd);
+}
+
+////////////////////////////////////
+// INT OUVRIR_ECOUTE(CONST CHAR*) //
+////////////////////////////////////
+
+static int
+ouvrir_ecoute(const char *chemin){
+  struct sockaddr_un adresse;
+  int fd;
+
+  if (strlen(chemin) >= sizeof(adresse.sun_path)){
+    fprintf(stderr, "%s : chemin de socket trop long.\n", chemin);
+    return -1;
+  }
+  memset(&adresse, 0, sizeof(adresse));
+  adresse.sun_family = AF_UNIX;
+  strcpy(adresse.sun_path, chemin);
+
+  if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1){
+    perror("socket");
+    return -1;
+  }
+  unlink(chemin); // Socket laissée par un démon précédent
+  if (bind(fd, (struct sockaddr *) &adresse, sizeof(adresse)) == -1
+      || listen(fd, SOMAXCONN) == -1){
+    fprintf(stderr, "%s : %s.\n", chemin, strerror(errno));
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void
+accepter(int ecoute){
+  Session *s;
+  int fd;
+
+  if ((fd = accept4(ecoute, NULL, NULL, SOCK_CLOEXEC)) == -1)
+    return;
+  if ((s = calloc(1, sizeof(Session))) == NULL){
+    close(fd);
+    return;
+  }
+  s->fd = fd;
+  initialiser_analyseur(&s->analyseur);
+  s->repertoire = getcwd(NULL, 0);
+  s->compte_rendu = -1;
+  s->connexion.genre = CONNEXION;
+  s->connexion.session = s;
+  s->retour.genre = COMPTE_RENDU;
+  s->retour.session = s;
+  s->suivante = sessions;
+  sessions = s;
+  surveiller(fd, &s->connexion);
+}
+
+// Un événement déjà rendu par epoll peut encore désigner une session fermée
+// pendant le même tour : elle n'est libérée qu'à la fin du tour
+
+static void
+fermer(Session *s){
+  Session **p;
+
+  for (p = &sessions; *p != s; p = &(*p)->suivante)
+    ;
+  *p = s->suivante;
+
+  if (!s->deconnectee)
+    oublier(s->fd);
+  else
+    close(s->fd);
+  s->fermee = true;
+  s->suivante = fermees;
+  fermees = s;
+}
+
+static void
+liberer(Session *s){
+  int i;
+
+  detruire_analyseur(&s->analyseur);
+  for (i = 0; i < s->nb_lignes; i++)
+    free(s->historique[i]);
+  free(s->historique);
+  free(s->repertoire);
+  free(s->recu);
+  free(s);
+}
+
+static void
+memoriser(Session *s, const char *ligne, size_t n){
+  if (n == 0)
+    return;
+  if (s->nb_lignes == s->capacite_historique){
+    s->capacite_historique = s->capacite_historique ? 2 * s->capacite_historique : 16;
+    s->historique = realloc(s->historique, s->capacite_historique * sizeof(char *));
+  }
+  s->historique[s->nb_lignes++] = strndup(ligne, n);
+}
+
+////////////////////////////////////////
+// VOID LANCER(SESSION*, EXPRESSION*) //
+///////////////////////////////////////////////////////////////////////////
+// Exécute e dans un fils qui reprend l'état de la session : répertoire, //
+// statut, historique. Ses sorties vont au client, son entrée est vide.  //
+///////////////////////////////////////////////////////////////////////////
+
+static void
+lancer(Session *s, Expression *e){
+  int tube[2], null, i;
+  Session *autre;
+  char *repertoire;
+  pid_t pid;
+
+  if (pipe2(tube, O_CLOEXEC) == -1){
+    perror("pipe");
+    return;
+  }
+
+  if ((pid = forker_shell(0, false)) == 0){
+    // Le fils ne garde que ce qui concerne sa session
+    close(epfd);
+    for (autre = sessions; autre != NULL; autre = autre->suivante)
+      if (autre != s){
+	close(autre->fd);
+	if (autre->compte_rendu != -1)
+	  close(autre->compte_rendu);
+      }
+    close(tube[0]);
+    signal(SIGPIPE, SIG_DFL);
+
+    if ((null = open("/dev/null", O_RDONLY)) != -1){
+      dup2(null, STDIN_FILENO);
+      close(null);
+    }
+    dup2(s->fd, STDOUT_FILENO);
+    dup2(s->fd, STDERR_FILENO);
+
+    if (chdir(s->repertoire) == -1)
+      fprintf(stderr, "%s : %s.\n", s->repertoire, strerror(errno));
+    if (charger_saisie()){ // Déjà fait par le démon : voir servir_clients
+      saisie.clear_history();
+      for (i = 0; i < s->nb_lignes; i++)
+	saisie.add_history(s->historique[i]);
+      saisie.using_history();
+    }
+
+    status = s->statut;
+    bloquer_recolte(); // Comme dans la boucle principale du shell
+    executer_expression(e);
+    fflush(stdout);
+
+    repertoire = getcwd(NULL, 0);
+    dprintf(tube[1], "%d %s", status, repertoire ? repertoire : s->repertoire);
+    exit(status);
+  }
+
+  close(tube[1]);
+  if (pid == -1){
+    close(tube[0]);
+    return;
+  }
+  s->pid = pid;
+  s->compte_rendu = tube[0];
+  surveiller(tube[0], &s->retour);
+}
+
+///////////////////////////////////////
+// VOID EXECUTER_SUIVANTES(SESSION*) //
+//////////////////////////////////////////////////////////////////////
+// Analyse les lignes complètes reçues, jusqu'à en lancer une. Une  //
+// session déconnectée est fermée dès qu'elle n'a plus rien à faire //
+//////////////////////////////////////////////////////////////////////
+
+static void
+executer_suivantes(Session *s){
+  char *fin;
+  size_t n;
+
+  while (s->pid == 0 && (fin = memchr(s->recu, '\n', s->longueur)) != NULL){
+    n = fin + 1 - s->recu;
+    memoriser(s, s->recu, n - 1);
+    if (analyser_ligne(&s->analyseur, s->recu, n) == 0 && s->analyseur.expression != NULL)
+      lancer(s, s->analyseur.expression);
+    else
+      s->statut = 2;
+    s->longueur -= n;
+    memmove(s->recu, s->recu + n, s->longueur);
+    arene_reinitialiser(&arene_ligne); // Le fils a sa copie de l'arbre
+  }
+
+  if (s->pid == 0 && s->deconnectee)
+    fermer(s);
+}
+
+static void
+lire_client(Session *s){
+  ssize_t lu = read(s->fd, lecture, sizeof(lecture));
+
+  if (lu == -1 && errno == EINTR)
+    return;
+  if (lu <= 0){
+    s->deconnectee = true; // Les lignes déjà reçues sont quand même exécutées
+    epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+  }
+  else {
+    if (s->longueur + lu > s->capacite){
+      s->capacite = 2 * (s->longueur + lu);
+      s->recu = realloc(s->recu, s->capacite);
+    }
+    memcpy(s->recu + s->longueur, lecture, lu);
+    s->longueur += lu;
+  }
+  executer_suivantes(s);
+}
+
+//////////////////////////////////////
+// VOID LIRE_COMPTE_RENDU(SESSION*) //
+/////////////////////////////////////////////////////////////////////////
+// Fin de la commande en cours : reprend son statut et son répertoire. //
+// Un fils terminé sans compte rendu (exit, signal) met fin à la       //
+// session.                                                            //
+/////////////////////////////////////////////////////////////////////////
+
+static void
+lire_compte_rendu(Session *s){
+  char *espace;
+  ssize_t lu;
+
+  while ((lu = read(s->compte_rendu, lecture, sizeof(lecture) - 1)) == -1 && errno == EINTR)
+    ;
+  oublier(s->compte_rendu);
+  s->compte_rendu = -1;
+  s->pid = 0; // Le fils est récolté par le gestionnaire de SIGCHLD
+
+  if (lu <= 0){
+    if (!s->deconnectee){
+      s->deconnectee = true;
+      epoll_ctl(epfd, EPOLL_CTL_DEL, s->fd, NULL);
+    }
+    s->longueur = 0;
+  }
+  else {
+    lecture[lu] = '\0';
+    s->statut = atoi(lecture);
+    if ((espace = strchr(lecture, ' ')) != NULL){
+      free(s->repertoire);
+      s->repertoire = strdup(espace + 1);
+    }
+  }
+  executer_suivantes(s);
+}
+
+//////////////////////////////////////
+// VOID SERVIR_CLIENTS(CONST CHAR*) //
+//////////////////////////////////////
+
+void
+servir_clients(const char *chemin){
+  struct epoll_event evenements[NB_EVENEMENTS];
+  Source ecoute = {ECOUTE, NULL};
+  Source *source;
+  int fd, n, i;
+
+  initialiser_taches(false);
+  signal(SIGPIPE, SIG_IGN); // Un client parti ne doit pas tuer le démon
+  charger_saisie();         // Une fois pour toutes : les fils en héritent (historiques)
+
+  if ((fd = ouvrir_ecoute(chemin)) == -1)
+    exit(1);
+  if ((epfd = epoll_create1(EPOLL_CLOEXEC)) == -1){
+    perror("epoll_create1");
+    exit(1);
+  }
+  surveiller(fd, &ecoute);
+
+  while (1){
+    if ((n = epoll_wait(epfd, evenements, NB_EVENEMENTS, -1)) == -1){
+      if (errno == EINTR) // SIGCHLD
+	continue;
+      perror("epoll_wait");
+      exit(1);
+    }
+    for (i = 0; i < n; i++){
+      source = evenements[i].data.ptr;
+      if (source->session != NULL && source->session->fermee)
+	continue;
+      switch (source->genre) {
+      case ECOUTE :
+	accepter(fd);
+	break;
+      case CONNEXION :
+	lire_client(source->session);
+	break;
+      case COMPTE_RENDU :
+	lire_compte_rendu(source->session);
+	break;
+      }
+    }
+    while (fermees != NULL){
+      Session *s = fermees;
+      fermees = s->suivante;
+      liberer(s);
+    }
+  }
+}
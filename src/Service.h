@@ -0,0 +1,11 @@
+#ifndef _SERVICE_H
+#define _SERVICE_H
+
+/*
+ * Mode démon : un seul shell sert sur une socket Unix autant de sessions que
+ * de clients connectés.
+ */
+
+void servir_clients(const char *chemin);
+
+#endif
@@ -1,44 +1,55 @@
 /* Construction des arbres représentant des commandes */
 
 #include <stdbool.h>
-#include <readline/history.h>
-#include <readline/readline.h>
+#include <time.h>
 
 #include "Shell.h"
 
 #include "Affichage.h"
+#include "Arene.h"
+#include "Cache.h"
+#include "Completion.h"
+#include "Distant.h"
 #include "Evaluation.h"
+#include "Historique.h"
+#include "Lecture.h"
+#include "Mesures.h"
+#include "Saisie.h"
+#include "Service.h"
+#include "Statistiques.h"
+#include "Taches.h"
 
 //////////
 // DATA //
 //////////
 
-extern int yyparse_string(char *);
-
-bool interactive_mode = 1; // par défaut on utilise readline
+bool interactive_mode = 0; // 1 : readline, seulement sans script ni -c et sur un terminal
 int status = 0;            // valeur retournée par la dernière commande
+static Analyseur analyseur; // analyse des lignes lues par le shell
+static Expression **lignes_precompilees = NULL; // arbres d'un script pris dans le cache, terminés par NULL
 static int verbose = 0;    // indique si le programme affiche l'arbe syntaxique avant exécution d'une commande (1 = oui)
+static bool profil_demarrage = false; // --startup-profile : durée de chaque étape du démarrage
+static struct timespec debut_etape;
+static double duree_demarrage = 0; // Somme des étapes depuis l'entrée dans main
 
 ///////////////////////
 // FONCTIONS DONNÉES //
 ///////////////////////
 
 /*
- * Construit une expression à partir de sous-expressions
+ * Construit une expression à partir de sous-expressions (le noeud est pris
+ * dans l'arène de la ligne)
  */
 
 Expression *ConstruireNoeud (expr_t type, Expression *g, Expression *d, char **args) {
   Expression *e;
 
-  if ((e = (Expression *)malloc(sizeof(Expression))) == NULL){
-    perror("malloc");
-    exit(EXIT_FAILURE);
-  }
-
+  e = (Expression *) arene_allouer (&arene_ligne, sizeof (Expression));
   e->type = type;
   e->gauche = g;
   e->droite = d;
   e->arguments = args;
+  e->mesure = NULL;
   return e;
 }
 
@@ -54,162 +65,318 @@ int LongueurListe(char **l) {
 }
 
 /*
- * Renvoie une liste d'arguments, la première case étant initialisée à NULL, la
- * liste pouvant contenir NB_ARGS arguments (plus le pointeur NULL de fin de
- * liste)
+ * Renvoie une liste d'arguments vide, la première case étant initialisée à
+ * NULL. La liste peut d'abord contenir NB_ARGS_INITIAL arguments (plus le
+ * pointeur NULL de fin de liste), puis s'agrandit à la demande
  */
 
-char **InitialiserListeArguments (void) {
-  char **l;
+ListeArgs *InitialiserListeArguments (void) {
+  ListeArgs *l;
 
-  l = (char **) (calloc (NB_ARGS+1, sizeof (char *)));
-  *l = NULL;
+  l = (ListeArgs *) arene_allouer (&arene_ligne, sizeof (ListeArgs));
+  l->capacite = NB_ARGS_INITIAL;
+  l->longueur = 0;
+  l->arguments = (char **) arene_allouer (&arene_ligne, (NB_ARGS_INITIAL+1) * sizeof (char *));
+  l->arguments[0] = NULL;
   return l;
 }
 
 /*
- * Ajoute en fin de liste le nouvel argument et renvoie la liste résultante
+ * Ajoute en fin de liste le nouvel argument et renvoie la liste résultante.
+ * L'argument n'est pas recopié : il doit vivre au moins jusqu'à la fin de la
+ * ligne (les mots rendus par l'analyseur lexical sont déjà dans l'arène).
+ * Quand le tableau est plein, sa capacité est doublée (l'ancien tableau reste
+ * dans l'arène jusqu'à la fin de la ligne)
  */
 
-char **AjouterArg (char **Liste, char *Arg) {
-  char **l;
+ListeArgs *AjouterArg (ListeArgs *Liste, char *Arg) {
+  if (Liste->longueur == Liste->capacite)
+    {
+      char **t = (char **) arene_allouer (&arene_ligne, (2*Liste->capacite+1) * sizeof (char *));
+      memcpy (t, Liste->arguments, Liste->longueur * sizeof (char *));
+      Liste->arguments = t;
+      Liste->capacite *= 2;
+    }
 
-  l = Liste + LongueurListe (Liste);
-  *l = (char *) (malloc (1+strlen (Arg)));
-  strcpy (*l++, Arg);
-  *l = NULL;
+  Liste->arguments[Liste->longueur++] = Arg;
+  Liste->arguments[Liste->longueur] = NULL;
   return Liste;
 }
 
 /*
- * Fonction appelée lorsque l'utilisateur tape "".
+ * Fonction appelée lorsque l'utilisateur tape "", ou à la fin du script.
  */
 
 void EndOfFile (void)
 {
-  exit (0);
+  exit (status);
 }
 
 /*
  * Appelée par yyparse() sur erreur syntaxique
  */
 
-void yyerror (char *s)
+void yyerror (Analyseur *a, const char *s)
 {
+  if (a->incomplete && interactive_mode)
+    return; // La suite de la construction sera lue sur la ligne suivante
+  if (a->silencieux)
+    return; // Précompilation d'un script : l'erreur sera signalée en l'exécutant
+  a->profondeur = 0; // Le reste de la ligne est sauté jusqu'au prochain '\n'
   fprintf(stderr, "%s\n", s);
 }
 
 
 /*
- * Libération de la mémoire occupée par une expression
+ * Statistiques de l'analyse d'une ligne (voir Statistiques.c)
  */
 
-void
-expression_free(Expression *e)
+static int
+compter_analyse (int ret, double cpu)
 {
-  if (e == NULL)
-    return;
-
-  expression_free(e->gauche);
-  expression_free(e->droite);
-
-  if (e->arguments != NULL)
-    {
-      for (int i = 0; e->arguments[i] != NULL; i++)
-	free(e->arguments[i]);
-      free(e->arguments);
-    }
-
-  free(e);
+  if (ret != 0)
+    compteurs[ERREURS_SYNTAXE]++;
+  else if (analyseur.expression == NULL)
+    return ret; // Fin de l'entrée
+  compteurs[LIGNES]++;
+  observer(DUREE_ANALYSE, 0, cpu);
+  return ret;
 }
 
 /*
  * Lecture de la ligne de commande à l'aide de readline en mode interactif
  * Mémorisation dans l'historique des commandes
- * Analyse de la ligne lue
+ * Analyse de la ligne lue ; tant qu'une construction (if, while, for) y reste
+ * ouverte, la ligne suivante est lue avec l'invite de continuation et le tout
+ * est analysé à nouveau
+ * En mode non interactif, l'analyseur lit directement la ligne suivante dans
+ * l'entrée préparée par main(), sauf pour un script précompilé (voir Cache.c)
+ * dont les arbres sont déjà là
  */
 
 int
 my_yyparse(void)
 {
+  double debut, cpu = 0;
+  int ret;
+
+  if (lignes_precompilees != NULL)
+    {
+      analyseur.expression = *lignes_precompilees;
+      if (analyseur.expression == NULL)
+	analyseur.fin = 1; // Fin du script
+      else
+	lignes_precompilees++;
+      return 0;
+    }
   if (interactive_mode)
     {
-      char *line = NULL;
+      char *line = NULL, *texte = NULL;
+      size_t longueur = 0;
       char buffer[1024];
+      ret = 1;
       snprintf(buffer, 1024, "\x1b[01;33m[%d] \x1b[01;34mTermina \x1b[01;33m> \x1b[0m", status);
-      line = readline(buffer);
-      if(line != NULL)
+      while ((line = saisie.readline(texte == NULL ? buffer : "> ")) != NULL)
 	{
-	  int ret;
-	  add_history(line);              // Enregistre la line non vide dans l'historique courant
-	  *strchr(line, '\0') = '\n';     // Ajoute \n à la line pour qu'elle puisse etre traité par le parseur
-	  ret = yyparse_string(line);     // Remplace l'entrée standard de yyparse par s
+	  size_t n = strlen(line);
+	  ajouter_historique(line);       // Enregistre la line non vide dans l'historique (et son fichier)
+	  texte = realloc(texte, longueur + n + 1);
+	  memcpy(texte + longueur, line, n);
+	  longueur += n;
+	  texte[longueur++] = '\n';       // Ajoute \n à la line pour qu'elle puisse etre traité par le parseur
 	  free(line);
-	  return ret;
+	  debut = horloge_cpu();
+	  ret = analyser_ligne(&analyseur, texte, longueur);
+	  cpu += horloge_cpu() - debut;
+	  if (ret == 0 || !analyseur.incomplete)
+	    break;
 	}
-      else
+      if (texte == NULL)
 	{
 	  EndOfFile();
 	  return -1;
 	}
+      if (ret != 0 && analyseur.incomplete) // Fin de l'entrée dans une construction ouverte
+	fprintf(stderr, "syntax error\n");
+      free(texte);
+      return compter_analyse(ret, cpu);
     }
-  else
-    {
-      // pour le mode distant par exemple
+  debut = horloge_cpu();
+  ret = yyparse(&analyseur);
+  return compter_analyse(ret, horloge_cpu() - debut);
+}
 
-      int ret; int c;
 
-      char *line = NULL;
-      size_t linecap = 0;
-      ssize_t linelen;
-      linelen = getline(&line, &linecap, stdin);
 
-      if(linelen>0)
-	{
-	  int ret;
-	  ret = yyparse_string(line);
-	  free(line);
-	  return ret;
-	}
-    }
+/*
+ * Vrai si la chaîne de -c ne contient qu'une ligne de commande : la première
+ * ligne analysée sera alors la dernière
+ */
+
+static bool
+une_seule_ligne (const char *commande)
+{
+  const char *p = strchr(commande, '\n');
+  return p == NULL || p[strspn(p, " \t\n")] == '\0';
+}
+
+/*
+ * --startup-profile : chaque étape du démarrage affiche sa durée sur la sortie
+ * d'erreur. Ce qui précède main (chargement de l'exécutable et des
+ * bibliothèques, relogements) est mesuré en temps CPU du processus
+ */
+
+static double
+millisecondes (struct timespec *depuis, struct timespec *t)
+{
+  return (t->tv_sec - depuis->tv_sec) * 1e3 + (t->tv_nsec - depuis->tv_nsec) / 1e6;
 }
 
+static void
+etape_demarrage (const char *etape)
+{
+  struct timespec t;
+  double duree;
 
+  if (!profil_demarrage)
+    return;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  duree = millisecondes(&debut_etape, &t);
+  duree_demarrage += duree;
+  fprintf(stderr, "démarrage : %8.3f ms  %s\n", duree, etape);
+  clock_gettime(CLOCK_MONOTONIC, &debut_etape); // L'affichage ne compte pas
+}
+
+static void
+commencer_profil (void)
+{
+  struct timespec zero = {0, 0}, cpu, t;
+
+  profil_demarrage = true;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu);
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  duree_demarrage += millisecondes(&debut_etape, &t);
+  fprintf(stderr, "démarrage : %8.3f ms  avant main (temps CPU)\n", millisecondes(&zero, &cpu));
+  clock_gettime(CLOCK_MONOTONIC, &debut_etape);
+}
+
+static void
+terminer_profil (void)
+{
+  if (profil_demarrage)
+    fprintf(stderr, "démarrage : %8.3f ms  total depuis main\n", duree_demarrage);
+}
 
 //////////
 // MAIN //
 //////////
 
+static void
+usage (void)
+{
+  fprintf(stderr, "Usage : Termina [-v] [-a] [--startup-profile] [-c commande | script]\n"
+	  "        Termina --serve <socket>\n"
+	  "        Termina --serveur\n");
+  exit(2);
+}
+
 int
 main (int argc, char **argv)
 {
+  char *commande = NULL, *script = NULL, *tampon;
+  bool derniere_ligne = false; // Ligne après laquelle le shell se termine
+  size_t taille;
+  int i;
 
-  // faire en sorte qu'interactive_mode = 0 lorsque le shell est distant
+  clock_gettime(CLOCK_MONOTONIC, &debut_etape);
 
-  if (argv[1]!=NULL && (strcmp(argv[1], "-v") || strcmp(argv[1], "--verbose")))
-    verbose = 1;
-  
-  if (interactive_mode)
+  for (i = 1; i < argc && argv[i][0] == '-'; i++)
+    {
+      if (strcmp(argv[i], "-v") == 0 || strcmp(argv[i], "--verbose") == 0)
+	verbose = 1;
+      else if (strcmp(argv[i], "-a") == 0 || strcmp(argv[i], "--analyse") == 0)
+	mesures_actives = true; // Mesures de chaque noeud après exécution (voir Mesures.c)
+      else if (strcmp(argv[i], "--startup-profile") == 0)
+	commencer_profil();
+      else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+	commande = argv[++i];
+      else if (strcmp(argv[i], "--serveur") == 0)
+	servir_distant(); // Extrémité d'une session de remote (voir Distant.c)
+      else if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc)
+	servir_clients(argv[++i]); // Démon pour plusieurs clients (voir Service.c)
+      else
+	usage();
+    }
+  if (i < argc && commande == NULL)
+    script = argv[i];
+  etape_demarrage("arguments");
+
+  initialiser_analyseur(&analyseur);
+  etape_demarrage("analyseur");
+
+  // Mode non interactif : readline n'est même pas chargée, l'analyseur lit
+  // directement la chaîne, le script projeté en mémoire ou l'entrée standard.
+  // Un script déjà analysé lors d'une exécution précédente ne l'est plus
+  if (commande != NULL)
     {
-      using_history();
+      tampon = preparer_chaine(commande, &taille);
+      analyser_tampon(&analyseur, tampon, taille);
+      derniere_ligne = une_seule_ligne(commande);
     }
+  else if (script != NULL)
+    {
+      if ((tampon = projeter_script(script, &taille)) == NULL)
+	exit(127);
+      if ((lignes_precompilees = precompiler_script(script, tampon, taille)) == NULL)
+	analyser_tampon(&analyseur, tampon, taille); // Pas de cache, ou erreur de syntaxe
+    }
+  else if (isatty(STDIN_FILENO) && charger_saisie())
+    interactive_mode = 1;
   else
+    analyser_flux(&analyseur, STDIN_FILENO); // Pas un terminal (ou readline introuvable)
+  etape_demarrage(interactive_mode ? "readline" : "entrée");
+
+  if (interactive_mode)
     {
-      //  mode distant
+      saisie.using_history();
+      ouvrir_historique();
+      etape_demarrage("historique");
+      initialiser_completion();
+      etape_demarrage("complétion");
     }
 
+  initialiser_taches(interactive_mode);
+  etape_demarrage("tâches");
+  terminer_profil();
+
   while (1){
-    if (my_yyparse () == 0) {  /* L'analyse a abouti */
+    signaler_taches(); // Annonce les tâches terminées depuis la dernière invite
+    if (my_yyparse () == 0 && analyseur.expression != NULL
+	&& analyseur.expression->type != VIDE) {  /* L'analyse a abouti */
       if (verbose == 1)
-	afficher_expr(ExpressionAnalysee);
-      status = 0; // On réinitialise le statut
-      executer_expression(ExpressionAnalysee);
+	afficher_expr(analyseur.expression);
+      if (mesures_actives)
+	preparer_mesures(analyseur.expression);
+      bloquer_recolte(); // Les fils au premier plan sont attendus explicitement
+      if (derniere_ligne && !mesures_actives)
+	executer_et_terminer(analyseur.expression); // La dernière commande remplace le shell
+      executer_expression(analyseur.expression);
+      debloquer_recolte();
       fflush(stdout);
-      expression_free(ExpressionAnalysee);
+      if (mesures_actives)
+	{
+	  agreger_mesures(analyseur.expression);
+	  afficher_analyse(analyseur.expression);
+	}
     }
+    else if (analyseur.fin)
+      EndOfFile(); // Fin du script ou de l'entrée standard
     else {
-      /* L'analyse de la ligne de commande a donné une erreur */
+      /* Erreur de syntaxe ou ligne vide : rien n'est exécuté, et $? garde
+	 le statut de la ligne précédente */
     }
+    arene_reinitialiser(&arene_ligne); // Libère d'un coup l'arbre de la ligne
+    exporter_statistiques(); // $TERMINA_STATISTIQUES, au plus une fois par période
   }
   return 0;
 }
@@ -5,8 +5,7 @@
 #include <string.h>
 #include <unistd.h>
 
-#define NB_ARGS 50
-#define TAILLE_ID 500
+#define NB_ARGS_INITIAL 8
 
 typedef enum expr_t {
   VIDE,	         		// Commande vide 
@@ -22,6 +21,13 @@ typedef enum expr_t {
   REDIRECTION_E, 		// Redirection sortie erreur 
   REDIRECTION_EO,		// Redirection sorties erreur et standard
   SOUS_SHELL,                   // ( shell ) 
+  SI,                           // if ... then ... [else ...] fi
+  ALTERNATIVE,                  // Branches then et else d'un SI
+  TANT_QUE,                     // while ... do ... done
+  JUSQUA,                       // until ... do ... done
+  POUR,                         // for nom in mots ; do ... done
+  REDIRECTION_DOC,              // Document en entre (<<MOT)
+  REDIRECTION_CHAINE,           // Chane en entre (<<<)
 } expr_t;
 
 typedef struct Expression {
@@ -29,16 +35,48 @@ typedef struct Expression {
   struct Expression *gauche;
   struct Expression *droite;
   char   **arguments;
+  struct Mesure *mesure;	// Mesures du mode analyse (NULL sinon, voir Mesures.c)
 } Expression;
 
-extern int yyparse(void);
+typedef struct ListeArgs {	// Liste d'arguments en construction
+  char **arguments;		// Tableau  la argv, termin par NULL
+  int longueur;
+  int capacite;
+} ListeArgs;
+
+typedef struct Document {	// Document (<<MOT) dont le texte reste  lire
+  Expression *e;
+  int cite;			// Dlimiteur entre guillemets : texte pris tel quel
+  struct Document *suivant;
+} Document;
+
+typedef struct Analyseur {	// Etat de l'analyse d'un flot de lignes de commande
+  void *scanner;		// Analyseur lexical rentrant (yyscan_t)
+  Expression *expression;	// Arbre de la dernire ligne (NULL  la fin de l'entre)
+  int fin;			// Fin de l'entre atteinte
+  int attente;			// Sorte du prochain mot (voir Analyse.l)
+  int profondeur;		// Constructions if, while, until, for ouvertes
+  int incomplete;		// Entre termine dans une construction ouverte
+  int parentheses;		// Parenthses ouvertes d'une substitution $(...)
+  int cite;			// Dernier dlimiteur de document entre guillemets
+  Document *documents;		// Documents de la ligne en attente de leur texte
+  int silencieux;		// Erreurs non affiches (prcompilation, voir Cache.c)
+} Analyseur;
+
+extern int yyparse(Analyseur *);
+void initialiser_analyseur(Analyseur *);
+void detruire_analyseur(Analyseur *);
+void analyser_tampon(Analyseur *, char *, size_t);
+void analyser_flux(Analyseur *, int);
+int analyser_ligne(Analyseur *, const char *, size_t);
+void attendre_document(Analyseur *, Expression *);
+
 Expression *ConstruireNoeud (expr_t, Expression *, Expression *, char **);
-char **AjouterArg (char **, char *);
-char **InitialiserListeArguments (void);
+ListeArgs *AjouterArg (ListeArgs *, char *);
+ListeArgs *InitialiserListeArguments (void);
 int LongueurListe(char **);
 void EndOfFile(void);
 
-void yyerror (char *s);
-Expression *ExpressionAnalysee;
+void yyerror (Analyseur *, const char *s);
 extern int status;
 #endif /* ANALYSE */
@@ -0,0 +1,256 @@
+#define _GNU_SOURCE // asprintf()
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "Statistiques.h"
+
+/*--------------------------------------------------------------------------------------.
+| Statistiques d'une session, pour les shells qui vivent longtemps. Les compteurs sont  |
+| de simples incréments ; chaque durée observée tombe dans un histogramme à seaux fixes |
+| (bornes 1 µs, 4 µs, 16 µs... 16 s), choisi par un calcul sur les bits de la durée :   |
+| rien d'autre que la lecture de l'horloge, sans allocation ni appel système.           |
+|                                                                                       |
+| Les octets des redirections sont estimés d'après la taille des fichiers, relevée à la |
+| fin de la commande : ce qu'une redirection de sortie a ajouté, la taille entière d'un |
+| fichier lu en entrée. Le texte des documents (<<, <<<) est compté exactement. Seul le |
+| shell compte : ce que font ses fils forkés (sous-shells, étages internes d'un         |
+| pipeline) n'y figure pas, hormis leur lancement et leur attente.                      |
+|                                                                                       |
+| Le fichier $TERMINA_STATISTIQUES, s'il est défini, est réécrit au format Prometheus   |
+| (collecteur textfile de node_exporter) entre deux lignes de commande, au plus toutes  |
+| les $TERMINA_STATISTIQUES_PERIODE secondes (10 par défaut), et à la sortie du shell.  |
+| Il est remplacé d'un coup (rename()) : on ne le lit jamais à moitié écrit.            |
+`--------------------------------------------------------------------------------------*/
+
+#define NB_SEAUX 13              // Bornes 4^k µs, k = 0..12, puis +Inf
+#define PERIODE_DEFAUT 10        // Secondes entre deux exports
+
+typedef struct Histogramme {
+  unsigned long long seaux[NB_SEAUX + 1];
+  unsigned long long nombre;
+  double somme, max;             // Secondes
+} Histogramme;
+
+typedef struct Description {
+  const char *nom;               // Pour stats
+  const char *metrique;          // Pour Prometheus
+  const char *aide;
+} Description;
+
+static const Description descriptions_compteurs[NB_COMPTEURS] = {
+  {"lignes analysées", "termina_lines_total", "Lignes de commande analysées."},
+  {"erreurs de syntaxe", "termina_syntax_errors_total", "Lignes de commande rejetées par l'analyseur."},
+  {"commandes internes", "termina_builtins_total", "Commandes internes exécutées par le shell."},
+  {"commandes externes", "termina_external_commands_total", "Commandes externes lancées par le shell."},
+  {"échecs de lancement", "termina_spawn_failures_total", "Commandes externes introuvables ou refusées par posix_spawn."},
+  {"octets lus (redirections)", "termina_redirect_read_bytes_total", "Octets fournis par les redirections d'entrée."},
+  {"octets écrits (redirections)", "termina_redirect_written_bytes_total", "Octets ajoutés aux fichiers des redirections de sortie."}};
+
+static const Description descriptions_histogrammes[NB_HISTOGRAMMES] = {
+  {"analyse", "termina_parse_seconds", "Temps CPU d'analyse d'une ligne de commande."},
+  {"lancement", "termina_spawn_seconds", "Durée de posix_spawn pour une commande externe."},
+  {"attente", "termina_wait_seconds", "Attente d'une commande au premier plan, jusqu'à sa récolte."}};
+
+unsigned long long compteurs[NB_COMPTEURS];
+static Histogramme histogrammes[NB_HISTOGRAMMES];
+
+double
+horloge(void){
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+double
+horloge_cpu(void){
+  struct timespec t;
+  clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+  return t.tv_sec + t.tv_nsec / 1e9;
+}
+
+//////////////////////////////////////////////////
+// VOID OBSERVER(HISTOGRAMME_T, DOUBLE, DOUBLE) //
+//////////////////////////////////////////////////////////////////////
+// Ajoute la durée fin - debut à l'histogramme h. Son seau est le   //
+// premier k tel que 4^k µs la couvre : la moitié du nombre de bits //
+// de (µs - 1), arrondie au-dessus                                  //
+//////////////////////////////////////////////////////////////////////
+
+void
+observer(histogramme_t h, double debut, double fin){
+  Histogramme *p = &histogrammes[h];
+  double duree = (fin > debut) ? fin - debut : 0;
+  unsigned long long us = (unsigned long long) (duree * 1e6 + 0.999);
+  int k = (us <= 1) ? 0 : (64 - __builtin_clzll(us - 1) + 1) / 2;
+
+  p->seaux[k < NB_SEAUX ? k : NB_SEAUX]++;
+  p->nombre++;
+  p->somme += duree;
+  if (duree > p->max)
+    p->max = duree;
+}
+
+////////////////////////////////////////////////////////////////
+// VOID DEBUTER_OCTETS / COMPTER_OCTETS(REDIRECTION*, EXPR_T) //
+///////////////////////////////////////////////////////////////////////
+// Autour d'une redirection r de type type (r->type vaut PIPE quand  //
+// le shell a ouvert le fichier lui-même) : taille du fichier avant  //
+// la commande, puis compte de ses octets une fois la commande faite //
+///////////////////////////////////////////////////////////////////////
+
+static long long
+taille(Redirection *r){
+  struct stat st;
+
+  if ((r->type == PIPE ? fstat(r->fd, &st) : stat(r->fichier, &st)) == -1 || !S_ISREG(st.st_mode))
+    return -1; // Terminal, /dev/null, tube nommé... : rien à mesurer
+  return st.st_size;
+}
+
+void
+debuter_octets(Redirection *r, expr_t type){
+  r->taille = (type == REDIRECTION_A) ? taille(r) : 0;
+}
+
+void
+compter_octets(Redirection *r, expr_t type){
+  long long t;
+
+  if (est_document(type) || (t = taille(r)) == -1)
+    return;
+  if (type == REDIRECTION_I)
+    compteurs[OCTETS_LUS] += t;
+  else if (t > r->taille)
+    compteurs[OCTETS_ECRITS] += t - r->taille;
+}
+
+/////////////////////////////////////////////
+// VOID AFFICHER_STATISTIQUES(FILE*, BOOL) //
+/////////////////////////////////////////////////////////////////
+// Ecrit les statistiques dans f, pour la commande stats ou au //
+// format texte de Prometheus (histogrammes à seaux cumulés)   //
+/////////////////////////////////////////////////////////////////
+
+static void
+ecrire_duree(FILE *f, double s){
+  if (s < 1e-3)
+    fprintf(f, "%.1f µs", s * 1e6);
+  else if (s < 1)
+    fprintf(f, "%.2f ms", s * 1e3);
+  else
+    fprintf(f, "%.3f s", s);
+}
+
+static void
+ecrire_prometheus(FILE *f){
+  const Description *d;
+  Histogramme *h;
+  unsigned long long cumul;
+  double borne;
+  int i, k;
+
+  for (i = 0; i < NB_COMPTEURS; i++){
+    d = &descriptions_compteurs[i];
+    fprintf(f, "# HELP %s %s\n# TYPE %s counter\n%s %llu\n", d->metrique, d->aide, d->metrique, d->metrique, compteurs[i]);
+  }
+  for (i = 0; i < NB_HISTOGRAMMES; i++){
+    d = &descriptions_histogrammes[i];
+    h = &histogrammes[i];
+    fprintf(f, "# HELP %s %s\n# TYPE %s histogram\n", d->metrique, d->aide, d->metrique);
+    for (k = 0, cumul = 0, borne = 1e-6; k < NB_SEAUX; k++, borne *= 4){
+      cumul += h->seaux[k];
+      fprintf(f, "%s_bucket{le=\"%g\"} %llu\n", d->metrique, borne, cumul);
+    }
+    fprintf(f, "%s_bucket{le=\"+Inf\"} %llu\n", d->metrique, h->nombre);
+    fprintf(f, "%s_sum %.9f\n%s_count %llu\n", d->metrique, h->somme, d->metrique, h->nombre);
+  }
+}
+
+void
+afficher_statistiques(FILE *f, bool prometheus){
+  Histogramme *h;
+  int i;
+
+  if (prometheus){
+    ecrire_prometheus(f);
+    return;
+  }
+  for (i = 0; i < NB_COMPTEURS; i++)
+    fprintf(f, "%12llu  %s\n", compteurs[i], descriptions_compteurs[i].nom);
+  for (i = 0; i < NB_HISTOGRAMMES; i++){
+    h = &histogrammes[i];
+    fprintf(f, "%12llu  %s", h->nombre, descriptions_histogrammes[i].nom);
+    if (h->nombre > 0){
+      fputs(" : moyenne ", f);
+      ecrire_duree(f, h->somme / h->nombre);
+      fputs(", max ", f);
+      ecrire_duree(f, h->max);
+    }
+    fputc('\n', f);
+  }
+}
+
+void
+vider_statistiques(void){
+  memset(compteurs, 0, sizeof(compteurs));
+  memset(histogrammes, 0, sizeof(histogrammes));
+}
+
+//////////////////////////////////////
+// VOID EXPORTER_STATISTIQUES(VOID) //
+//////////////////////////////////////////////////////////////////////
+// Réécrit $TERMINA_STATISTIQUES si la période est écoulée. Appelée //
+// par la boucle principale après chaque ligne de commande          //
+//////////////////////////////////////////////////////////////////////
+
+static char *chemin = NULL, *temporaire = NULL;
+static pid_t proprietaire;       // Les fils forkés n'écrivent pas le fichier
+
+static void
+ecrire_fichier(void){
+  FILE *f;
+
+  if (getpid() != proprietaire)
+    return;
+  if ((f = fopen(temporaire, "w")) == NULL){
+    fprintf(stderr, "%s : %s.\n", temporaire, strerror(errno));
+    return;
+  }
+  ecrire_prometheus(f);
+  if (fclose(f) == EOF || rename(temporaire, chemin) == -1)
+    fprintf(stderr, "%s : %s.\n", chemin, strerror(errno));
+}
+
+void
+exporter_statistiques(void){
+  static bool pret = false;
+  static double periode = PERIODE_DEFAUT, dernier = 0;
+  const char *p;
+  double t;
+
+  if (!pret){
+    pret = true;
+    if ((p = getenv("TERMINA_STATISTIQUES")) == NULL || *p == '\0'
+	|| asprintf(&temporaire, "%s.%d", p, (int) getpid()) == -1)
+      return;
+    chemin = strdup(p);
+    if ((p = getenv("TERMINA_STATISTIQUES_PERIODE")) != NULL && atof(p) > 0)
+      periode = atof(p);
+    proprietaire = getpid();
+    atexit(ecrire_fichier); // Le dernier état, à la sortie du shell
+  }
+  if (chemin == NULL)
+    return;
+
+  t = horloge();
+  if (dernier != 0 && t - dernier < periode)
+    return;
+  dernier = t;
+  ecrire_fichier();
+}
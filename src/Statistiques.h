@@ -0,0 +1,46 @@
+#ifndef _STATISTIQUES_H
+#define _STATISTIQUES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "Lancement.h"
+
+/*
+ * Compteurs et histogrammes de durées tenus pendant toute la vie du shell :
+ * affichés par la commande interne stats, et réécrits périodiquement au
+ * format texte de Prometheus dans $TERMINA_STATISTIQUES s'il est défini.
+ */
+
+typedef enum compteur_t {
+  LIGNES,                 // Lignes de commande analysées
+  ERREURS_SYNTAXE,
+  INTERNES,               // Commandes internes exécutées par le shell
+  EXTERNES,               // Commandes externes lancées par le shell
+  ECHECS_LANCEMENT,       // Introuvables, ou refusées par posix_spawn
+  OCTETS_LUS,             // Octets passés par les redirections
+  OCTETS_ECRITS,
+  NB_COMPTEURS
+} compteur_t;
+
+typedef enum histogramme_t {
+  DUREE_ANALYSE,          // Analyse d'une ligne (temps CPU)
+  DUREE_LANCEMENT,        // posix_spawn d'une commande externe
+  DUREE_ATTENTE,          // Attente d'une commande au premier plan
+  NB_HISTOGRAMMES
+} histogramme_t;
+
+extern unsigned long long compteurs[NB_COMPTEURS];
+
+double horloge(void);
+double horloge_cpu(void);
+void observer(histogramme_t h, double debut, double fin);
+
+void debuter_octets(Redirection *r, expr_t type);
+void compter_octets(Redirection *r, expr_t type);
+
+void afficher_statistiques(FILE *f, bool prometheus);
+void vider_statistiques(void);
+void exporter_statistiques(void);
+
+#endif
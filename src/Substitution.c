@@ -0,0 +1,193 @@
+#define _GNU_SOURCE // pipe2()
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "Substitution.h"
+#include "Arene.h"
+#include "Commandes_Internes.h"
+#include "Evaluation.h"
+#include "Lancement.h"
+#include "Motifs.h"
+#include "Taches.h"
+
+/*--------------------------------------------------------------------------------------.
+| Substitution de commande $(...). Le texte entre parenthèses reste dans le mot (voir   |
+| Analyse.l) ; il est analysé et exécuté au moment du développement, comme $NOM         |
+| (Variables.c). La sortie est lue par un tube dans un tampon qui s'agrandit, sans      |
+| fichier temporaire ; ses fins de ligne finales sont retirées. Hors guillemets, le     |
+| résultat est ensuite découpé en mots (Motifs.c).                                      |
+|                                                                                       |
+| Pas de shell intermédiaire : une commande externe est lancée directement              |
+| (Lancement.c), et pwd, hostname ou date, dont la sortie tient dans le tube, sont      |
+| exécutées par le shell lui-même, sans fork. Le reste (autres commandes internes,      |
+| pipes, séquences...) est évalué dans un fils du shell.                                |
+|                                                                                       |
+| Entre guillemets, l'analyseur lexical protège les parenthèses par des '\' (voir       |
+| proteger_motif) : "$(...)" s'écrit alors $\(...\), et n'est pas découpé.              |
+`--------------------------------------------------------------------------------------*/
+
+// Commandes internes exécutées dans le shell : leur sortie est courte
+static const char *internes_directes[] = {"pwd", "hostname", "date", NULL};
+
+static Analyseur analyseur;     // Analyse des commandes substituées
+static bool analyseur_pret = false;
+
+int statut_substitution = -1;
+
+static char *lu = NULL;         // Sortie de la commande en cours de lecture
+static size_t longueur = 0, capacite = 0;
+
+static bool
+est_directe(const char *nom){
+  for (int i = 0; internes_directes[i] != NULL; i++)
+    if (strcmp(nom, internes_directes[i]) == 0)
+      return true;
+  return false;
+}
+
+/////////////////////////////////////////////////////
+// CONST CHAR* FIN_SUBSTITUTION(CONST CHAR*, BOOL) //
+//////////////////////////////////////////////////////////////////////
+// Parenthèse fermante de la substitution dont le texte commence en //
+// p, ou NULL. Sous la forme protégée, seules les parenthèses       //
+// protégées comptent (la fin pointe alors sur le '\') ; sinon, une //
+// parenthèse entre apostrophes ou guillemets ne compte pas.        //
+//////////////////////////////////////////////////////////////////////
+
+static const char *
+fin_substitution(const char *p, bool protegee){
+  char guillemet = 0;
+  int niveau = 1;
+
+  for (; *p != '\0'; p++){
+    if (protegee){
+      if (*p != '\\' || p[1] == '\0')
+	continue;
+      if (p[1] == '(')
+	niveau++;
+      else if (p[1] == ')' && --niveau == 0)
+	return p;
+      p++;
+    }
+    else if (guillemet != 0){
+      if (*p == guillemet)
+	guillemet = 0;
+    }
+    else if (*p == '\'' || *p == '"')
+      guillemet = *p;
+    else if (*p == '\\' && p[1] != '\0')
+      p++;
+    else if (*p == '(')
+      niveau++;
+    else if (*p == ')' && --niveau == 0)
+      return p;
+  }
+  return NULL;
+}
+
+/////////////////////////////////
+// CHAR* CAPTURER(EXPRESSION*) //
+///////////////////////////////////////////////////////////////////////
+// Exécute e, sa sortie standard dans un tube, et renvoie ce qui y a //
+// été écrit (dans l'arène), sans ses fins de ligne finales. Le      //
+// statut de e est gardé dans statut_substitution.                   //
+///////////////////////////////////////////////////////////////////////
+
+static char *
+capturer(Expression *e){
+  int tube[2], sauvegarde[3], statut = 1;
+  char **arguments;
+  Redirection r;
+  pid_t pid = 0;
+  ssize_t n;
+
+  if (pipe2(tube, O_CLOEXEC) == -1){
+    perror("pipe");
+    return arene_copier(&arene_ligne, "", 0);
+  }
+  r = (Redirection){.type = PIPE, .fd = tube[1], .cible = STDOUT_FILENO, .englobante = redirections_en_cours};
+
+  if (e->type == SIMPLE && est_directe(e->arguments[0])){
+    if (rediriger_temporairement(&r, sauvegarde) == 0){
+      arguments = e->arguments;
+      e->arguments = developper_arguments(arguments);
+      executer_interne(e, &statut);
+      e->arguments = arguments;
+    }
+    restaurer_redirections(sauvegarde);
+  }
+  else if (est_commande_externe(e))
+    pid = lancer_expression(e, &r, -1);
+  else if ((pid = forker_shell(-1, false)) == 0){
+    redirections_en_cours = &r;
+    executer_et_terminer(e);
+  }
+  close(tube[1]);
+
+  longueur = 0;
+  for (;;){
+    if (longueur == capacite){
+      capacite = capacite ? 2 * capacite : 4096;
+      if ((lu = realloc(lu, capacite)) == NULL){
+	perror("realloc");
+	exit(EXIT_FAILURE);
+      }
+    }
+    if ((n = read(tube[0], lu + longueur, capacite - longueur)) > 0)
+      longueur += n;
+    else if (n == 0 || errno != EINTR)
+      break;
+  }
+  close(tube[0]);
+  if (pid > 0)
+    statut = attendre_commande(pid);
+  else if (pid == -1)
+    statut = 127; // Commande introuvable, ou fork impossible
+  statut_substitution = statut;
+
+  while (longueur > 0 && lu[longueur - 1] == '\n')
+    longueur--;
+  return arene_copier(&arene_ligne, lu, longueur);
+}
+
+//////////////////////////////////////////////////////////
+// CHAR* SUBSTITUER_COMMANDE(CONST CHAR*, CONST CHAR**) //
+///////////////////////////////////////////////////////////////////////
+// debut pointe sur le '$' de "$(" (ou "$\(", entre guillemets) :    //
+// exécute la commande et renvoie sa sortie, prise dans l'arène, la  //
+// suite du mot dans *suite. NULL si la parenthèse n'est pas fermée. //
+///////////////////////////////////////////////////////////////////////
+
+char *
+substituer_commande(const char *debut, const char **suite){
+  bool protegee = (debut[1] == '\\');
+  const char *texte = debut + (protegee ? 3 : 2), *fin;
+  char *ligne, *p;
+
+  if ((fin = fin_substitution(texte, protegee)) == NULL)
+    return NULL;
+  *suite = fin + (protegee ? 2 : 1);
+
+  // Texte de la commande, sans les protections, en une ligne complète
+  p = ligne = arene_allouer(&arene_ligne, fin - texte + 2);
+  for (; texte < fin; texte++){
+    if (protegee && *texte == '\\' && texte + 1 < fin)
+      texte++;
+    *p++ = *texte;
+  }
+  *p++ = '\n';
+
+  if (!analyseur_pret){
+    initialiser_analyseur(&analyseur);
+    analyseur_pret = true;
+  }
+  if (analyser_ligne(&analyseur, ligne, p - ligne) != 0 || analyseur.expression == NULL)
+    return arene_copier(&arene_ligne, "", 0);
+  return capturer(analyseur.expression);
+}
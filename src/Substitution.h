@@ -0,0 +1,13 @@
+#ifndef _SUBSTITUTION_H
+#define _SUBSTITUTION_H
+
+/*
+ * Substitution de commande $(...) : la commande est exécutée au moment du
+ * développement du mot, et sa sortie prend sa place.
+ */
+
+extern int statut_substitution; // Statut de la dernière, -1 si aucune
+
+char *substituer_commande(const char *debut, const char **suite);
+
+#endif
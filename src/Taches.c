@@ -0,0 +1,612 @@
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "Taches.h"
+#include "Affichage.h"
+#include "Lancement.h"
+#include "Mesures.h"
+#include "Statistiques.h"
+
+/*--------------------------------------------------------------------------------------.
+| Contrôle des tâches. Les tâches sont rangées dans un tableau indexé par leur numéro   |
+| (les numéros libérés sont réutilisés), et une table de hachage pid -> numéro permet   |
+| de retrouver en temps constant la tâche d'un processus qui change d'état.             |
+|                                                                                       |
+| Les fils sont récoltés de manière asynchrone par le gestionnaire de SIGCHLD. Ce       |
+| signal est bloqué pendant l'exécution d'une ligne de commande : les commandes au      |
+| premier plan sont alors attendues explicitement, sans risque que le gestionnaire ne   |
+| leur vole leur statut. Le gestionnaire ne fait jamais d'allocation, tout ce qui       |
+| grandit est agrandi par le programme principal, SIGCHLD bloqué.                       |
+`--------------------------------------------------------------------------------------*/
+
+// Etats d'un processus d'une tâche
+#define EN_COURS  0
+#define STOPPE    1
+#define TERMINE   2
+
+typedef struct Entree {
+  pid_t pid;      // 0 : case vide
+  int numero;
+} Entree;
+
+bool controle_des_taches = false;
+
+static Tache *taches = NULL;       // taches[n - 1] est la tâche numéro n
+static int capacite = 0;
+static int *libres = NULL;         // Pile des numéros libres
+static int nb_libres = 0;
+static int courante = 0;           // Tâche désignée par défaut (fg, bg, wait)
+
+static int *finies = NULL;         // Tâches terminées à annoncer
+static int nb_finies = 0;
+
+static Entree *index_pids = NULL;  // Table pid -> numéro, adressage ouvert
+static int capacite_index = 0, nb_index = 0;
+
+static sigset_t masque_sigchld;
+
+//////////////////////////////////////////
+// ENTREE* CASE_PID(PID_T) et compagnie //
+//////////////////////////////////////////////////////////////////
+// Gestion de la table pid -> numéro (sondage linéaire, retrait //
+// par recul des cases suivantes de la grappe)                  //
+//////////////////////////////////////////////////////////////////
+
+static Entree *
+case_pid(pid_t pid){
+  int i = ((unsigned) pid * 2654435761u) & (capacite_index - 1);
+
+  while (index_pids[i].pid != 0 && index_pids[i].pid != pid)
+    i = (i + 1) & (capacite_index - 1);
+  return &index_pids[i];
+}
+
+static void
+indexer_pid(pid_t pid, int numero){
+  Entree *ancien = index_pids;
+  int ancienne_capacite = capacite_index;
+
+  if (2 * (nb_index + 1) > capacite_index){
+    capacite_index = capacite_index ? 2 * capacite_index : 64;
+    index_pids = calloc(capacite_index, sizeof(Entree));
+    for (int i = 0; i < ancienne_capacite; i++)
+      if (ancien[i].pid != 0)
+	*case_pid(ancien[i].pid) = ancien[i];
+    free(ancien);
+  }
+  *case_pid(pid) = (Entree){pid, numero};
+  nb_index++;
+}
+
+static void
+desindexer_pid(pid_t pid){
+  Entree *e, deplacee;
+  int i;
+
+  if (capacite_index == 0 || (e = case_pid(pid))->pid == 0)
+    return;
+  e->pid = 0;
+  nb_index--;
+  for (i = (e - index_pids + 1) & (capacite_index - 1); index_pids[i].pid != 0;
+       i = (i + 1) & (capacite_index - 1)){
+    deplacee = index_pids[i];
+    index_pids[i].pid = 0;
+    *case_pid(deplacee.pid) = deplacee;
+  }
+}
+
+////////////////////////////////////
+// VOID METTRE_A_JOUR(PID_T, INT) //
+//////////////////////////////////////////////////////////////////////
+// Reporte un changement d'état (donné par waitpid) sur la tâche du //
+// processus pid. Appelée par le gestionnaire de SIGCHLD : aucune   //
+// allocation ici.                                                  //
+//////////////////////////////////////////////////////////////////////
+
+static void
+mettre_a_jour(pid_t pid, int st){
+  Entree *e;
+  Tache *t;
+  int i;
+
+  if (capacite_index == 0 || (e = case_pid(pid))->pid == 0)
+    return; // Pas un processus d'une tâche
+  t = &taches[e->numero - 1];
+  for (i = 0; t->pids[i] != pid; i++)
+    ;
+
+  if (WIFSTOPPED(st)){
+    if (t->etats[i] == EN_COURS){
+      t->etats[i] = STOPPE;
+      t->stoppes++;
+    }
+    return;
+  }
+  if (WIFCONTINUED(st)){
+    if (t->etats[i] == STOPPE){
+      t->etats[i] = EN_COURS;
+      t->stoppes--;
+    }
+    return;
+  }
+
+  if (t->etats[i] == STOPPE)
+    t->stoppes--;
+  t->etats[i] = TERMINE;
+  t->restants--;
+  if (i == t->nb_pids - 1)
+    t->statut = statut_normalise(st);
+  desindexer_pid(pid);
+
+  if (t->restants == 0)
+    finies[nb_finies++] = t->numero;
+}
+
+////////////////////////////////
+// VOID RECOLTER_TACHES(VOID) //
+////////////////////////////////////////////////////////////////////////
+// Récolte tous les fils ayant changé d'état, sans attendre. Appelée  //
+// par le gestionnaire de SIGCHLD, ou SIGCHLD bloqué quand aucun fils //
+// au premier plan n'est en cours.                                    //
+////////////////////////////////////////////////////////////////////////
+
+void
+recolter_taches(void){
+  pid_t pid;
+  int st;
+
+  while ((pid = waitpid(-1, &st, WNOHANG | WUNTRACED | WCONTINUED)) > 0)
+    mettre_a_jour(pid, st);
+}
+
+static void
+sur_sigchld(int sig){
+  int errno_sauve = errno;
+  recolter_taches();
+  errno = errno_sauve;
+}
+
+void
+bloquer_recolte(void){
+  sigprocmask(SIG_BLOCK, &masque_sigchld, NULL);
+}
+
+void
+debloquer_recolte(void){
+  sigprocmask(SIG_UNBLOCK, &masque_sigchld, NULL);
+}
+
+///////////////////////////////////
+// VOID INITIALISER_TACHES(BOOL) //
+//////////////////////////////////////////////////////////////////////
+// Installe la récolte asynchrone des fils. Un shell interactif qui //
+// possède son terminal active en plus le contrôle des tâches : il  //
+// ignore les signaux du clavier, que reçoivent seuls ses fils.     //
+//////////////////////////////////////////////////////////////////////
+
+void
+initialiser_taches(bool interactif){
+  struct sigaction action;
+
+  sigemptyset(&masque_sigchld);
+  sigaddset(&masque_sigchld, SIGCHLD);
+
+  memset(&action, 0, sizeof(action));
+  action.sa_handler = sur_sigchld;
+  action.sa_flags = SA_RESTART;
+  sigemptyset(&action.sa_mask);
+  sigaction(SIGCHLD, &action, NULL);
+
+  controle_des_taches = interactif && au_premier_plan();
+  if (controle_des_taches){
+    signal(SIGINT, SIG_IGN);
+    signal(SIGQUIT, SIG_IGN);
+    signal(SIGTSTP, SIG_IGN);
+    signal(SIGTTIN, SIG_IGN);
+    signal(SIGTTOU, SIG_IGN);
+  }
+}
+
+////////////////////////////
+// BOOL AU_PREMIER_PLAN() //
+///////////////////////////////////////////////////////////////////////
+// Vrai si le shell lit un terminal dont il est le groupe au premier //
+// plan (et peut donc le donner à ses fils)                          //
+///////////////////////////////////////////////////////////////////////
+
+bool
+au_premier_plan(void){
+  return isatty(STDIN_FILENO) && tcgetpgrp(STDIN_FILENO) == getpgrp();
+}
+
+/////////////////////////////////
+// VOID DONNER_TERMINAL(PID_T) //
+///////////////////////////////////////////////////////////////////////////
+// Met le groupe pgid au premier plan du terminal. SIGTTOU est bloqué le //
+// temps de l'appel, sans quoi un processus en arrière-plan serait       //
+// suspendu par tcsetpgrp().                                             //
+///////////////////////////////////////////////////////////////////////////
+
+void
+donner_terminal(pid_t pgid){
+  sigset_t masque, ancien;
+
+  sigemptyset(&masque);
+  sigaddset(&masque, SIGTTOU);
+  sigprocmask(SIG_BLOCK, &masque, &ancien);
+  tcsetpgrp(STDIN_FILENO, pgid);
+  sigprocmask(SIG_SETMASK, &ancien, NULL);
+}
+
+void
+reprendre_terminal(void){
+  donner_terminal(getpgrp());
+}
+
+/////////////////////////////////////
+// PID_T FORKER_SHELL(PID_T, BOOL) //
+//////////////////////////////////////////////////////////////////////
+// Forke un fils qui continue à évaluer du shell. pgid suit la même //
+// convention que lancer_commande(). Le fils oublie la table des    //
+// tâches du père et remet les signaux dans leur état par défaut.   //
+//////////////////////////////////////////////////////////////////////
+
+static void oublier_taches(void);
+
+pid_t
+forker_shell(pid_t pgid, bool terminal){
+  pid_t pid;
+
+  fflush(stdout); // Sinon le fils hériterait du tampon non vidé
+
+  if ((pid = fork()) == -1){
+    perror("fork");
+    return -1;
+  }
+
+  if (pid == 0){
+    if (pgid >= 0)
+      setpgid(0, pgid);
+    if (terminal)
+      donner_terminal(getpgrp());
+    signal(SIGINT, SIG_DFL);
+    signal(SIGQUIT, SIG_DFL);
+    signal(SIGTSTP, SIG_DFL);
+    signal(SIGTTIN, SIG_DFL);
+    signal(SIGTTOU, SIG_DFL);
+    signal(SIGCHLD, SIG_DFL);
+    controle_des_taches = false;
+    oublier_taches();
+    return 0;
+  }
+
+  if (pgid >= 0)
+    setpgid(pid, pgid ? pgid : pid);
+  return pid;
+}
+
+////////////////////////////////////////////
+// TACHE* CREER_TACHE(PID_T*, INT, PID_T) //
+///////////////////////////////////////////////////////////////////////
+// Range une nouvelle tâche dans la table (SIGCHLD bloqué). Les pids //
+// valant -1 (processus qui n'ont pas pu être lancés) sont ignorés.  //
+///////////////////////////////////////////////////////////////////////
+
+static Tache *
+creer_tache(pid_t *pids, int n, pid_t pgid){
+  Tache *t;
+  int numero;
+
+  if (nb_libres == 0){
+    int ancienne = capacite;
+    capacite = capacite ? 2 * capacite : 16;
+    taches = realloc(taches, capacite * sizeof(Tache));
+    libres = realloc(libres, capacite * sizeof(int));
+    finies = realloc(finies, capacite * sizeof(int));
+    for (int i = capacite; i > ancienne; i--)
+      libres[nb_libres++] = i;
+    memset(taches + ancienne, 0, (capacite - ancienne) * sizeof(Tache));
+  }
+
+  numero = libres[--nb_libres];
+  t = &taches[numero - 1];
+  t->numero = numero;
+  t->pgid = pgid;
+  t->pids = malloc((n + 1) * sizeof(pid_t));
+  t->etats = malloc(n + 1);
+  t->nb_pids = 0;
+  t->stoppes = 0;
+  t->statut = 127;
+  t->commande = NULL;
+
+  for (int i = 0; i < n; i++)
+    if (pids[i] != -1){
+      t->pids[t->nb_pids] = pids[i];
+      t->etats[t->nb_pids++] = EN_COURS;
+      indexer_pid(pids[i], numero);
+    }
+  t->restants = t->nb_pids;
+
+  // Le dernier processus n'a pas pu être lancé : une entrée déjà terminée
+  // le remplace, pour que le statut (127) ne vienne pas de l'avant-dernier
+  if (n > 0 && pids[n - 1] == -1){
+    t->pids[t->nb_pids] = 0;
+    t->etats[t->nb_pids++] = TERMINE;
+  }
+
+  if (t->restants == 0)
+    finies[nb_finies++] = numero;
+  return t;
+}
+
+static void
+retirer_des_finies(int numero){
+  for (int i = 0; i < nb_finies; i++)
+    if (finies[i] == numero)
+      finies[i] = finies[--nb_finies];
+}
+
+static void
+liberer_tache(Tache *t){
+  for (int i = 0; i < t->nb_pids; i++)
+    if (t->etats[i] != TERMINE)
+      desindexer_pid(t->pids[i]);
+  free(t->pids);
+  free(t->etats);
+  free(t->commande);
+  libres[nb_libres++] = t->numero;
+  if (courante == t->numero)
+    courante = 0;
+  t->numero = 0;
+}
+
+static void
+oublier_taches(void){
+  for (int i = 0; i < capacite; i++)
+    if (taches[i].numero != 0)
+      liberer_tache(&taches[i]);
+  nb_finies = 0;
+}
+
+////////////////////////////////////////////////////////
+// VOID LANCER_TACHE(PID_T*, INT, PID_T, EXPRESSION*) //
+//////////////////////////////////////////////////////////////////
+// Enregistre la commande e, dont les processus viennent d'être //
+// lancés en arrière-plan                                       //
+//////////////////////////////////////////////////////////////////
+
+void
+lancer_tache(pid_t *pids, int n, pid_t pgid, Expression *e){
+  Tache *t = creer_tache(pids, n, pgid);
+
+  t->commande = expr_en_texte(e);
+  courante = t->numero;
+  if (controle_des_taches)
+    fprintf(stderr, "[%d] %d\n", t->numero, (int) pids[n - 1]);
+
+  // Le moment de récolter les tâches précédentes déjà terminées, au cas où
+  // la ligne en lancerait des milliers
+  recolter_taches();
+}
+
+////////////////////////////////
+// INT ATTENDRE_TACHE(TACHE*) //
+//////////////////////////////////////////////////////////////////////
+// Attend (SIGCHLD bloqué) que la tâche t soit terminée ou stoppée, //
+// et renvoie son statut                                            //
+//////////////////////////////////////////////////////////////////////
+
+int
+attendre_tache(Tache *t){
+  int st;
+
+  for (int i = 0; i < t->nb_pids && t->stoppes == 0; i++){
+    if (t->etats[i] != EN_COURS)
+      continue;
+    if (attendre_processus(t->pids[i], &st, WUNTRACED) == -1){
+      if (errno == EINTR){
+	i--;
+	continue;
+      }
+      st = 0; // Déjà récolté ailleurs : on le considère terminé
+    }
+    mettre_a_jour(t->pids[i], st);
+  }
+
+  return t->stoppes ? 128 + SIGTSTP : t->statut;
+}
+
+////////////////////////////////////////////////////////////////
+// INT ATTENDRE_PREMIER_PLAN(PID_T*, INT, PID_T, EXPRESSION*) //
+////////////////////////////////////////////////////////////////////
+// Attend les processus d'une commande lancée au premier plan, et //
+// renvoie le statut du dernier. Avec le contrôle des tâches, le  //
+// terminal lui est donné le temps de l'attente ; si elle est     //
+// stoppée (Ctrl-Z), elle reste dans la table des tâches.         //
+////////////////////////////////////////////////////////////////////
+
+int
+attendre_premier_plan(pid_t *pids, int n, pid_t pgid, Expression *e){
+  double debut = horloge();
+  Tache *t;
+  int st = 127;
+
+  if (!controle_des_taches){
+    for (int i = 0; i < n; i++)
+      if (pids[i] != -1)
+	st = attendre_commande(pids[i]);
+      else if (i == n - 1)
+	st = 127;
+    observer(DUREE_ATTENTE, debut, horloge());
+    return st;
+  }
+
+  t = creer_tache(pids, n, pgid);
+  if (pgid > 0){
+    donner_terminal(pgid);
+    // Un fils lancé par posix_spawn a pu lire le terminal avant qu'on ne
+    // le lui donne, et être suspendu par SIGTTIN : on le relance
+    killpg(pgid, SIGCONT);
+  }
+  st = attendre_tache(t);
+  reprendre_terminal();
+
+  if (t->stoppes){
+    t->commande = expr_en_texte(e);
+    courante = t->numero;
+    fprintf(stderr, "\n[%d]+  Stoppé\t\t%s\n", t->numero, t->commande);
+  }
+  else {
+    retirer_des_finies(t->numero); // Rien à annoncer au premier plan
+    liberer_tache(t);
+  }
+  observer(DUREE_ATTENTE, debut, horloge());
+  return st;
+}
+
+////////////////////////////////
+// VOID SIGNALER_TACHES(VOID) //
+///////////////////////////////////////////////////////////////////
+// Annonce (en mode interactif) puis libère les tâches terminées //
+// depuis la dernière invite                                     //
+///////////////////////////////////////////////////////////////////
+
+static void
+afficher_tache(FILE *f, Tache *t){
+  char etat[32];
+
+  if (t->restants == 0){
+    if (t->statut == 0)
+      snprintf(etat, sizeof(etat), "Fini");
+    else
+      snprintf(etat, sizeof(etat), "Sortie %d", t->statut);
+  }
+  else
+    snprintf(etat, sizeof(etat), t->stoppes ? "Stoppé" : "En cours");
+
+  fprintf(f, "[%d]%c  %-12s\t%s\n", t->numero, (t->numero == courante) ? '+' : ' ',
+	  etat, t->commande ? t->commande : "");
+}
+
+void
+signaler_taches(void){
+  Tache *t;
+
+  bloquer_recolte();
+  while (nb_finies > 0){
+    t = &taches[finies[--nb_finies] - 1];
+    if (controle_des_taches)
+      afficher_tache(stderr, t);
+    liberer_tache(t);
+  }
+  debloquer_recolte();
+}
+
+///////////////////////////////////////
+// TACHE* TROUVER_TACHE(CONST CHAR*) //
+/////////////////////////////////////////////////////////////////////
+// Renvoie la tâche désignée par "n" ou "%n", ou la tâche courante //
+// si designation vaut NULL ; NULL si elle n'existe pas            //
+/////////////////////////////////////////////////////////////////////
+
+Tache *
+trouver_tache(const char *designation){
+  char *fin;
+  long n;
+
+  if (designation == NULL){
+    if (courante == 0) // Sinon la plus récente encore en vie
+      for (int i = capacite - 1; i >= 0 && courante == 0; i--)
+	if (taches[i].numero != 0)
+	  courante = taches[i].numero;
+    n = courante;
+  }
+  else {
+    if (*designation == '%')
+      designation++;
+    n = strtol(designation, &fin, 10);
+    if (*designation == '\0' || *fin != '\0')
+      return NULL;
+  }
+
+  if (n < 1 || n > capacite || taches[n - 1].numero == 0)
+    return NULL;
+  return &taches[n - 1];
+}
+
+void
+afficher_taches(FILE *f){
+  for (int i = 0; i < capacite; i++)
+    if (taches[i].numero != 0)
+      afficher_tache(f, &taches[i]);
+}
+
+//////////////////////////////////
+// INT ATTENDRE_TOUTES_TACHES() //
+//////////////////////////////////////////////////////////////////////
+// Attend la fin de toutes les tâches en cours (les tâches stoppées //
+// ne sont pas attendues)                                           //
+//////////////////////////////////////////////////////////////////////
+
+int
+attendre_toutes_taches(void){
+  for (int i = 0; i < capacite; i++)
+    if (taches[i].numero != 0 && taches[i].stoppes == 0)
+      attendre_tache(&taches[i]);
+  return 0;
+}
+
+///////////////////////////////////////
+// INT REPRENDRE_TACHE(TACHE*, BOOL) //
+//////////////////////////////////////////////////////////////
+// Relance la tâche t (SIGCONT), au premier plan (fg) ou en //
+// arrière-plan (bg)                                        //
+//////////////////////////////////////////////////////////////
+
+static void
+envoyer_signal(Tache *t, int sig){
+  if (controle_des_taches)
+    killpg(t->pgid, sig);
+  else
+    for (int i = 0; i < t->nb_pids; i++)
+      if (t->etats[i] != TERMINE)
+	kill(t->pids[i], sig);
+}
+
+int
+reprendre_tache(Tache *t, bool premier_plan){
+  int st;
+
+  courante = t->numero;
+  for (int i = 0; i < t->nb_pids; i++)
+    if (t->etats[i] == STOPPE)
+      t->etats[i] = EN_COURS;
+  t->stoppes = 0;
+
+  if (!premier_plan){
+    envoyer_signal(t, SIGCONT);
+    fprintf(stdout, "[%d]+ %s &\n", t->numero, t->commande);
+    return 0;
+  }
+
+  fprintf(stdout, "%s\n", t->commande);
+  fflush(stdout);
+  if (controle_des_taches)
+    donner_terminal(t->pgid);
+  envoyer_signal(t, SIGCONT);
+  st = attendre_tache(t);
+  if (controle_des_taches)
+    reprendre_terminal();
+
+  if (t->stoppes)
+    fprintf(stderr, "\n[%d]+  Stoppé\t\t%s\n", t->numero, t->commande);
+  else {
+    retirer_des_finies(t->numero);
+    liberer_tache(t);
+  }
+  return st;
+}
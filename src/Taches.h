@@ -0,0 +1,50 @@
+#ifndef _TACHES_H
+#define _TACHES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include "Shell.h"
+
+/*
+ * Table des tâches : chaque commande lancée en arrière-plan (ou stoppée par
+ * Ctrl-Z) y est rangée sous son numéro, avec les pids de ses processus.
+ */
+
+typedef struct Tache {
+  int numero;           // 0 : case libre
+  pid_t pgid;           // Groupe de processus (ou pid du premier processus
+                        // quand le contrôle des tâches est inactif)
+  pid_t *pids;
+  char *etats;          // Etat de chaque processus (voir Taches.c)
+  int nb_pids;
+  int restants;         // Processus pas encore terminés
+  int stoppes;          // Processus actuellement stoppés
+  int statut;           // Statut normalisé du dernier processus
+  char *commande;
+} Tache;
+
+extern bool controle_des_taches;
+
+void initialiser_taches(bool interactif);
+void bloquer_recolte(void);
+void debloquer_recolte(void);
+void recolter_taches(void);
+void signaler_taches(void);
+
+bool au_premier_plan(void);
+void donner_terminal(pid_t pgid);
+void reprendre_terminal(void);
+pid_t forker_shell(pid_t pgid, bool terminal);
+
+void lancer_tache(pid_t *pids, int n, pid_t pgid, Expression *e);
+int attendre_premier_plan(pid_t *pids, int n, pid_t pgid, Expression *e);
+
+Tache *trouver_tache(const char *designation);
+void afficher_taches(FILE *f);
+int attendre_tache(Tache *t);
+int attendre_toutes_taches(void);
+int reprendre_tache(Tache *t, bool premier_plan);
+
+#endif
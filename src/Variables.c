@@ -0,0 +1,391 @@
+#include <ctype.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "Variables.h"
+#include "Arene.h"
+#include "Shell.h"
+#include "Substitution.h"
+
+/*--------------------------------------------------------------------------------------.
+| Variables du shell, dans une table de hachage à adressage ouvert (sondage linéaire,   |
+| comme le cache des commandes). Chaque variable est gardée sous la forme "NOM=valeur", |
+| directement utilisable dans un environnement. Les variables d'environnement reçues    |
+| sont recopiées dans la table au premier accès, marquées exportées.                    |
+|                                                                                       |
+| Le tableau envp passé aux commandes n'est reconstruit que si une variable exportée a  |
+| changé (affectée, exportée, supprimée) depuis la dernière construction : un script    |
+| qui lance des milliers de commandes ne le paie qu'une fois.                           |
+|                                                                                       |
+| $NOM, ${NOM}, $? et $(...) sont substitués dans les arguments juste avant leur        |
+| développement (Motifs.c). Comme dans zsh, la valeur n'est ni découpée en mots ni      |
+| développée : ses jokers sont protégés par un '\'. Seule la sortie d'un $(...) hors    |
+| guillemets est ensuite découpée. Un mot entre apostrophes n'est pas substitué.        |
+`--------------------------------------------------------------------------------------*/
+
+#define CAPACITE_INITIALE 64
+
+typedef struct Variable {
+  char *texte;            // "NOM=valeur", NULL pour une case vide
+  size_t longueur_nom;
+  uint32_t hachage;
+  bool exportee;
+} Variable;
+
+extern char **environ;
+
+static Variable *table = NULL;
+static size_t capacite = 0, nombre = 0;
+static bool importees = false;   // environ recopié dans la table
+
+static char **envp = NULL;       // Environnement des commandes lancées
+static size_t capacite_envp = 0;
+static bool envp_perime = true;  // Une variable exportée a changé depuis sa construction
+
+static uint32_t
+hacher(const char *s, size_t n){
+  uint32_t h = 2166136261u; // FNV-1a
+  while (n-- > 0)
+    h = (h ^ (unsigned char) *s++) * 16777619u;
+  return h;
+}
+
+///////////////////////////////////////////////////////////
+// VARIABLE* TROUVER_CASE(CONST CHAR*, SIZE_T, UINT32_T) //
+//////////////////////////////////////////////////////////////////////
+// Sondage linéaire : renvoie la case du nom (n octets), ou la case //
+// vide où il faudrait l'insérer                                    //
+//////////////////////////////////////////////////////////////////////
+
+static Variable *
+trouver_case(const char *nom, size_t n, uint32_t h){
+  size_t i = h & (capacite - 1);
+
+  while (table[i].texte != NULL
+	 && (table[i].hachage != h || table[i].longueur_nom != n
+	     || memcmp(table[i].texte, nom, n) != 0))
+    i = (i + 1) & (capacite - 1);
+  return &table[i];
+}
+
+static void
+agrandir_table(void){
+  Variable *ancienne = table;
+  size_t ancienne_capacite = capacite;
+
+  capacite = capacite ? 2 * capacite : CAPACITE_INITIALE;
+  if ((table = calloc(capacite, sizeof(Variable))) == NULL){
+    perror("calloc");
+    exit(EXIT_FAILURE);
+  }
+  for (size_t i = 0; i < ancienne_capacite; i++)
+    if (ancienne[i].texte != NULL)
+      *trouver_case(ancienne[i].texte, ancienne[i].longueur_nom, ancienne[i].hachage) = ancienne[i];
+  free(ancienne);
+}
+
+static void importer(void);
+
+static Variable *
+chercher(const char *nom, size_t n){
+  Variable *v;
+
+  if (!importees)
+    importer();
+  if (capacite == 0)
+    return NULL;
+  v = trouver_case(nom, n, hacher(nom, n));
+  return (v->texte != NULL) ? v : NULL;
+}
+
+//////////////////////////////////////////////////////////
+// VOID DEFINIR(CONST CHAR*, SIZE_T, CONST CHAR*, BOOL) //
+//////////////////////////////////////////////////////////////////////
+// Donne sa valeur au nom (n octets). Une variable déjà exportée le //
+// reste ; exporter l'exporte dans tous les cas.                    //
+//////////////////////////////////////////////////////////////////////
+
+static void
+definir(const char *nom, size_t n, const char *valeur, bool exporter){
+  size_t l = strlen(valeur);
+  uint32_t h = hacher(nom, n);
+  Variable *v;
+  char *texte;
+
+  if (!importees)
+    importer();
+  if (2 * (nombre + 1) > capacite)
+    agrandir_table();
+
+  if ((texte = malloc(n + l + 2)) == NULL){
+    perror("malloc");
+    exit(EXIT_FAILURE);
+  }
+  memcpy(texte, nom, n);
+  texte[n] = '=';
+  memcpy(texte + n + 1, valeur, l + 1);
+
+  v = trouver_case(nom, n, h);
+  if (v->texte == NULL){
+    *v = (Variable){NULL, n, h, false};
+    nombre++;
+  }
+  free(v->texte); // Après la copie : valeur peut être l'ancienne valeur
+  v->texte = texte;
+  v->exportee |= exporter;
+  if (v->exportee)
+    envp_perime = true;
+}
+
+static void
+importer(void){
+  const char *egal;
+
+  importees = true;
+  for (char **e = environ; e != NULL && *e != NULL; e++)
+    if ((egal = strchr(*e, '=')) != NULL)
+      definir(*e, egal - *e, egal + 1, true);
+}
+
+//////////////////////////////////////////////
+// CONST CHAR* VALEUR_VARIABLE(CONST CHAR*) //
+//////////////////////////////////////////////////////////
+// Valeur de la variable nom, NULL si elle n'existe pas //
+//////////////////////////////////////////////////////////
+
+const char *
+valeur_variable(const char *nom){
+  Variable *v = chercher(nom, strlen(nom));
+  return (v != NULL) ? v->texte + v->longueur_nom + 1 : NULL;
+}
+
+void
+affecter_variable(const char *nom, const char *valeur){
+  definir(nom, strlen(nom), valeur, false);
+}
+
+// export NOM : une variable qui n'existe pas est créée vide
+
+void
+exporter_variable(const char *nom){
+  Variable *v = chercher(nom, strlen(nom));
+
+  if (v == NULL)
+    definir(nom, strlen(nom), "", true);
+  else if (!v->exportee){
+    v->exportee = true;
+    envp_perime = true;
+  }
+}
+
+//////////////////////////////////////////
+// VOID SUPPRIMER_VARIABLE(CONST CHAR*) //
+//////////////////////////////////////////////////////////////////////
+// Retire une variable (unset). Les cases suivantes de la même      //
+// grappe sont réinsérées, pour que le sondage linéaire ne s'arrête //
+// pas sur le trou.                                                 //
+//////////////////////////////////////////////////////////////////////
+
+void
+supprimer_variable(const char *nom){
+  Variable *v = chercher(nom, strlen(nom)), deplacee;
+  size_t i;
+
+  if (v == NULL)
+    return;
+  if (v->exportee)
+    envp_perime = true;
+  free(v->texte);
+  v->texte = NULL;
+  nombre--;
+
+  for (i = (v - table + 1) & (capacite - 1); table[i].texte != NULL; i = (i + 1) & (capacite - 1)){
+    deplacee = table[i];
+    table[i].texte = NULL;
+    *trouver_case(deplacee.texte, deplacee.longueur_nom, deplacee.hachage) = deplacee;
+  }
+}
+
+void
+afficher_variables(FILE *f, bool exportees){
+  if (!importees)
+    importer();
+  for (size_t i = 0; i < capacite; i++)
+    if (table[i].texte != NULL && (table[i].exportee || !exportees))
+      fprintf(f, "%s\n", table[i].texte);
+}
+
+// Un nom de variable : lettres, chiffres et '_', sans chiffre en tête
+
+bool
+nom_valide(const char *nom, size_t longueur){
+  if (longueur == 0 || isdigit((unsigned char) nom[0]))
+    return false;
+  for (size_t i = 0; i < longueur; i++)
+    if (!isalnum((unsigned char) nom[i]) && nom[i] != '_')
+      return false;
+  return true;
+}
+
+bool
+est_affectation(const char *mot){
+  const char *egal = strchr(mot, '=');
+  return egal != NULL && nom_valide(mot, egal - mot);
+}
+
+// NOM=valeur (mot vérifié par est_affectation)
+
+void
+affecter_mot(const char *mot, bool exporter){
+  const char *egal = strchr(mot, '=');
+  definir(mot, egal - mot, egal + 1, exporter);
+}
+
+////////////////////////////////
+// CHAR** ENVIRONNEMENT(VOID) //
+////////////////////////////////////////////////////////////////////////
+// Environnement des commandes lancées : les variables exportées. Les //
+// chaînes sont celles de la table, seul le tableau est reconstruit.  //
+////////////////////////////////////////////////////////////////////////
+
+char **
+environnement(void){
+  size_t n = 0;
+
+  if (!importees)
+    importer();
+  if (!envp_perime)
+    return envp;
+
+  if (nombre + 1 > capacite_envp){
+    capacite_envp = 2 * (nombre + 1);
+    if ((envp = realloc(envp, capacite_envp * sizeof(char *))) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  for (size_t i = 0; i < capacite; i++)
+    if (table[i].texte != NULL && table[i].exportee)
+      envp[n++] = table[i].texte;
+  envp[n] = NULL;
+  envp_perime = false;
+  return envp;
+}
+
+/*--------------------------------------------------------------------------------------.
+| Substitution. Le mot est sous la forme que comprend Motifs.c : un '\' protège le      |
+| caractère suivant, et reste en place pour le développement des motifs qui suit. Les   |
+| valeurs insérées sont protégées de la même façon.                                     |
+`--------------------------------------------------------------------------------------*/
+
+static char *tampon = NULL;
+static size_t longueur = 0, capacite_tampon = 0;
+
+static void
+ajouter(char c){
+  if (longueur == capacite_tampon){
+    capacite_tampon = capacite_tampon ? 2 * capacite_tampon : 256;
+    if ((tampon = realloc(tampon, capacite_tampon)) == NULL){
+      perror("realloc");
+      exit(EXIT_FAILURE);
+    }
+  }
+  tampon[longueur++] = c;
+}
+
+static void
+inserer(const char *valeur){
+  for (; *valeur != '\0'; valeur++){
+    if (*valeur == '*' || *valeur == '?' || *valeur == '\\')
+      ajouter('\\');
+    ajouter(*valeur);
+  }
+}
+
+// $(...) : la commande exécutée reprend ce tampon pour ses propres
+// substitutions, la partie déjà construite est mise de côté le temps de
+// l'exécution
+
+static char *
+substituer(const char *p, const char **suite){
+  size_t n = longueur, i;
+  char *debut = arene_copier(&arene_ligne, tampon ? tampon : "", n);
+  char *sortie = substituer_commande(p, suite);
+
+  longueur = 0;
+  for (i = 0; i < n; i++)
+    ajouter(debut[i]);
+  return sortie;
+}
+
+/////////////////////////////////////////////
+// CHAR* SUBSTITUER_VARIABLES(CONST CHAR*) //
+///////////////////////////////////////////////////////////////////////
+// Renvoie mot, ou s'il contient des $ non protégés une copie prise  //
+// dans l'arène où ils sont remplacés. Une variable inexistante vaut //
+// "" ; un $ qui n'introduit pas un nom reste tel quel. *decouper    //
+// (si non NULL) devient vrai si un $(...) hors guillemets a été     //
+// substitué : le résultat est à découper en mots.                   //
+///////////////////////////////////////////////////////////////////////
+
+char *
+substituer_variables(const char *mot, bool *decouper){
+  const char *p, *nom, *fin;
+  char statut[16], *sortie;
+  Variable *v;
+  size_t n;
+
+  for (p = mot; *p != '\0' && *p != '$'; p++)
+    if (*p == '\\' && p[1] != '\0')
+      p++;
+  if (*p == '\0')
+    return (char *) mot;
+
+  longueur = 0;
+  for (p = mot; *p != '\0'; ){
+    if (*p == '\\' && p[1] != '\0'){
+      ajouter(*p++);
+      ajouter(*p++);
+      continue;
+    }
+    if (*p != '$'){
+      ajouter(*p++);
+      continue;
+    }
+
+    if ((p[1] == '(' || (p[1] == '\\' && p[2] == '(')) && (sortie = substituer(p, &fin)) != NULL){
+      if (p[1] == '(' && decouper != NULL)
+	*decouper = true;
+      inserer(sortie);
+      p = fin;
+      continue;
+    }
+    if (p[1] == '?'){
+      snprintf(statut, sizeof(statut), "%d", status);
+      inserer(statut);
+      p += 2;
+      continue;
+    }
+    if (p[1] == '{' && (fin = strchr(p + 2, '}')) != NULL && nom_valide(p + 2, fin - p - 2)){
+      nom = p + 2;
+      n = fin - nom;
+      p = fin + 1;
+    }
+    else if (isalpha((unsigned char) p[1]) || p[1] == '_'){
+      nom = p + 1;
+      for (n = 0; isalnum((unsigned char) nom[n]) || nom[n] == '_'; n++)
+	;
+      p = nom + n;
+    }
+    else {
+      ajouter(*p++);
+      continue;
+    }
+
+    if ((v = chercher(nom, n)) != NULL)
+      inserer(v->texte + v->longueur_nom + 1);
+  }
+
+  return arene_copier(&arene_ligne, tampon ? tampon : "", longueur);
+}
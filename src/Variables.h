@@ -0,0 +1,26 @@
+#ifndef _VARIABLES_H
+#define _VARIABLES_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+/*
+ * Variables du shell. Les variables d'environnement reçues au démarrage en
+ * font partie, exportées ; l'environnement des commandes lancées est
+ * construit à partir des variables exportées.
+ */
+
+const char *valeur_variable(const char *nom);
+void affecter_variable(const char *nom, const char *valeur);
+void exporter_variable(const char *nom);
+void supprimer_variable(const char *nom);
+void afficher_variables(FILE *f, bool exportees);
+
+bool nom_valide(const char *nom, size_t longueur);
+bool est_affectation(const char *mot);
+void affecter_mot(const char *mot, bool exporter);
+
+char **environnement(void);
+char *substituer_variables(const char *mot, bool *decouper);
+
+#endif